@@ -0,0 +1,114 @@
+#include <boost/beast/core/detail/base64.hpp>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base64.h"
+
+// Compare the base64 implementations of common/ with boost::beast::detail::base64 (used before):
+// the results must be the same, the speed is given in MB/s of decoded data
+
+namespace beast64 = boost::beast::detail::base64;
+
+// each measure repeats the operation for at least this time
+#define MIN_TIME std::chrono::milliseconds(300)
+
+/**
+ * @param op operation to measure
+ * @param bytes decoded bytes processed by an execution of op
+ * @return MB/s
+ */
+template <class Op>
+static double measure(Op op, std::size_t bytes) {
+    std::size_t runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    while (elapsed < MIN_TIME) {
+        op();
+        runs++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    return static_cast<double>(bytes) * runs / seconds / 1e6;
+}
+
+/**
+ * check that the results are the same of beast for random data of every size up to 256 bytes
+ * and for strings with padding and invalid characters
+ *
+ * @return true if all the results are the same
+ */
+static bool check(std::mt19937 &rng) {
+    for (std::size_t n = 0; n <= 256; n++) {
+        std::vector<unsigned char> data(n);
+        for (unsigned char &b: data)
+            b = rng();
+
+        std::string expected(beast64::encoded_size(n), 0), encoded(base64::encoded_size(n), 0);
+        expected.resize(beast64::encode(&expected[0], data.data(), n));
+        encoded.resize(base64::encode(&encoded[0], data.data(), n));
+        if (encoded != expected)
+            return false;
+
+        // valid, truncated and with a invalid character in a random position
+        for (int variant = 0; variant < 3; variant++) {
+            std::string input = expected;
+            if (variant == 1 && !input.empty())
+                input.resize(rng() % input.size());
+            if (variant == 2 && !input.empty())
+                input[rng() % input.size()] = "!-_ \n\x80"[rng() % 6];
+
+            // a truncated input can give up to 2 bytes more than decoded_size
+            std::vector<char> a(beast64::decoded_size(input.size()) + 2), b(base64::decoded_size(input.size()) + 2);
+            auto ra = beast64::decode(a.data(), input.data(), input.size());
+            auto rb = base64::decode(b.data(), input.data(), input.size());
+            if (ra != rb || std::memcmp(a.data(), b.data(), ra.first) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    std::mt19937 rng(42);
+    std::cout << "default implementation: " << base64::implementation() << std::endl;
+
+    for (const std::string &name: base64::implementations()) {
+        base64::use_implementation(name);
+        if (!check(rng)) {
+            std::cerr << name << ": results different from beast" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << std::setw(10) << "size" << std::setw(10) << "impl"
+              << std::setw(16) << "encode MB/s" << std::setw(16) << "decode MB/s" << std::endl;
+
+    for (std::size_t size: {std::size_t(1024), std::size_t(64 * 1024), std::size_t(16 * 1024 * 1024)}) {
+        std::vector<unsigned char> data(size);
+        for (unsigned char &b: data)
+            b = rng();
+        std::string encoded(beast64::encoded_size(size), 0);
+        encoded.resize(beast64::encode(&encoded[0], data.data(), size));
+        std::unique_ptr<char[]> out{new char[encoded.size() + 64]};
+
+        double enc = measure([&]() { beast64::encode(out.get(), data.data(), size); }, size);
+        double dec = measure([&]() { beast64::decode(out.get(), encoded.data(), encoded.size()); }, size);
+        std::cout << std::setw(10) << size << std::setw(10) << "beast" << std::fixed << std::setprecision(0)
+                  << std::setw(16) << enc << std::setw(16) << dec << std::endl;
+
+        for (const std::string &name: base64::implementations()) {
+            base64::use_implementation(name);
+            enc = measure([&]() { base64::encode(out.get(), data.data(), size); }, size);
+            dec = measure([&]() { base64::decode(out.get(), encoded.data(), encoded.size()); }, size);
+            std::cout << std::setw(10) << size << std::setw(10) << name
+                      << std::setw(16) << enc << std::setw(16) << dec << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dao.h"
+
+// Compare the Dao (a connection for each thread in WAL mode, prepared statements kept) with a single connection
+// shared by the threads that prepares each query (used before): the threads look up the users of the tokens, one
+// request out of WRITE_EVERY saves a digest
+
+namespace fs = std::filesystem;
+
+namespace configuration {
+    std::string dbpath;
+}
+
+#define USERS 1000
+#define WRITE_EVERY 20
+// each measure lasts this time
+#define MEASURE_TIME std::chrono::milliseconds(1000)
+
+static std::string token_of(int user) {
+    return "token" + std::to_string(user);
+}
+
+// the previous access: one connection (serialized by the mutex of sqlite) and a statement prepared at each query
+class SharedConnection {
+    sqlite3 *db = nullptr;
+
+public:
+    explicit SharedConnection(const std::string &path) {
+        sqlite3_open(path.c_str(), &db);
+    }
+
+    ~SharedConnection() {
+        sqlite3_close(db);
+    }
+
+    bool getUserFromToken(const std::string &token) {
+        sqlite3_stmt *stmt = nullptr;
+        if (sqlite3_prepare_v2(db, "SELECT username FROM users WHERE token = ?", -1, &stmt, nullptr) != SQLITE_OK)
+            return false;
+        sqlite3_bind_text(stmt, 1, token.c_str(), token.size(), nullptr);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    bool saveDigest(const std::string &username, const std::string &path, const FileDigest &digest) {
+        sqlite3_stmt *stmt = nullptr;
+        if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO digests (username, path, size, mtime, inode, digest, "
+                                   "algorithm) VALUES (?, ?, ?, ?, ?, ?, ?)", -1, &stmt, nullptr) != SQLITE_OK)
+            return false;
+        sqlite3_bind_text(stmt, 1, username.c_str(), username.size(), nullptr);
+        sqlite3_bind_text(stmt, 2, path.c_str(), path.size(), nullptr);
+        sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(digest.size));
+        sqlite3_bind_int64(stmt, 4, digest.mtime);
+        sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(digest.inode));
+        sqlite3_bind_text(stmt, 6, digest.digest.c_str(), digest.digest.size(), nullptr);
+        sqlite3_bind_text(stmt, 7, "sha256", 6, nullptr);
+        bool done = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        return done;
+    }
+};
+
+/**
+ * @param nthreads number of threads making requests
+ * @param lookup function (thread, request) -> bool of a token lookup
+ * @param save function (thread, request) -> bool of a digest save
+ * @return requests per second, -1 if a request failed
+ */
+template <class Lookup, class Save>
+static double measure(int nthreads, Lookup lookup, Save save) {
+    std::atomic<bool> stop{false};
+    std::atomic<bool> failed{false};
+    std::atomic<std::uint64_t> requests{0};
+
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([&, t]() {
+            std::uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                bool ok = n % WRITE_EVERY == WRITE_EVERY - 1 ? save(t, n) : lookup(t, n);
+                if (!ok)
+                    failed = true;
+                n++;
+            }
+            requests += n;
+        });
+    }
+    std::this_thread::sleep_for(MEASURE_TIME);
+    stop = true;
+    for (std::thread &thread: threads)
+        thread.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return failed ? -1 : requests / secs;
+}
+
+static void remove_database(const std::string &path) {
+    fs::remove(path);
+    fs::remove(path + "-wal");
+    fs::remove(path + "-shm");
+}
+
+/**
+ * create a database with the users and their tokens
+ *
+ * @param path of the database
+ * @return false if it can't be created
+ */
+static bool create_database(const std::string &path) {
+    remove_database(path);
+
+    sqlite3 *db = nullptr;
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        return false;
+    }
+    sqlite3_exec(db, "CREATE TABLE users (username TEXT PRIMARY KEY, hash TEXT, token TEXT); "
+                     "CREATE INDEX users_token ON users (token); "
+                     "CREATE TABLE digests (username TEXT NOT NULL, path TEXT NOT NULL, algorithm TEXT NOT NULL, "
+                     "size INTEGER, mtime INTEGER, inode INTEGER, digest TEXT, "
+                     "PRIMARY KEY (username, path, algorithm)); BEGIN", nullptr, nullptr, nullptr);
+    for (int i = 0; i < USERS; i++) {
+        std::string insert = "INSERT INTO users VALUES ('user" + std::to_string(i) + "', 'hash', '" + token_of(i) + "')";
+        sqlite3_exec(db, insert.c_str(), nullptr, nullptr, nullptr);
+    }
+    bool ok = sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) == SQLITE_OK;
+    sqlite3_close(db);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    std::string path = argc > 1 ? argv[1] : (fs::temp_directory_path() / "dao_bench").string();
+    // the previous access uses the default journal mode, the Dao switches its database to WAL
+    std::string shared_path = path + "_shared.db", dao_path = path + "_dao.db";
+    if (!create_database(shared_path) || !create_database(dao_path)) {
+        std::cerr << "can't create the databases in " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    configuration::dbpath = dao_path;
+    Dao *dao = Dao::getInstance();
+    SharedConnection connection(shared_path);
+
+    FileDigest digest{1234, 5678, 42, std::string(64, 'a')};
+    auto lookup_token = [](int t, std::uint64_t n) { return token_of(static_cast<int>((n * 7 + t) % USERS)); };
+    auto digest_path = [](int t, std::uint64_t n) { return "thread" + std::to_string(t) + "/" + std::to_string(n % 100); };
+
+    std::cout << "users: " << USERS << ", 1 write every " << WRITE_EVERY << " requests" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(16) << "shared req/s" << std::setw(16) << "dao req/s"
+              << std::endl;
+
+    for (int nthreads: {1, 2, 4, 8}) {
+        double shared = measure(nthreads,
+                                [&](int t, std::uint64_t n) { return connection.getUserFromToken(lookup_token(t, n)); },
+                                [&](int t, std::uint64_t n) { return connection.saveDigest("user0", digest_path(t, n), digest); });
+        double pooled = measure(nthreads,
+                                [&](int t, std::uint64_t n) { return dao->getUserFromToken(lookup_token(t, n)).has_value(); },
+                                [&](int t, std::uint64_t n) { return dao->saveDigest("user0", digest_path(t, n), "sha256", digest); });
+
+        std::cout << std::setw(8) << nthreads << std::fixed << std::setprecision(0) << std::setw(16) << shared
+                  << std::setw(16) << pooled << std::endl;
+        if (shared < 0 || pooled < 0) {
+            std::cerr << "a request failed" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    remove_database(shared_path);
+    remove_database(dao_path);
+    return 0;
+}
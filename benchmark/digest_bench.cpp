@@ -0,0 +1,93 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blake3.h"
+#include "digest.h"
+
+// Check the BLAKE3 implementation with the official test vectors (and the incremental, multithreaded and file
+// versions between them), then compare the speed of SHA256 and BLAKE3 on a big file in the page cache
+
+namespace fs = std::filesystem;
+
+// input of the official test vectors: bytes 0, 1, ..., 250, 0, 1, ...
+static std::vector<unsigned char> vector_input(std::size_t len) {
+    std::vector<unsigned char> data(len);
+    for (std::size_t i = 0; i < len; i++)
+        data[i] = i % 251;
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    std::string path = argc > 1 ? argv[1] : (fs::temp_directory_path() / "digest_bench").string();
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const std::pair<std::size_t, const char *> vectors[] = {
+            {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+            {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+            {1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+            {1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+            {1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+            {2048, "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a"},
+    };
+    for (const auto &[len, expected]: vectors) {
+        std::vector<unsigned char> data = vector_input(len);
+        if (blake3::digest(data.data(), len) != expected) {
+            std::cerr << "wrong BLAKE3 digest of " << len << " bytes: " << blake3::digest(data.data(), len) << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // incremental (in random parts), multithreaded and file digests must be the same
+    std::mt19937 rng(42);
+    for (std::size_t len: {std::size_t(3000), std::size_t(65537), std::size_t(1 << 20), std::size_t(5000000),
+                           std::size_t(40 * 1024 * 1024 + 12345)}) {
+        std::vector<unsigned char> data = vector_input(len);
+        std::string expected = blake3::digest(data.data(), len);
+
+        blake3::Hasher hasher;
+        for (std::size_t pos = 0; pos < len;) {
+            std::size_t part = std::min<std::size_t>(rng() % 5000, len - pos);
+            hasher.update(data.data() + pos, part);
+            pos += part;
+        }
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(data.data()), len);
+        if (hasher.final() != expected || blake3::digest(data.data(), len, 4) != expected ||
+            blake3::file_digest(path, 4).value_or("") != expected) {
+            std::cerr << "different BLAKE3 digests of " << len << " bytes" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // speed on a file of 256 MiB
+    std::size_t size = 256 * 1024 * 1024;
+    {
+        std::vector<char> data(size);
+        for (char &c: data)
+            c = static_cast<char>(rng());
+        std::ofstream(path, std::ios::binary).write(data.data(), size);
+    }
+    std::cout << "file of " << size / (1024 * 1024) << " MiB, " << threads << " threads" << std::endl;
+    std::cout << std::setw(16) << "algorithm" << std::setw(12) << "MB/s" << std::endl;
+
+    auto measure = [&](const std::string &name, auto op) {
+        op();
+        auto start = std::chrono::steady_clock::now();
+        op();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::setw(16) << name << std::fixed << std::setprecision(0) << std::setw(12)
+                  << size / secs / 1e6 << std::endl;
+    };
+    measure("sha256", [&]() { digest::file(path, digest::algorithm_sha256); });
+    measure("blake3 x1", [&]() { blake3::file_digest(path, 1); });
+    measure("blake3 x" + std::to_string(threads), [&]() { blake3::file_digest(path, threads); });
+
+    fs::remove(path);
+    return 0;
+}
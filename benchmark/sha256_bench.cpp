@@ -0,0 +1,151 @@
+#include <openssl/evp.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sha256.h"
+
+// Compare the digests of a tree of files computed by the engines of common/sha256 with the loop used before
+// (2 KB fread and EVP_DigestUpdate, a new context for each file): the results must be the same, the speed is given
+// in files/s and MB/s with the files in the page cache
+
+namespace fs = std::filesystem;
+
+#define OLD_BUF_SIZE 2048
+
+/**
+ * the digest of a file as it was computed before
+ */
+static std::string old_digest(const std::string &path) {
+    unsigned char buf[OLD_BUF_SIZE];
+    FILE *fin = fopen(path.c_str(), "rb");
+    if (!fin)
+        return {};
+    EVP_MD_CTX *md = EVP_MD_CTX_new();
+    EVP_DigestInit(md, EVP_sha256());
+    std::size_t n;
+    while ((n = fread(buf, 1, OLD_BUF_SIZE, fin)) > 0)
+        EVP_DigestUpdate(md, buf, n);
+    fclose(fin);
+
+    unsigned char md_value[EVP_MAX_MD_SIZE];
+    char hex_digest[EVP_MAX_MD_SIZE * 2 + 1];
+    unsigned int md_len;
+    EVP_DigestFinal_ex(md, md_value, &md_len);
+    EVP_MD_CTX_free(md);
+    for (unsigned int i = 0; i < md_len; i++)
+        sprintf(hex_digest + 2 * i, "%02x", md_value[i]);
+    hex_digest[md_len * 2] = 0;
+    return hex_digest;
+}
+
+/**
+ * create the files of a test
+ *
+ * @param dir where the files are created
+ * @param n number of files
+ * @param max_size the size of each file is random up to this
+ * @return the paths of the files and the total size
+ */
+static std::pair<std::vector<std::string>, std::size_t> make_files(const std::string &dir, std::size_t n,
+                                                                   std::size_t max_size, std::mt19937 &rng) {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::vector<std::string> paths;
+    std::size_t total = 0;
+    std::vector<char> data(max_size);
+    for (std::size_t i = 0; i < n; i++) {
+        std::size_t size = rng() % (max_size + 1);
+        for (std::size_t j = 0; j < size; j++)
+            data[j] = static_cast<char>(rng());
+        paths.push_back(dir + "/" + std::to_string(i));
+        std::ofstream(paths.back(), std::ios::binary).write(data.data(), size);
+        total += size;
+    }
+    return {paths, total};
+}
+
+template <class Op>
+static double seconds(Op op) {
+    auto start = std::chrono::steady_clock::now();
+    op();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void print(const std::string &name, std::size_t files, std::size_t bytes, double secs) {
+    std::cout << std::setw(22) << name << std::fixed << std::setprecision(0)
+              << std::setw(14) << files / secs << std::setw(12) << bytes / secs / 1e6 << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string base = argc > 1 ? argv[1] : (fs::temp_directory_path() / "sha256_bench").string();
+    std::mt19937 rng(42);
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "default engine: " << sha256::implementation() << ", threads: " << threads << std::endl;
+
+    struct Test {
+        const char *name;
+        std::size_t files;
+        std::size_t max_size;
+    };
+    for (const Test &test: {Test{"small (0-4 KiB)", 20000, 4096}, Test{"medium (0-64 KiB)", 5000, 65536},
+                            Test{"large (0-16 MiB)", 16, 16 * 1024 * 1024}}) {
+        auto [paths, total] = make_files(base, test.files, test.max_size, rng);
+        std::cout << test.name << ": " << paths.size() << " files, " << total / 1000000 << " MB" << std::endl;
+        std::cout << std::setw(22) << "engine" << std::setw(14) << "files/s" << std::setw(12) << "MB/s" << std::endl;
+
+        std::vector<std::string> expected(paths.size());
+        // the first reading puts the files in the cache
+        seconds([&]() {
+            for (std::size_t i = 0; i < paths.size(); i++)
+                expected[i] = old_digest(paths[i]);
+        });
+        print("fread 2 KB", paths.size(), total, seconds([&]() {
+            for (std::size_t i = 0; i < paths.size(); i++)
+                expected[i] = old_digest(paths[i]);
+        }));
+
+        for (const std::string &name: sha256::implementations()) {
+            sha256::use_implementation(name);
+            for (unsigned int t: {1u, threads}) {
+                std::vector<std::optional<std::string>> results;
+                double secs = seconds([&]() { results = sha256::file_digests(paths, t); });
+                for (std::size_t i = 0; i < paths.size(); i++) {
+                    if (results[i].value_or("") != expected[i]) {
+                        std::cerr << name << ": wrong digest of " << paths[i] << std::endl;
+                        return EXIT_FAILURE;
+                    }
+                }
+                print(name + " x" + std::to_string(t), paths.size(), total, secs);
+                if (threads == 1)
+                    break;
+            }
+        }
+    }
+
+    // digests of buffers of every size up to 3 blocks with the multi-buffer padding
+    for (std::size_t n = 0; n <= 192; n++) {
+        std::string data(n, 0);
+        for (char &c: data)
+            c = static_cast<char>(rng());
+        std::ofstream(base + "/buf", std::ios::binary) << data;
+        for (const std::string &name: sha256::implementations()) {
+            sha256::use_implementation(name);
+            if (sha256::file_digests({base + "/buf"})[0].value_or("") != sha256::digest(data.data(), n)) {
+                std::cerr << name << ": wrong digest of " << n << " bytes" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    fs::remove_all(base);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "IoRing.h"
+#include "digest.h"
+
+// Compare the storage operations of the server through the io_uring ring with the POSIX ones (ofstream for the
+// writes, digest::file for the reads): qd threads write (then hash) FILES files together, as the workers of the
+// server do, so qd operations are in flight at the same time. For each queue depth the MB/s and the 99th percentile
+// of the time of a file are printed. With --fsync each file is flushed to the disk before it is closed
+
+namespace fs = std::filesystem;
+
+#define FILES 1024
+#define FILE_SIZE (128 * 1024)
+
+struct Result {
+    double mbs;
+    double p99_ms;
+};
+
+/**
+ * @param qd number of threads
+ * @param op function (index of the file) -> bool
+ * @return throughput and 99th percentile of the time of op, mbs is -1 if op failed
+ */
+template <class Op>
+static Result measure(int qd, Op op) {
+    std::vector<double> times(FILES);
+    std::vector<std::thread> threads;
+    bool failed = false;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < qd; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = t; i < FILES; i += qd) {
+                auto file_start = std::chrono::steady_clock::now();
+                if (!op(i))
+                    failed = true;
+                times[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - file_start).count();
+            }
+        });
+    }
+    for (std::thread &thread: threads)
+        thread.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(times.begin(), times.end());
+    return Result{failed ? -1 : FILES * static_cast<double>(FILE_SIZE) / secs / 1e6, times[FILES * 99 / 100]};
+}
+
+int main(int argc, char *argv[]) {
+    std::string folder = (fs::temp_directory_path() / "uring_bench").string();
+    bool sync = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--fsync") == 0)
+            sync = true;
+        else
+            folder = argv[i];
+    }
+    fs::create_directories(folder);
+    auto path_of = [&folder](int i) { return folder + "/f" + std::to_string(i); };
+
+    IoRing *ring = IoRing::getInstance();
+    if (!ring->available() || !ring->fixed_reads()) {
+        std::cerr << "io_uring is not available: " << ring->error() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<char> data(FILE_SIZE);
+    std::mt19937 rng(42);
+    for (char &c: data)
+        c = static_cast<char>(rng());
+
+    // the ring must write and read the same content
+    if (!ring->write_file(path_of(0), data.data(), data.size(), sync) ||
+        ring->digest_file(path_of(0), digest::algorithm_sha256) !=
+        digest::buffer(data.data(), data.size(), digest::algorithm_sha256)) {
+        std::cerr << "different content written or read by the ring" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto ofstream_write = [&](int i) {
+        std::ofstream file(path_of(i), std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        file.flush();
+        if (sync) {
+            // ofstream has no fsync, the file is opened again
+            int fd = open(path_of(i).c_str(), O_RDONLY);
+            fsync(fd);
+            close(fd);
+        }
+        return !file.fail();
+    };
+    auto ring_write = [&](int i) { return ring->write_file(path_of(i), data.data(), data.size(), sync); };
+    auto posix_read = [&](int i) { return digest::file(path_of(i), digest::algorithm_sha256).has_value(); };
+    auto ring_read = [&](int i) { return ring->digest_file(path_of(i), digest::algorithm_sha256).has_value(); };
+
+    std::cout << FILES << " files of " << FILE_SIZE / 1024 << " KiB" << (sync ? ", fsync" : "") << std::endl;
+    std::cout << std::setw(4) << "qd" << std::setw(14) << "write" << std::setw(22) << "ofstream"
+              << std::setw(22) << "uring" << std::setw(14) << "read" << std::setw(22) << "posix"
+              << std::setw(22) << "uring" << std::endl;
+    std::cout << std::setw(4) << "" << std::setw(14) << "" << std::setw(11) << "MB/s" << std::setw(11) << "p99 ms"
+              << std::setw(11) << "MB/s" << std::setw(11) << "p99 ms" << std::setw(14) << ""
+              << std::setw(11) << "MB/s" << std::setw(11) << "p99 ms" << std::setw(11) << "MB/s"
+              << std::setw(11) << "p99 ms" << std::endl;
+
+    for (int qd: {1, 2, 4, 8, 16, 32, 64}) {
+        Result results[4] = {measure(qd, ofstream_write), measure(qd, ring_write),
+                             measure(qd, posix_read), measure(qd, ring_read)};
+        std::cout << std::setw(4) << qd << std::setw(14) << "" << std::fixed;
+        for (int r = 0; r < 4; r++) {
+            if (r == 2)
+                std::cout << std::setw(14) << "";
+            std::cout << std::setprecision(0) << std::setw(11) << results[r].mbs << std::setprecision(3)
+                      << std::setw(11) << results[r].p99_ms;
+        }
+        std::cout << std::endl;
+        for (const Result &result: results) {
+            if (result.mbs < 0) {
+                std::cerr << "a operation failed" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    std::cout << "ring: " << ring->operations() << " operations in " << ring->enters() << " submissions"
+              << std::endl;
+    fs::remove_all(folder);
+    return 0;
+}
@@ -0,0 +1,122 @@
+//
+// Created by giacomo on 12/09/20.
+//
+
+#include "ConnectionPool.h"
+
+// maximum number of idle connections kept open towards the server
+#define MAX_IDLE 64
+
+ConnectionPool* ConnectionPool::instance = nullptr;
+std::once_flag ConnectionPool::inited;
+
+/**
+ * constructor of the pool
+ * start the thread that runs the shared io_context
+ */
+ConnectionPool::ConnectionPool()
+        : work_(net::make_work_guard(ioc_))
+{
+    // the signals are blocked by main in all the threads, so the thread of the io_context never handles them
+    thread_ = std::thread([this] { ioc_.run(); });
+    thread_.detach();
+}
+
+ConnectionPool *ConnectionPool::getInstance() {
+
+    std::call_once(inited, []() {
+        instance = new ConnectionPool;
+    });
+
+    return instance;
+}
+
+/**
+ * @return the io_context shared by all the sessions
+ */
+net::io_context &ConnectionPool::context() {
+    return ioc_;
+}
+
+/**
+ * take an idle connection from the pool
+ *
+ * @return an open connection, nullptr if there are no idle connections (a new one must be opened)
+ */
+std::unique_ptr<Connection> ConnectionPool::acquire() {
+    std::lock_guard lg(m_);
+
+    while (!idle_.empty()) {
+        std::unique_ptr<Connection> conn = std::move(idle_.back());
+        idle_.pop_back();
+
+        // the server may have closed the socket in the meantime
+        if (conn->stream.socket().is_open()) {
+            hits_++;
+            return conn;
+        }
+    }
+    misses_++;
+    return nullptr;
+}
+
+/**
+ * give back a connection after a complete request/response exchange
+ *
+ * @param conn connection that can be used again for another request
+ */
+void ConnectionPool::release(std::unique_ptr<Connection> conn) {
+    // no timeout while the connection is idle
+    conn->stream.expires_never();
+
+    std::lock_guard lg(m_);
+    if (idle_.size() < MAX_IDLE)
+        idle_.push_back(std::move(conn));
+}
+
+/**
+ * a connection taken from the pool was already closed by the server:
+ * the request needed a new connection, so it is counted as a miss
+ */
+void ConnectionPool::stale() {
+    hits_--;
+    misses_++;
+}
+
+/**
+ * @return the cached endpoints of the server, a empty optional if the address was never resolved
+ */
+std::optional<tcp::resolver::results_type> ConnectionPool::endpoints() {
+    std::lock_guard lg(m_);
+    return endpoints_;
+}
+
+/**
+ * cache the result of the resolution of configuration::address
+ */
+void ConnectionPool::set_endpoints(const tcp::resolver::results_type &endpoints) {
+    std::lock_guard lg(m_);
+    endpoints_ = endpoints;
+}
+
+/**
+ * forget the cached endpoints (e.g. after a connection error), the next connection will resolve again
+ */
+void ConnectionPool::invalidate_endpoints() {
+    std::lock_guard lg(m_);
+    endpoints_.reset();
+}
+
+/**
+ * @return number of requests served with an already open connection
+ */
+unsigned long ConnectionPool::hits() const {
+    return hits_.load();
+}
+
+/**
+ * @return number of requests that needed a new connection
+ */
+unsigned long ConnectionPool::misses() const {
+    return misses_.load();
+}
@@ -0,0 +1,72 @@
+//
+// Created by giacomo on 12/09/20.
+//
+
+#ifndef CLIENT_CONNECTIONPOOL_H
+#define CLIENT_CONNECTIONPOOL_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <boost/beast/core.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/strand.hpp>
+
+namespace beast = boost::beast;     // from <boost/beast.hpp>
+namespace net = boost::asio;        // from <boost/asio.hpp>
+using tcp = net::ip::tcp;           // from <boost/asio/ip/tcp.hpp>
+
+// A keep-alive connection to the server, with the buffer used to read from it
+struct Connection {
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer; // (Must persist between reads)
+
+    explicit Connection(net::io_context& ioc): stream(net::make_strand(ioc)) {}
+};
+
+//singleton, long-lived transport shared by all the requests to the server
+class ConnectionPool {
+    ConnectionPool();
+
+    // the io_context is run by a background thread for all the life of the client
+    net::io_context ioc_;
+    net::executor_work_guard<net::io_context::executor_type> work_;
+    std::thread thread_;
+
+    std::mutex m_;
+    // endpoints of the server, resolved only once
+    std::optional<tcp::resolver::results_type> endpoints_;
+    // connections not used by any request (kept open with HTTP/1.1 keep-alive)
+    std::vector<std::unique_ptr<Connection>> idle_;
+
+    std::atomic<unsigned long> hits_{0};
+    std::atomic<unsigned long> misses_{0};
+
+public:
+    static ConnectionPool* instance;
+    static std::once_flag inited;
+
+    static ConnectionPool *getInstance();
+
+    net::io_context& context();
+
+    std::unique_ptr<Connection> acquire();
+    void release(std::unique_ptr<Connection> conn);
+    void stale();
+
+    std::optional<tcp::resolver::results_type> endpoints();
+    void set_endpoints(const tcp::resolver::results_type& endpoints);
+    void invalidate_endpoints();
+
+    unsigned long hits() const;
+    unsigned long misses() const;
+
+    ConnectionPool(const ConnectionPool&)= delete;
+    ConnectionPool& operator=(const ConnectionPool&)= delete;
+};
+
+
+#endif //CLIENT_CONNECTIONPOOL_H
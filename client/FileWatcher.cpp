@@ -4,12 +4,17 @@
 
 #include <thread>
 #include <iostream>
-#include <deque>
-#include <condition_variable>
+#include <optional>
+#include <algorithm>
 
 #include "FileWatcher.h"
 #include "client.h"
 #include "ExceptionBackup.h"
+#include "HashIndex.h"
+#include "WorkStealingPool.h"
+
+// min seconds between two saves of the hash index while watching
+#define INDEX_SAVE_INTERVAL 60
 
 std::mutex om;
 
@@ -19,51 +24,14 @@ void myout(const std::string& msg){
 }
 
 
-template <class T>
-class Jobs {
-    // FIFO queue
-    std::deque<T> jobs;
-    bool active = true;
-    std::mutex qm;
-    std::condition_variable not_empty;
-
-public:
-    void put(T job){
-        std::lock_guard _g(qm);
-        jobs.push_back(job);
-        not_empty.notify_one();
-    }
-
-    std::optional<T> get() {
-        std::unique_lock lock(qm);
-        while (true){
-
-            if(!jobs.empty()){
-                T job = jobs.front();
-                jobs.pop_front();
-                return job;
-            }
-            if(!active){
-                return std::optional<T>();
-            }
-            not_empty.wait(lock, [this](){ return !this->jobs.empty() || !this->active;});
-        }
-    }
-
-    void ended(){
-        std::lock_guard g(qm);
-        active = false;
-        not_empty.notify_all();
-    }
-
-//    int size(){
-//        return jobs.size();
-//    }
-};
-
-FileWatcher::FileWatcher(const std::string& path_to_watch, std::chrono::duration<int, std::milli> delay)
-    : path_to_watch{path_to_watch}, delay{delay} {
+FileWatcher::FileWatcher(const std::string& path_to_watch, std::chrono::duration<int, std::milli> delay,
+                         WatchMode mode, unsigned int max_inflight)
+    : path_to_watch{path_to_watch}, delay{delay}, mode{mode}, executor_{max_inflight} {}
 
+/**
+ * first comparison of the tree with the backup on the server, retried if the connection is lost
+ */
+void FileWatcher::initialize() {
     try {
         initialization();
     }
@@ -78,100 +46,167 @@ FileWatcher::FileWatcher(const std::string& path_to_watch, std::chrono::duration
     }
 }
 
-void FileWatcher::initialization() {
-    // object implementing a fifo queue of directories and sub-directories present in the path to watch
-    Jobs<std::filesystem::path> jobs;
-
-    // number of threads equal to the number of cores of the machine
-    unsigned int n_threads = std::thread::hardware_concurrency();
-
-    std::vector<std::thread> threads_;
-    threads_.resize(n_threads);
-
-    // counter of leaf directories in the queue (when the counter comes back to 0, it means that all the tree of directories has been watched)
-    std::atomic<int> count_leaves(0);
+/**
+ * @param dir path of a folder
+ * @param name of a child
+ * @return the path of the child
+ */
+static std::string child_path(const std::string &dir, const std::string &name) {
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+}
 
-    // delete any files or folders no longer present in the root folder
-    // probe_folder(path_to_watch);
+/**
+ * @param path of a file or folder
+ * @return the path without the final '/', as the folders are indexed in children_
+ */
+static std::string without_slash(const std::string &path) {
+    return path.size() > 1 && path.back() == '/' ? path.substr(0, path.size() - 1) : path;
+}
 
+/**
+ * compare the tree with the backup on the server and send the differences. The hash of each folder
+ * (Merkle tree of names, types and digests of its content) is compared with the one of the server,
+ * descending only in the sub-folders that are different: if nothing changed a single request is sent
+ */
+void FileWatcher::initialization() {
     // erase all the elements in the path_ map
     paths_.clear();
+    children_.clear();
+
+    std::unordered_map<std::string, LocalFolder> local;
+    scan_local(local);
+
+    // a folder to compare with the server, on_server is false if the server doesn't have it
+    struct Sync {
+        std::string dir;
+        bool on_server;
+    };
+
+    WorkStealingPool<Sync> pool;
+    pool.run({{path_to_watch, true}}, [&local](unsigned int, const Sync &job,
+                                               const WorkStealingPool<Sync>::Add &add) {
+        auto it = local.find(job.dir);
+        if (it == local.end())
+            return;
+        const LocalFolder &folder = it->second;
+
+        std::map<std::string, TreeChild> remote;
+        bool on_server = job.on_server;
+        if (on_server) {
+            std::optional<TreeNode> node = probe_tree(job.dir, folder.hash);
+            if (node && node->hash == folder.hash)
+                return;
+            if (node)
+                remote = std::move(node->children);
+            else
+                on_server = false;
+        }
+        if (!on_server)
+            backup_folder(job.dir);
 
-    // firstly insert in the queue the root directory
-    jobs.put(path_to_watch);
-    // increment the counter of leaf directories present in the fifo queue
-    count_leaves.fetch_add(1);
-
-
-    for(int i=0; i<n_threads; i++){
-        threads_.emplace_back([&jobs, this, &count_leaves, i](){
-            while(true){
-                // take a job from the queue
-                std::optional<fs::path>  path_ = jobs.get();
-                if(path_.has_value()){
-                    // safe because only a thread will receive that path
-                    fs::path path_entry = path_.value();
+        // delete any files or folders no longer present in the folder
+        for (const auto &[name, child]: remote) {
+            if (folder.children.count(name) == 0)
+                delete_path(child_path(job.dir, name));
+        }
 
-                    // counter of direct child-directories of the current directory
-                    int directories = 0;
+        for (const auto &[name, child]: folder.children) {
+            std::string path = child_path(job.dir, name);
+            auto r = remote.find(name);
+            if (r != remote.end() && r->second.type != child.type) {
+                // a file replaced by a folder or vice versa
+                delete_path(path);
+                r = remote.end();
+            }
 
-                    // myout("sending probe folder of " + path_entry.string());
-                    if(!probe_folder(path_entry.string())) {
-                        // myout("probe failed, sending backup folder " + path_entry.string());
-                        backup_folder(path_entry.string());
-                    }
-                    // add the folder to the paths_ unordered_map or just update last write time if already present
-                    mutex_paths_.lock();
-                    paths_[path_entry.string()] = fs::last_write_time(path_entry);
-                    mutex_paths_.unlock();
-
-                    // iterate on all direct children of the directory
-                    for (const auto& p : fs::directory_iterator(path_entry)) {
-                        if (p.is_regular_file()) {
-                            // myout("sending probe file of " + p.path().string());
-                            if (!probe_file(p.path().string())) {
-                                // myout("probe failed, sending backup file " + p.path().string());
-                                backup_file(p.path().string());
-                            }
-                            // add the file to the paths_ unordered_map or just update last write time
-                            // if already present
-                            mutex_paths_.lock();
-                            paths_[p.path().string()] = fs::last_write_time(p);
-                            mutex_paths_.unlock();
-                        } else if (p.is_directory()) {
-                            directories++;
-                            if (directories >= 2) {
-                                // increment count_leaves only if more then one sub-directory
-                                count_leaves.fetch_add(1);
-                            }
-                            jobs.put(p.path());
-                        }
-                    }
+            if (child.type == TREE_FOLDER) {
+                if (r == remote.end() || r->second.hash != child.hash)
+                    add({path, r != remote.end()});
+            } else if (r == remote.end()) {
+                backup_file(path);
+            } else if (r->second.hash != child.hash) {
+                // the server replaces its copy with the differences, if it is still the one listed. Otherwise it
+                // changed in the meantime and it is checked again
+                if (!update_file(path, r->second.hash))
+                    probe_file(path);
+            }
+        }
+    });
 
-                    // if there are no sub-directories, the actual directory is really a leaf, decrement counter
-                    // because finished to watch it
-                    if (directories == 0)
-                        count_leaves.fetch_sub(1);
+    // the digests of all the files have been computed, save them for the next start
+    HashIndex::getInstance()->save();
+}
 
-                    // if counter of leaf directories is 0 means that all the tree has been visited, so stop
-                    // the jobs queue
-                    if (count_leaves.load() == 0){
-                        jobs.ended();
-                    }
-                } else {
-                    // myout("consumer " + std::to_string(i) + " terminated");
-                    break;
-                }
+/**
+ * read the tree: the children of each folder with their digests (from the hash index if the files didn't change),
+ * then the hash of each folder is computed from the bottom
+ *
+ * @param local where the folders are saved, by path
+ */
+void FileWatcher::scan_local(std::unordered_map<std::string, LocalFolder> &local) {
+    WorkStealingPool<std::string> pool;
+
+    // each thread saves the folders read and the last write times in its own buffers, merged at the end
+    std::vector<std::unordered_map<std::string, LocalFolder>> folders(pool.threads());
+    std::vector<std::vector<std::pair<std::string, fs::file_time_type>>> times(pool.threads());
+
+    pool.run({path_to_watch}, [&folders, &times](unsigned int index, const std::string &dir,
+                                                const WorkStealingPool<std::string>::Add &add) {
+        LocalFolder folder;
+        std::vector<std::string> names, files;
+
+        // iterate on all direct children of the directory
+        for (const auto& p : fs::directory_iterator(dir)) {
+            std::string name = p.path().filename().string();
+            if (p.is_directory()) {
+                folder.children[name] = TreeChild{TREE_FOLDER, ""};
+                add(p.path().string());
+            } else if (p.is_regular_file()) {
+                names.push_back(name);
+                files.push_back(p.path().string());
+            } else {
+                continue;
             }
-        });
+            times[index].emplace_back(p.path().string(), fs::last_write_time(p));
+        }
+        times[index].emplace_back(dir, fs::last_write_time(dir));
+
+        // the files of the folder are hashed together
+        std::vector<std::string> digests = file_digests(files);
+        for (std::size_t i = 0; i < files.size(); i++)
+            folder.children[names[i]] = TreeChild{TREE_FILE, std::move(digests[i])};
+
+        folders[index][dir] = std::move(folder);
+    });
+
+    // add the paths to the paths_ unordered_map with their last write time
+    std::size_t n_paths = 0;
+    for (const auto &buffer: times)
+        n_paths += buffer.size();
+    paths_.reserve(n_paths);
+    for (auto &buffer: times) {
+        for (auto &[path, time]: buffer)
+            remember(path, time);
     }
-
-    for (auto &t: threads_) {
-        if(t.joinable()) t.join();
+    for (auto &buffer: folders)
+        local.merge(buffer);
+
+    // a folder has a longer path than its parent: the sub-folders are computed first
+    std::vector<std::string> dirs;
+    for (const auto &[dir, folder]: local)
+        dirs.push_back(dir);
+    std::sort(dirs.begin(), dirs.end(), [](const std::string &a, const std::string &b) {
+        return a.size() > b.size();
+    });
+
+    for (const std::string &dir: dirs) {
+        LocalFolder &folder = local[dir];
+        for (auto &[name, child]: folder.children) {
+            if (child.type == TREE_FOLDER)
+                child.hash = local[child_path(dir, name)].hash;
+        }
+        folder.hash = tree_hash(folder.children);
     }
-
-    // myout("consumer terminati job ancora aperti: " + std::to_string(jobs.size()));
-
 }
 
 bool FileWatcher::check_connection_and_retry() {
@@ -194,7 +229,29 @@ bool FileWatcher::check_connection_and_retry() {
     return false;
 }
 
+/**
+ * compare the tree with the server, then watch the path for changes, with inotify if it is available (and
+ * requested), polling otherwise. The watches are added before the tree is read, so a change done while the tree is
+ * compared has an event
+ */
 void FileWatcher::start() {
+    if (mode == watch_inotify) {
+        Inotify inotify;
+        if (inotify.init(path_to_watch) && inotify.add_tree(path_to_watch)) {
+            initialize();
+            watch_events(inotify);
+            return;
+        }
+        myout("inotify not available, using polling");
+    }
+    initialize();
+    poll_changes();
+}
+
+/**
+ * compare the whole tree with paths_ every "delay" milliseconds
+ */
+void FileWatcher::poll_changes() {
     while (retry) {
         try {
             // Wait for "delay" milliseconds
@@ -206,7 +263,8 @@ void FileWatcher::start() {
                 if (!fs::exists(it->first)) {
                     // myout("delete path of " + it->first);
                     // delete from server
-                    delete_path(it->first);
+                    executor_.submit(op_delete, it->first);
+                    HashIndex::getInstance()->erase(it->first);
 
                     // update last modified time of it's parent folder in paths_
                     int pos = it->first.rfind("/");
@@ -214,7 +272,9 @@ void FileWatcher::start() {
                     if (fs::exists(parent))
                         paths_[parent] = fs::last_write_time(parent);
 
-                    // delete from paths
+                    // delete from paths (its content is found deleted too)
+                    children_[parent].erase(it->first.substr(pos + 1));
+                    children_.erase(it->first);
                     it = paths_.erase(it);
                 } else {
                     it++;
@@ -229,13 +289,13 @@ void FileWatcher::start() {
 
                     if(path_entry.is_directory()) {
                         // myout("backup folder " + path_entry.path().string());
-                        backup_folder(path_entry.path().string());
+                        executor_.submit(op_backup_folder, path_entry.path().string());
                     }
                     else if(path_entry.is_regular_file()) {
                         // myout("backup file " + path_entry.path().string());
-                        backup_file(path_entry.path().string());
+                        executor_.submit(op_backup_file, path_entry.path().string());
                     }
-                    paths_[path_entry.path().string()] = current_file_last_write_time;
+                    remember(path_entry.path().string(), current_file_last_write_time);
 
                 } else {
                     // file  modification
@@ -247,20 +307,196 @@ void FileWatcher::start() {
                             backup_folder(path_entry.path().string());
                         }*/
                         if(path_entry.is_regular_file()) {
-                            // myout("file modified: sending delete and backup " + path_entry.path().string());
-                            delete_path(path_entry.path().string());
-                            backup_file(path_entry.path().string());
+                            // myout("file modified: sending the differences " + path_entry.path().string());
+                            // the server replaces the old copy only when the new one is complete
+                            executor_.submit(op_update_file, path_entry.path().string());
                         }
                         paths_[path_entry.path().string()] = current_file_last_write_time;
                     }
                 }
             }
+
+            // the requests of the changes are sent in parallel
+            executor_.wait();
+
+            // save the digests computed for the modified files
+            HashIndex::getInstance()->save_if_dirty(std::chrono::seconds(INDEX_SAVE_INTERVAL));
+        }
+        catch (const ExceptionBackup& e) {
+            // server error or connection lost
+            std::cerr << e.what() << ". Error number " << e.getErrorNumber() << std::endl;
+            if(check_connection_and_retry())
+                myout("Connection is back");
+        }
+    }
+}
+
+/**
+ * wait for the events of the watched directories and send only the paths changed, without scanning the tree.
+ * If the events are lost (queue overflow) only the directories involved are compared again. The tree is compared
+ * with the server before (and after the connection is back), so the events are the only changes to send
+ *
+ * @param inotify instance with the watches of the whole tree
+ */
+void FileWatcher::watch_events(Inotify &inotify) {
+    while (retry) {
+        try {
+            for (const Change &change : inotify.wait()) {
+                switch (change.type) {
+                    case change_path:
+                        sync_path(change.path, &inotify);
+                        break;
+                    case change_children:
+                        rescan(change.path, false, &inotify);
+                        break;
+                    case change_subtree:
+                        sync_path(change.path, &inotify);
+                        rescan(change.path, true, &inotify);
+                        break;
+                }
+            }
+
+            // the requests of the changes are sent in parallel
+            executor_.wait();
+
+            // save the digests computed for the modified files
+            HashIndex::getInstance()->save_if_dirty(std::chrono::seconds(INDEX_SAVE_INTERVAL));
         }
         catch (const ExceptionBackup& e) {
             // server error or connection lost
             std::cerr << e.what() << ". Error number " << e.getErrorNumber() << std::endl;
+            // the tree is read and compared with the server again
             if(check_connection_and_retry())
                 myout("Connection is back");
         }
     }
 }
+
+/**
+ * compare a path with its last known state and send the change to the server
+ *
+ * @param path absolute path of a file or folder
+ * @param inotify instance where the new folders are watched, nullptr if they are already watched
+ */
+void FileWatcher::sync_path(const std::string &path, Inotify *inotify) {
+    std::error_code ec;
+    fs::file_status status = fs::status(path, ec);
+
+    // file / folder elimination
+    if (!fs::exists(status)) {
+        if (contains(path)) {
+            executor_.submit(op_delete, path);
+            forget(path);
+        }
+        return;
+    }
+
+    auto current_file_last_write_time = fs::last_write_time(path, ec);
+    if (ec)
+        return;
+
+    // file / folder creation
+    if (!contains(path)) {
+        if (fs::is_directory(status)) {
+            executor_.submit(op_backup_folder, path);
+            remember(path, current_file_last_write_time);
+            // the content of a folder created (or moved here) has no events
+            if (inotify)
+                inotify->add_tree(path);
+            rescan(path, true, nullptr);
+            return;
+        }
+        if (fs::is_regular_file(status))
+            executor_.submit(op_backup_file, path);
+        remember(path, current_file_last_write_time);
+        return;
+    }
+
+    // file modification
+    if (paths_[path] != current_file_last_write_time) {
+        if (fs::is_regular_file(status))
+            executor_.submit(op_update_file, path);
+        paths_[path] = current_file_last_write_time;
+    }
+}
+
+/**
+ * compare the content of a folder with its last known state: only its direct children are listed and compared
+ * with the ones known, the sub-folders are compared in the same way
+ *
+ * @param dir absolute path of the folder
+ * @param recursive true to compare also the sub-folders
+ * @param inotify instance where the new folders are watched, nullptr if they are already watched
+ */
+void FileWatcher::rescan(const std::string &dir, bool recursive, Inotify *inotify) {
+    // name of each child and if it is a folder (from the entry, without reading the child)
+    std::map<std::string, bool> names;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code type_ec;
+        names.emplace(it->path().filename().string(), it->is_directory(type_ec));
+    }
+
+    // children no longer present (the whole folder if it can't be read), sent before the new ones
+    auto known = children_.find(without_slash(dir));
+    if (known != children_.end()) {
+        std::vector<std::string> removed;
+        for (const std::string &name : known->second) {
+            if (names.count(name) == 0)
+                removed.push_back(child_path(dir, name));
+        }
+        for (const std::string &path : removed) {
+            if (contains(path)) {
+                executor_.submit(op_delete, path);
+                forget(path);
+            }
+        }
+    }
+
+    for (const auto &[name, is_dir] : names) {
+        std::string path = child_path(dir, name);
+        bool known_dir = is_dir && contains(path);
+        sync_path(path, inotify);
+        if (recursive && known_dir)
+            rescan(path, true, inotify);
+    }
+}
+
+/**
+ * add a path to paths_ and to the children of its folder
+ *
+ * @param path absolute path of the file or folder
+ * @param time last write time
+ */
+void FileWatcher::remember(const std::string &path, fs::file_time_type time) {
+    paths_[path] = time;
+    std::string child = without_slash(path);
+    std::size_t pos = child.rfind('/');
+    if (pos != std::string::npos && pos + 1 < child.size())
+        children_[child.substr(0, pos == 0 ? 1 : pos)].insert(child.substr(pos + 1));
+}
+
+/**
+ * remove a path deleted and its content from paths_ and from the hash index
+ *
+ * @param path absolute path of the file or folder
+ */
+void FileWatcher::forget(const std::string &path) {
+    std::string key = without_slash(path);
+    auto children = children_.find(key);
+    if (children != children_.end()) {
+        std::set<std::string> names = std::move(children->second);
+        children_.erase(children);
+        for (const std::string &name : names)
+            forget(child_path(key, name));
+    }
+
+    HashIndex::getInstance()->erase(path);
+    paths_.erase(path);
+    std::size_t pos = key.rfind('/');
+    if (pos != std::string::npos) {
+        auto parent = children_.find(key.substr(0, pos == 0 ? 1 : pos));
+        if (parent != children_.end())
+            parent->second.erase(key.substr(pos + 1));
+    }
+}
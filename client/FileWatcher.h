@@ -10,26 +10,57 @@
 #include <filesystem>
 #include <unordered_map>
 #include <mutex>
+#include <map>
+#include <set>
+
+#include "Inotify.h"
+#include "backup.h"
+#include "SyncExecutor.h"
 
 namespace fs = std::filesystem;
 
+// how the changes are detected: inotify events or a comparison of the whole tree every "delay"
+enum WatchMode {
+    watch_polling,
+    watch_inotify
+};
+
+// a local folder with the hashes of its direct children (by name) and its own hash
+struct LocalFolder {
+    std::map<std::string, TreeChild> children;
+    std::string hash;
+};
 
 class FileWatcher {
 public:
-    FileWatcher(const std::string& path_to_watch, std::chrono::duration<int, std::milli> delay);
+    FileWatcher(const std::string& path_to_watch, std::chrono::duration<int, std::milli> delay,
+                WatchMode mode = watch_inotify, unsigned int max_inflight = 8);
 
     void start();
 
 private:
     void initialization();
+    void scan_local(std::unordered_map<std::string, LocalFolder> &local);
     bool check_connection_and_retry();
+    void poll_changes();
+    void watch_events(Inotify &inotify);
+    void sync_path(const std::string &path, Inotify *inotify);
+    void rescan(const std::string &dir, bool recursive, Inotify *inotify);
+    void remember(const std::string &path, fs::file_time_type time);
+    void forget(const std::string &path);
+    void initialize();
 
     std::string path_to_watch;
     std::chrono::duration<int, std::milli> delay;
+    WatchMode mode;
+    // sends the requests of the changes, several at the same time
+    SyncExecutor executor_;
 
     // unordered_map: path of the file and its last modification time
     std::unordered_map<std::string, std::filesystem::file_time_type> paths_;
-    std::mutex mutex_paths_ ;
+    // names of the children in paths_ of each folder (by path, without the final '/'), so a folder is compared
+    // without looking at the whole paths_
+    std::unordered_map<std::string, std::set<std::string>> children_;
 
     int retry = 3;
 
@@ -0,0 +1,246 @@
+//
+// Created by giacomo on 18/09/20.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HashIndex.h"
+
+// first bytes of the index file, the format is:
+// magic, algorithm of the digests (8 chars, padded with '\0'), then for each entry: path length (4 bytes), inode,
+// size, mtime (8 bytes each), digest (64 chars), path (numbers are little endian).
+// The first format had no algorithm, its digests are SHA256
+#define INDEX_MAGIC "BKIDX002"
+#define INDEX_MAGIC_V1 "BKIDX001"
+#define INDEX_MAGIC_SIZE 8
+#define INDEX_ALGORITHM_SIZE 8
+#define INDEX_DIGEST_SIZE 64
+#define INDEX_RECORD_SIZE (4 + 3 * 8 + INDEX_DIGEST_SIZE)
+
+HashIndex* HashIndex::instance = nullptr;
+std::once_flag HashIndex::inited;
+
+HashIndex *HashIndex::getInstance() {
+
+    std::call_once(inited, []() {
+        instance = new HashIndex;
+    });
+
+    return instance;
+}
+
+/**
+ * read a little endian number from the index
+ *
+ * @param data where the number starts
+ * @param n number of bytes
+ * @return the number
+ */
+static std::uint64_t read_number(const unsigned char *data, int n) {
+    std::uint64_t value = 0;
+    for (int i = n - 1; i >= 0; i--)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+/**
+ * write a little endian number in the index
+ *
+ * @param out the index file
+ * @param value the number
+ * @param n number of bytes
+ */
+static void write_number(std::ostream &out, std::uint64_t value, int n) {
+    char bytes[8];
+    for (int i = 0; i < n; i++) {
+        bytes[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+    out.write(bytes, n);
+}
+
+/**
+ * load the index from a file, mapped in memory to read it in a single pass.
+ * A missing or corrupted file gives a empty index
+ *
+ * @param path of the index file, also used by save
+ * @return true if the index was loaded
+ */
+bool HashIndex::load(const std::string &path) {
+    std::lock_guard lg(m_);
+    path_ = path;
+    entries_.clear();
+    saved_ = std::chrono::steady_clock::now();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < INDEX_MAGIC_SIZE) {
+        close(fd);
+        return false;
+    }
+
+    std::size_t size = st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const auto *data = static_cast<const unsigned char *>(map);
+    bool valid = true;
+    std::size_t pos = INDEX_MAGIC_SIZE;
+    if (std::memcmp(data, INDEX_MAGIC, INDEX_MAGIC_SIZE) == 0 && size >= INDEX_MAGIC_SIZE + INDEX_ALGORITHM_SIZE) {
+        const char *algorithm = reinterpret_cast<const char *>(data + INDEX_MAGIC_SIZE);
+        algorithm_ = std::string(algorithm, strnlen(algorithm, INDEX_ALGORITHM_SIZE));
+        pos += INDEX_ALGORITHM_SIZE;
+    } else if (std::memcmp(data, INDEX_MAGIC_V1, INDEX_MAGIC_SIZE) == 0) {
+        algorithm_ = "sha256";
+    } else {
+        valid = false;
+    }
+
+    while (valid && pos < size) {
+        if (size - pos < INDEX_RECORD_SIZE) {
+            valid = false;
+            break;
+        }
+        std::size_t path_size = read_number(data + pos, 4);
+        if (size - pos - INDEX_RECORD_SIZE < path_size) {
+            valid = false;
+            break;
+        }
+
+        IndexEntry entry{read_number(data + pos + 4, 8),
+                         read_number(data + pos + 12, 8),
+                         static_cast<std::int64_t>(read_number(data + pos + 20, 8)),
+                         std::string(reinterpret_cast<const char *>(data + pos + 28), INDEX_DIGEST_SIZE)};
+        entries_.emplace(std::string(reinterpret_cast<const char *>(data + pos + INDEX_RECORD_SIZE), path_size),
+                         std::move(entry));
+        pos += INDEX_RECORD_SIZE + path_size;
+    }
+    munmap(map, size);
+
+    if (!valid)
+        entries_.clear();
+    return valid;
+}
+
+/**
+ * write the index in its file: it is written in a temporary file and then renamed,
+ * so a crash never leaves a truncated index
+ *
+ * @return true if the index was saved
+ */
+bool HashIndex::save() {
+    std::lock_guard lg(m_);
+    if (path_.empty())
+        return false;
+
+    std::string tmp_path = path_ + ".tmp";
+    std::ofstream out(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    out.write(INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    char algorithm[INDEX_ALGORITHM_SIZE] = {};
+    algorithm_.copy(algorithm, INDEX_ALGORITHM_SIZE);
+    out.write(algorithm, INDEX_ALGORITHM_SIZE);
+    for (const auto &[path, entry]: entries_) {
+        write_number(out, path.size(), 4);
+        write_number(out, entry.inode, 8);
+        write_number(out, entry.size, 8);
+        write_number(out, static_cast<std::uint64_t>(entry.mtime), 8);
+        out.write(entry.digest.data(), INDEX_DIGEST_SIZE);
+        out.write(path.data(), path.size());
+    }
+    out.close();
+
+    if (out.fail() || std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    dirty_ = false;
+    saved_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+/**
+ * save the index if it changed and the last save is older than interval
+ *
+ * @param interval min time between two saves
+ */
+void HashIndex::save_if_dirty(std::chrono::seconds interval) {
+    {
+        std::lock_guard lg(m_);
+        if (!dirty_ || std::chrono::steady_clock::now() - saved_ < interval)
+            return;
+    }
+    save();
+}
+
+/**
+ * set the algorithm of the digests (chosen with the server at the login): if it is not the one of the digests
+ * saved they are no more valid and are removed
+ *
+ * @param algorithm name of the algorithm
+ */
+void HashIndex::set_algorithm(const std::string &algorithm) {
+    std::lock_guard lg(m_);
+    if (algorithm == algorithm_)
+        return;
+    algorithm_ = algorithm;
+    entries_.clear();
+    dirty_ = true;
+}
+
+/**
+ * look for the digest of a file
+ *
+ * @param path absolute path of the file
+ * @param metadata current inode, size and mtime of the file
+ * @return the digest if the file didn't change since it was computed, a empty optional otherwise
+ */
+std::optional<std::string> HashIndex::lookup(const std::string &path, const IndexEntry &metadata) {
+    std::lock_guard lg(m_);
+
+    auto it = entries_.find(path);
+    if (it == entries_.end() || it->second.inode != metadata.inode || it->second.size != metadata.size ||
+        it->second.mtime != metadata.mtime)
+        return {};
+    return it->second.digest;
+}
+
+/**
+ * save the digest of a file
+ *
+ * @param path absolute path of the file
+ * @param entry metadata and digest of the file
+ */
+void HashIndex::store(const std::string &path, const IndexEntry &entry) {
+    if (entry.digest.size() != INDEX_DIGEST_SIZE)
+        return;
+
+    std::lock_guard lg(m_);
+    entries_[path] = entry;
+    dirty_ = true;
+}
+
+/**
+ * remove the digest of a file no more present
+ *
+ * @param path absolute path of the file
+ */
+void HashIndex::erase(const std::string &path) {
+    std::lock_guard lg(m_);
+    if (entries_.erase(path) > 0)
+        dirty_ = true;
+}
@@ -0,0 +1,55 @@
+//
+// Created by giacomo on 18/09/20.
+//
+
+#ifndef CLIENT_HASHINDEX_H
+#define CLIENT_HASHINDEX_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+// metadata of a file when its digest was computed, the digest is valid while they don't change
+struct IndexEntry {
+    std::uint64_t inode;
+    std::uint64_t size;
+    std::int64_t mtime;     // nanoseconds
+    std::string digest;     // in hexadecimal format, computed with the algorithm of the index
+};
+
+//singleton, digests of the files saved on disk so they are not computed again at every start
+class HashIndex {
+    HashIndex() = default;
+
+    std::mutex m_;
+    // entries by absolute path of the file
+    std::unordered_map<std::string, IndexEntry> entries_;
+    std::string path_;
+    std::string algorithm_ = "sha256";
+    bool dirty_ = false;
+    std::chrono::steady_clock::time_point saved_;
+
+public:
+    static HashIndex* instance;
+    static std::once_flag inited;
+
+    static HashIndex *getInstance();
+
+    bool load(const std::string &path);
+    bool save();
+    void save_if_dirty(std::chrono::seconds interval);
+    void set_algorithm(const std::string &algorithm);
+
+    std::optional<std::string> lookup(const std::string &path, const IndexEntry &metadata);
+    void store(const std::string &path, const IndexEntry &entry);
+    void erase(const std::string &path);
+
+    HashIndex(const HashIndex&)= delete;
+    HashIndex& operator=(const HashIndex&)= delete;
+};
+
+
+#endif //CLIENT_HASHINDEX_H
@@ -0,0 +1,227 @@
+//
+// Created by giacomo on 19/09/20.
+//
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "Inotify.h"
+
+namespace fs = std::filesystem;
+
+// events of the watched directories used to detect the changes: the files are considered modified at each write
+// (a file kept open, e.g. a log, is sent while it grows), when they are closed after a write or their attributes
+// change (e.g. touch). The events of a burst of writes are merged in a single change
+#define INOTIFY_MASK (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_EXCL_UNLINK | IN_ONLYDIR)
+
+// size of the buffer used to read the events
+#define EVENT_BUF_SIZE (64 * 1024)
+
+/**
+ * @param dir path of a directory
+ * @param name of a child
+ * @return the path of the child
+ */
+static std::string child_path(const std::string &dir, const std::string &name) {
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+}
+
+Inotify::~Inotify() {
+    for (Instance &instance: instances_) {
+        if (instance.fd >= 0)
+            close(instance.fd);
+    }
+}
+
+/**
+ * create the inotify instances, without watches
+ *
+ * @param root directory watched
+ * @return true if inotify is available
+ */
+bool Inotify::init(const std::string &root) {
+    root_ = root;
+    instances_.resize(INOTIFY_INSTANCES);
+    for (Instance &instance: instances_) {
+        instance.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (instance.fd < 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @param root directory watched
+ * @param dir path of a directory in the root
+ * @return the path of the top-level directory that contains dir, a empty string for the root
+ */
+static std::string top_level(const std::string &root, const std::string &dir) {
+    if (dir.size() <= root.size())
+        return {};
+
+    std::string relative = dir.substr(root.size());
+    if (relative.front() == '/')
+        relative.erase(0, 1);
+    return child_path(root, relative.substr(0, relative.find('/')));
+}
+
+/**
+ * the root has an instance for itself, the other directories are assigned by their top-level directory
+ *
+ * @param dir path of a directory in the root
+ * @return the index of the instance that watches the directory
+ */
+int Inotify::instance_of(const std::string &dir) const {
+    std::string top = top_level(root_, dir);
+    if (top.empty())
+        return 0;
+    return 1 + std::hash<std::string>{}(top) % (INOTIFY_INSTANCES - 1);
+}
+
+/**
+ * watch a directory and all its sub-directories
+ *
+ * @param dir path of the directory
+ * @return false if the watches can't be added (e.g. max_user_watches reached)
+ */
+bool Inotify::add_tree(const std::string &dir) {
+    std::vector<std::string> dirs{dir};
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec) && !it->is_symlink(ec))
+            dirs.push_back(it->path().string());
+    }
+
+    for (const std::string &path: dirs) {
+        int index = instance_of(path);
+        int wd = inotify_add_watch(instances_[index].fd, path.c_str(), INOTIFY_MASK);
+        if (wd < 0) {
+            // the directory may have been removed in the meantime, the other errors are limits of the system
+            if (errno == ENOENT || errno == ENOTDIR || errno == EACCES)
+                continue;
+            return false;
+        }
+        instances_[index].dirs[wd] = path;
+        watches_[path] = {index, wd};
+    }
+    return true;
+}
+
+/**
+ * stop watching a directory (removed or moved) and its sub-directories
+ *
+ * @param dir path of the directory
+ */
+void Inotify::remove_tree(const std::string &dir) {
+    std::string prefix = child_path(dir, "");
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        if (it->first == dir || it->first.rfind(prefix, 0) == 0) {
+            auto [index, wd] = it->second;
+            inotify_rm_watch(instances_[index].fd, wd);
+            instances_[index].dirs.erase(wd);
+            it = watches_.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+/**
+ * the event queue of an instance overflowed: all its directories must be compared
+ *
+ * @param instance index of the instance
+ * @param changes where the changes are added
+ */
+void Inotify::lost_events(int instance, std::vector<Change> &changes) const {
+    if (instance == 0) {
+        changes.push_back({root_, change_children});
+        return;
+    }
+    // the top-level directories of the instance
+    std::unordered_set<std::string> tops;
+    for (const auto &[wd, dir]: instances_[instance].dirs)
+        tops.insert(top_level(root_, dir));
+    for (const std::string &top: tops)
+        changes.push_back({top, change_subtree});
+}
+
+/**
+ * wait for the next changes: blocks until there is an event, then collects the events until they stop for
+ * EVENT_SETTLE_MS (so a burst of events gives a single list of changes)
+ *
+ * @return the changes, each path at most once
+ */
+std::vector<Change> Inotify::wait() {
+    std::vector<Change> changes;
+    std::unordered_set<std::string> seen;
+
+    std::vector<pollfd> fds;
+    for (const Instance &instance: instances_)
+        fds.push_back({instance.fd, POLLIN, 0});
+
+    std::unique_ptr<char[]> buf{new char[EVENT_BUF_SIZE]};
+    auto first = std::chrono::steady_clock::time_point::max();
+    int timeout = -1;
+
+    while (true) {
+        int n = poll(fds.data(), fds.size(), timeout);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        for (std::size_t i = 0; i < fds.size(); i++) {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            ssize_t len;
+            while ((len = read(fds[i].fd, buf.get(), EVENT_BUF_SIZE)) > 0) {
+                for (char *ptr = buf.get(); ptr < buf.get() + len;) {
+                    auto *event = reinterpret_cast<inotify_event *>(ptr);
+                    ptr += sizeof(inotify_event) + event->len;
+
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        lost_events(i, changes);
+                        continue;
+                    }
+
+                    auto it = instances_[i].dirs.find(event->wd);
+                    if (it == instances_[i].dirs.end())
+                        continue;
+                    if (event->mask & IN_IGNORED) {
+                        // the directory is not watched anymore (removed)
+                        auto w = watches_.find(it->second);
+                        if (w != watches_.end() && w->second == std::make_pair(static_cast<int>(i), event->wd))
+                            watches_.erase(w);
+                        instances_[i].dirs.erase(it);
+                        continue;
+                    }
+                    if (event->len == 0)
+                        continue;
+
+                    std::string path = child_path(it->second, event->name);
+                    if ((event->mask & IN_ISDIR) && (event->mask & (IN_MOVED_FROM | IN_DELETE)))
+                        remove_tree(path);
+                    if (seen.insert(path).second)
+                        changes.push_back({path, change_path});
+                }
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (first == std::chrono::steady_clock::time_point::max())
+            first = now;
+        if (now - first >= std::chrono::milliseconds(EVENT_MAX_WAIT_MS))
+            break;
+        timeout = EVENT_SETTLE_MS;
+    }
+    return changes;
+}
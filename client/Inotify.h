@@ -0,0 +1,62 @@
+//
+// Created by giacomo on 19/09/20.
+//
+
+#ifndef CLIENT_INOTIFY_H
+#define CLIENT_INOTIFY_H
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// the directories are split between some inotify instances (by top-level directory): if the event queue of an
+// instance overflows only the directories of that instance must be scanned again
+#define INOTIFY_INSTANCES 8
+
+// the events are collected until there are no new events for EVENT_SETTLE_MS (at most EVENT_MAX_WAIT_MS)
+#define EVENT_SETTLE_MS 50
+#define EVENT_MAX_WAIT_MS 1000
+
+enum ChangeType {
+    change_path,        // the file/folder in path was created, modified or removed
+    change_children,    // the direct children of the folder must be compared (events lost)
+    change_subtree      // the whole subtree of the folder must be compared (events lost)
+};
+
+struct Change {
+    std::string path;
+    ChangeType type;
+};
+
+// Watch a tree of directories with inotify and report the paths changed
+class Inotify {
+    // an inotify instance with its watched directories (by watch descriptor)
+    struct Instance {
+        int fd = -1;
+        std::unordered_map<int, std::string> dirs;
+    };
+
+    std::string root_;
+    std::vector<Instance> instances_;
+    // watched directories: instance and watch descriptor
+    std::unordered_map<std::string, std::pair<int, int>> watches_;
+
+    int instance_of(const std::string &dir) const;
+    void lost_events(int instance, std::vector<Change> &changes) const;
+
+public:
+    Inotify() = default;
+    ~Inotify();
+
+    bool init(const std::string &root);
+    bool add_tree(const std::string &dir);
+    void remove_tree(const std::string &dir);
+    std::vector<Change> wait();
+
+    Inotify(const Inotify&)= delete;
+    Inotify& operator=(const Inotify&)= delete;
+};
+
+
+#endif //CLIENT_INOTIFY_H
@@ -5,90 +5,205 @@
 #include "Session.h"
 #include "configuration.h"
 #include "ExceptionBackup.h"
+#include "digest.h"
 
 
-Session::Session(net::io_context &ioc, http::request<http::string_body> &req, http::response<http::string_body> &res)
+template<class Body>
+Session<Body>::Session(ConnectionPool &pool, http::request<Body> &req, http::response<http::string_body> &res)
 
-        : resolver_(net::make_strand(ioc))
-        , stream_(net::make_strand(ioc))
+        : pool_(pool)
+        , resolver_(net::make_strand(pool.context()))
         , req_(req)
         , res_(res)
 {
 }
 
-void Session::run() {
+template<class Body>
+std::future<void> Session<Body>::run() {
     // Finalize the HTTP request message
     req_.set(http::field::host, configuration::address + ":" + configuration::port);
     req_.version(11);
     req_.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    req_.keep_alive(true);
+
+    // authorization, with the algorithm of the digests chosen at the login
+    std::string token;
+    {
+        std::lock_guard<std::mutex> lg(configuration::token_mutex);
+        token = configuration::token;
+    }
+    if (!token.empty()) {
+        req_.set(http::field::authorization, token);
+        req_.set(DIGEST_ALGORITHM_HEADER, configuration::digest);
+    }
+
+    std::future<void> done = done_.get_future();
+
+    // Use an open connection if there is one, otherwise open a new one
+    conn_ = pool_.acquire();
+    if (conn_) {
+        reused_ = true;
+        net::dispatch(conn_->stream.get_executor(),
+                      beast::bind_front_handler(
+                              &Session<Body>::do_write,
+                              this->shared_from_this()));
+    } else {
+        connect();
+    }
+
+    return done;
+}
 
-    // authorization
-    if (!configuration::token.empty())
-        req_.set(http::field::authorization, configuration::token);
+template<class Body>
+void Session<Body>::connect() {
+    reused_ = false;
+    conn_ = std::make_unique<Connection>(pool_.context());
+
+    // Look up the domain name only the first time
+    std::optional<tcp::resolver::results_type> endpoints = pool_.endpoints();
+    if (endpoints) {
+        net::post(conn_->stream.get_executor(),
+                  beast::bind_front_handler(
+                          &Session<Body>::on_resolve,
+                          this->shared_from_this(),
+                          beast::error_code{},
+                          endpoints.value()));
+        return;
+    }
 
-    // Look up the domain name
     resolver_.async_resolve(
             configuration::address,
             configuration::port,
             beast::bind_front_handler(
-                    &Session::on_resolve,
-                    shared_from_this()));
+                    &Session<Body>::on_resolve,
+                    this->shared_from_this()));
 }
 
-void Session::on_resolve(beast::error_code ec, const tcp::resolver::results_type &results) {
+template<class Body>
+void Session<Body>::on_resolve(beast::error_code ec, const tcp::resolver::results_type &results) {
     if(ec)
-        throw (ExceptionBackup("resolve: " + ec.message(), async_resolver_error));
+        return fail(std::make_exception_ptr(ExceptionBackup("resolve: " + ec.message(), async_resolver_error)));
+
+    pool_.set_endpoints(results);
 
     // Set a timeout on the operation
-    stream_.expires_after(std::chrono::seconds(60));
+    conn_->stream.expires_after(std::chrono::seconds(60));
 
     // Make the connection on the IP address we get from a lookup
-    stream_.async_connect(
+    conn_->stream.async_connect(
             results,
             beast::bind_front_handler(
-                    &Session::on_connect,
-                    shared_from_this()));
+                    &Session<Body>::on_connect,
+                    this->shared_from_this()));
 }
 
-void Session::on_connect(beast::error_code ec, const tcp::resolver::results_type::endpoint_type &) {
-    if(ec)
-        throw (ExceptionBackup("connect: " + ec.message(), async_connection_error));
+template<class Body>
+void Session<Body>::on_connect(beast::error_code ec, const tcp::resolver::results_type::endpoint_type &) {
+    if(ec) {
+        // the address could have changed, resolve it again at the next connection
+        pool_.invalidate_endpoints();
+        return fail(std::make_exception_ptr(ExceptionBackup("connect: " + ec.message(), async_connection_error)));
+    }
+
+    do_write();
+}
 
+template<class Body>
+void Session<Body>::do_write() {
     // Set a timeout on the operation
-    stream_.expires_after(std::chrono::seconds(60));
+    conn_->stream.expires_after(std::chrono::seconds(60));
 
     // Send the HTTP request to the remote host
-    http::async_write(stream_, req_,
+    http::async_write(conn_->stream, req_,
                       beast::bind_front_handler(
-                              &Session::on_write,
-                              shared_from_this()));
+                              &Session<Body>::on_write,
+                              this->shared_from_this()));
 }
 
-void Session::on_write(beast::error_code ec, std::size_t bytes_transferred) {
+template<class Body>
+void Session<Body>::on_write(beast::error_code ec, std::size_t bytes_transferred) {
     boost::ignore_unused(bytes_transferred);
 
-    if(ec)
-        throw (ExceptionBackup("write: " + ec.message(), async_write_error));
+    if(ec) {
+        if (retry_on_stale(ec, false))
+            return;
+        return fail(std::make_exception_ptr(ExceptionBackup("write: " + ec.message(), async_write_error)));
+    }
 
     // Receive the HTTP response
-    http::async_read(stream_, buffer_, res_,
+    http::async_read(conn_->stream, conn_->buffer, res_,
                      beast::bind_front_handler(
-                             &Session::on_read,
-                             shared_from_this()));
+                             &Session<Body>::on_read,
+                             this->shared_from_this()));
 }
 
-void Session::on_read(beast::error_code ec, std::size_t bytes_transferred) {
+template<class Body>
+void Session<Body>::on_read(beast::error_code ec, std::size_t bytes_transferred) {
     boost::ignore_unused(bytes_transferred);
 
-    if(ec)
-        throw (ExceptionBackup("read: " + ec.message(), async_read_error));
-
-    // Gracefully close the socket
-    stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+    if(ec) {
+        if (retry_on_stale(ec, true))
+            return;
+        return fail(std::make_exception_ptr(ExceptionBackup("read: " + ec.message(), async_read_error)));
+    }
+
+    if (res_.keep_alive()) {
+        // the connection can be used again by another request
+        pool_.release(std::move(conn_));
+    } else {
+        // Gracefully close the socket
+        conn_->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+
+        // not_connected happens sometimes so don't bother reporting it.
+        if(ec && ec != beast::errc::not_connected)
+            return fail(std::make_exception_ptr(ExceptionBackup("shutdown: " + ec.message(), async_shutdown_error)));
+    }
+
+    done_.set_value();
+}
 
-    // not_connected happens sometimes so don't bother reporting it.
-    if(ec && ec != beast::errc::not_connected)
-        throw (ExceptionBackup("shutdown: " + ec.message(), async_shutdown_error));
+/**
+ * a connection taken from the pool may have been closed by the server while it was idle:
+ * in this case the request is sent again on a new connection. If the whole request was written the server may
+ * have executed it before closing, so it is sent again only if it is idempotent
+ *
+ * @param ec error of the write or read operation
+ * @param written true if the request was completely written (the error is of the read)
+ * @return true if the request has been restarted
+ */
+template<class Body>
+bool Session<Body>::retry_on_stale(beast::error_code ec, bool written) {
+    if (!reused_)
+        return false;
+
+    if (written) {
+        http::verb method = req_.method();
+        if (method != http::verb::get && method != http::verb::head && method != http::verb::put &&
+            method != http::verb::delete_)
+            return false;
+    }
+
+    if (ec != http::error::end_of_stream &&
+        ec != net::error::eof &&
+        ec != net::error::connection_reset &&
+        ec != net::error::broken_pipe)
+        return false;
+
+    pool_.stale();
+    res_ = {};
+    res_.result(http::status::unknown);
+    connect();
+    return true;
+}
 
-    // If we get here then the connection is closed gracefully
+/**
+ * report the error to the thread waiting for the response
+ */
+template<class Body>
+void Session<Body>::fail(const std::exception_ptr &e) {
+    conn_.reset();
+    done_.set_exception(e);
 }
+
+template class Session<http::string_body>;
+template class Session<UploadBody>;
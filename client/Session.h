@@ -5,36 +5,46 @@
 #ifndef CLIENT_SESSION_H
 #define CLIENT_SESSION_H
 
+#include <future>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/asio/strand.hpp>
 
+#include "ConnectionPool.h"
+#include "UploadBody.h"
+
 namespace beast = boost::beast;     // from <boost/beast.hpp>
 namespace http = beast::http;       // from <boost/beast/http.hpp>
 namespace net = boost::asio;        // from <boost/asio.hpp>
 using tcp = net::ip::tcp;           // from <boost/asio/ip/tcp.hpp>
 
-// Performs an HTTP request and saves the response
-class Session : public std::enable_shared_from_this<Session>
+// Performs an HTTP request on a pooled connection and saves the response
+template<class Body>
+class Session : public std::enable_shared_from_this<Session<Body>>
 {
+    ConnectionPool& pool_;
     tcp::resolver resolver_;
-    beast::tcp_stream stream_;
-    beast::flat_buffer buffer_; // (Must persist between reads)
-    http::request<http::string_body>& req_; // received by reference
+    std::unique_ptr<Connection> conn_;
+    bool reused_ = false; // the connection was taken from the pool
+    http::request<Body>& req_; // received by reference
     http::response<http::string_body>& res_; // received by reference
+    std::promise<void> done_;
 
 public:
     // Objects are constructed with a strand to ensure that handlers do not execute concurrently.
     explicit
-    Session(net::io_context& ioc,
-            http::request<http::string_body>& req,
+    Session(ConnectionPool& pool,
+            http::request<Body>& req,
             http::response<http::string_body>& res);
 
-    // Start the asynchronous operation
-    void
+    // Start the asynchronous operation, the future is ready when the response is received
+    std::future<void>
     run();
 
+    void
+    connect();
+
     void
     on_resolve(
             beast::error_code ec,
@@ -43,6 +53,9 @@ public:
     void
     on_connect(beast::error_code ec, const tcp::resolver::results_type::endpoint_type&);
 
+    void
+    do_write();
+
     void
     on_write(
             beast::error_code ec,
@@ -52,7 +65,18 @@ public:
     on_read(
             beast::error_code ec,
             std::size_t bytes_transferred);
+
+private:
+    bool
+    retry_on_stale(beast::error_code ec, bool written);
+
+    void
+    fail(const std::exception_ptr& e);
 };
 
 
+// the body types of the requests sent to the server (explicitly instantiated in Session.cpp)
+extern template class Session<http::string_body>;
+extern template class Session<UploadBody>;
+
 #endif //CLIENT_SESSION_H
@@ -0,0 +1,144 @@
+//
+// Created by giacomo on 21/09/20.
+//
+
+#include <algorithm>
+
+#include "SyncExecutor.h"
+#include "client.h"
+
+/**
+ * start the threads that send the requests, each one has a request at a time
+ *
+ * @param max_inflight max number of operations executed at the same time
+ */
+SyncExecutor::SyncExecutor(unsigned int max_inflight) {
+    for (unsigned int i = 0; i < std::max(1u, max_inflight); i++)
+        threads_.emplace_back([this]() { work(); });
+}
+
+SyncExecutor::~SyncExecutor() {
+    {
+        std::lock_guard lg(m_);
+        stop_ = true;
+        ready_cv_.notify_all();
+    }
+    for (auto &t: threads_) {
+        if(t.joinable()) t.join();
+    }
+}
+
+/**
+ * add an operation: it is executed as soon as the operations it depends on are completed
+ *
+ * @param type of the operation
+ * @param path absolute path of the file/folder
+ */
+void SyncExecutor::submit(OperationType type, const std::string &path) {
+    auto operation = std::make_shared<Operation>();
+    operation->type = type;
+    operation->path = path;
+
+    std::lock_guard lg(m_);
+    auto depends_on = [&operation](const std::shared_ptr<Operation> &before) {
+        before->next.push_back(operation);
+        operation->waiting++;
+    };
+
+    // the same path
+    auto it = last_.find(path);
+    if (it != last_.end())
+        depends_on(it->second);
+
+    // the folders that contain the path
+    for (std::size_t pos = path.rfind('/'); pos != std::string::npos && pos > 0; pos = path.rfind('/', pos - 1)) {
+        auto parent = last_.find(path.substr(0, pos));
+        if (parent != last_.end())
+            depends_on(parent->second);
+    }
+
+    // the paths inside the folder
+    std::string prefix = path.back() == '/' ? path : path + "/";
+    for (auto child = last_.lower_bound(prefix); child != last_.end() && child->first.rfind(prefix, 0) == 0; child++)
+        depends_on(child->second);
+
+    last_[path] = operation;
+    pending_++;
+    if (operation->waiting == 0) {
+        ready_.push_back(operation);
+        ready_cv_.notify_one();
+    }
+}
+
+/**
+ * wait until all the operations submitted are completed, can throws the first ExceptionBackup
+ * of an operation (the connection with the server was lost or the server answered with a error)
+ */
+void SyncExecutor::wait() {
+    std::unique_lock lock(m_);
+    idle_cv_.wait(lock, [this]() { return pending_ == 0; });
+
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * take the operations ready and send their requests
+ */
+void SyncExecutor::work() {
+    while (true) {
+        std::shared_ptr<Operation> operation;
+        bool skip;
+        {
+            std::unique_lock lock(m_);
+            ready_cv_.wait(lock, [this]() { return stop_ || !ready_.empty(); });
+            if (stop_)
+                return;
+            operation = ready_.front();
+            ready_.pop_front();
+            skip = error_ != nullptr;
+        }
+
+        if (!skip) {
+            try {
+                switch (operation->type) {
+                    case op_backup_file: backup_file(operation->path); break;
+                    case op_update_file: update_file(operation->path); break;
+                    case op_backup_folder: backup_folder(operation->path); break;
+                    case op_delete: delete_path(operation->path); break;
+                }
+            } catch (...) {
+                std::lock_guard lg(m_);
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+        }
+        complete(operation);
+    }
+}
+
+/**
+ * an operation is completed: the operations waiting only for it become ready
+ *
+ * @param operation completed
+ */
+void SyncExecutor::complete(const std::shared_ptr<Operation> &operation) {
+    std::lock_guard lg(m_);
+    for (const std::shared_ptr<Operation> &after: operation->next) {
+        if (--after->waiting == 0) {
+            ready_.push_back(after);
+            ready_cv_.notify_one();
+        }
+    }
+    operation->next.clear();
+
+    auto it = last_.find(operation->path);
+    if (it != last_.end() && it->second == operation)
+        last_.erase(it);
+
+    if (--pending_ == 0)
+        idle_cv_.notify_all();
+}
@@ -0,0 +1,70 @@
+//
+// Created by giacomo on 21/09/20.
+//
+
+#ifndef CLIENT_SYNCEXECUTOR_H
+#define CLIENT_SYNCEXECUTOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// operations sent to the server for a change of a path
+enum OperationType {
+    op_backup_file,
+    op_update_file,
+    op_backup_folder,
+    op_delete
+};
+
+// Execute the operations of the changes with up to max_inflight requests to the server at the same time.
+// An operation waits for the operations submitted before it on the same path, on a folder that contains it
+// (e.g. the folder is created before its files) or on a path inside it (e.g. a folder is deleted after
+// the files in it are sent); the other operations are executed in parallel
+class SyncExecutor {
+    struct Operation {
+        OperationType type;
+        std::string path;
+        // operations not completed that must be executed before this one
+        int waiting = 0;
+        // operations waiting for this one
+        std::vector<std::shared_ptr<Operation>> next;
+    };
+
+    std::mutex m_;
+    std::condition_variable ready_cv_;
+    std::condition_variable idle_cv_;
+    // operations that can be executed, in order of submission
+    std::deque<std::shared_ptr<Operation>> ready_;
+    // last operation not completed of each path (sorted, so the paths inside a folder are contiguous)
+    std::map<std::string, std::shared_ptr<Operation>> last_;
+    // operations submitted and not completed
+    std::size_t pending_ = 0;
+    bool stop_ = false;
+    // the first error: the operations after it are skipped, the caller synchronizes again all the tree
+    std::exception_ptr error_;
+
+    std::vector<std::thread> threads_;
+
+    void work();
+    void complete(const std::shared_ptr<Operation> &operation);
+
+public:
+    explicit SyncExecutor(unsigned int max_inflight);
+    ~SyncExecutor();
+
+    void submit(OperationType type, const std::string &path);
+    void wait();
+
+    SyncExecutor(const SyncExecutor&)= delete;
+    SyncExecutor& operator=(const SyncExecutor&)= delete;
+};
+
+
+#endif //CLIENT_SYNCEXECUTOR_H
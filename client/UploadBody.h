@@ -0,0 +1,177 @@
+//
+// Created by giacomo on 14/09/20.
+//
+
+#ifndef CLIENT_UPLOADBODY_H
+#define CLIENT_UPLOADBODY_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include "gzip.h"
+
+namespace beast = boost::beast;     // from <boost/beast.hpp>
+namespace http = beast::http;       // from <boost/beast/http.hpp>
+namespace net = boost::asio;        // from <boost/asio.hpp>
+
+// size of the blocks read from the file while it is sent
+#define UPLOAD_BLOCK_SIZE (64 * 1024)
+
+// Body of an upload: the content of a file (or some ranges of it) is read in
+// blocks while it is sent, so only one block at a time is kept in memory.
+// The blocks can be compressed while they are sent (the message must have Content-Encoding: gzip).
+// The message must use chunked transfer encoding.
+struct UploadBody {
+
+    class value_type {
+        beast::file file_;
+        // parts of the file to send in order, as offset and size
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges_;
+        bool compress_ = false;
+
+        friend struct UploadBody;
+
+    public:
+        /**
+         * open the file to send, the whole file is sent
+         *
+         * @param path of the file
+         * @param ec set if the file can't be opened
+         */
+        void open(const std::string &path, beast::error_code &ec) {
+            file_.open(path.c_str(), beast::file_mode::scan, ec);
+            if (ec)
+                return;
+            ranges_ = {{0, file_.size(ec)}};
+        }
+
+        /**
+         * send only a part of the file
+         *
+         * @param offset first byte to send
+         * @param size number of bytes to send
+         */
+        void range(std::uint64_t offset, std::uint64_t size) {
+            ranges_ = {{offset, size}};
+        }
+
+        /**
+         * send some parts of the file, one after the other
+         *
+         * @param ranges offset and size of each part
+         */
+        void ranges(std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges) {
+            ranges_ = std::move(ranges);
+        }
+
+        /**
+         * compress the data sent in gzip format
+         *
+         * @param compress true to compress
+         */
+        void compress(bool compress) {
+            compress_ = compress;
+        }
+
+        bool is_open() const {
+            return file_.is_open();
+        }
+    };
+
+    class writer {
+        value_type &body_;
+        std::size_t range_ = 0;
+        std::uint64_t remain_ = 0;
+        std::unique_ptr<char[]> buf_;
+        std::unique_ptr<gzip::Deflater> deflater_;
+        std::string compressed_;    // part of the compressed stream being sent
+        bool finished_ = false;     // the whole compressed stream was produced
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template<bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields> &, value_type &body)
+                : body_(body), buf_(new char[UPLOAD_BLOCK_SIZE]) {
+        }
+
+        void init(beast::error_code &ec) {
+            // the same message can be sent again (e.g. on a new connection), always restart from the first range
+            range_ = 0;
+            remain_ = 0;
+            finished_ = false;
+            if (body_.compress_)
+                deflater_ = std::make_unique<gzip::Deflater>();
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code &ec) {
+            if (!body_.compress_) {
+                std::size_t n = read(ec);
+                if (n == 0)
+                    return boost::none;
+                return {{const_buffers_type{buf_.get(), n}, more()}};
+            }
+
+            // the compressed data is sent when deflate produces some, the last part completes the stream
+            compressed_.clear();
+            while (compressed_.empty() && !finished_) {
+                std::size_t n = read(ec);
+                if (ec)
+                    return boost::none;
+                finished_ = !more();
+                if (!deflater_->update(buf_.get(), n, finished_, compressed_)) {
+                    ec = beast::errc::make_error_code(beast::errc::io_error);
+                    return boost::none;
+                }
+            }
+            if (compressed_.empty())
+                return boost::none;
+            return {{const_buffers_type{compressed_.data(), compressed_.size()}, !finished_}};
+        }
+
+    private:
+        // true if there are other bytes to read
+        bool more() const {
+            return remain_ > 0 || range_ < body_.ranges_.size();
+        }
+
+        // read the next block of the ranges in buf_, return its size (0 at the end)
+        std::size_t read(beast::error_code &ec) {
+            // move to the next range not empty
+            while (remain_ == 0 && range_ < body_.ranges_.size()) {
+                body_.file_.seek(body_.ranges_[range_].first, ec);
+                if (ec)
+                    return 0;
+                remain_ = body_.ranges_[range_].second;
+                range_++;
+            }
+
+            std::size_t amount = remain_ > UPLOAD_BLOCK_SIZE ? UPLOAD_BLOCK_SIZE : static_cast<std::size_t>(remain_);
+            if (amount == 0) {
+                ec = {};
+                return 0;
+            }
+
+            std::size_t n = body_.file_.read(buf_.get(), amount, ec);
+            if (ec)
+                return 0;
+            if (n == 0) {
+                // the file became shorter while it was sent
+                remain_ = 0;
+                range_ = body_.ranges_.size();
+                return 0;
+            }
+
+            remain_ -= n;
+            return n;
+        }
+    };
+};
+
+
+#endif //CLIENT_UPLOADBODY_H
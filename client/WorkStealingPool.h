@@ -0,0 +1,183 @@
+//
+// Created by giacomo on 20/09/20.
+//
+
+#ifndef CLIENT_WORKSTEALINGPOOL_H
+#define CLIENT_WORKSTEALINGPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Run a tree of jobs (e.g. the folders of a scan) on a pool of threads. Each thread has its own deque:
+// it adds and takes its jobs at the back (depth first, the data of the last folder is still in cache),
+// when it has no jobs it steals the oldest one from the front of another deque (usually a big subtree).
+// The threads don't share a single queue, so they don't wait for each other while there are jobs
+template <class T>
+class WorkStealingPool {
+public:
+    // add a job, from inside a job
+    using Add = std::function<void(T)>;
+    // execute a job: index of the thread (to use per-thread buffers), the job, how to add new jobs
+    using Job = std::function<void(unsigned int, const T &, const Add &)>;
+
+private:
+    // deque of a thread, the lock is contended only while a job is being stolen
+    struct Worker {
+        std::mutex m;
+        std::deque<T> jobs;
+    };
+
+    unsigned int n_threads_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // jobs added and not finished yet: when it goes to 0 no job can add new jobs, so all is done
+    std::atomic<long> pending_{0};
+    // jobs in the deques, not taken yet by a thread
+    std::atomic<long> queued_{0};
+    // threads waiting for new jobs
+    std::atomic<int> sleepers_{0};
+    std::atomic<bool> done_{false};
+    std::mutex idle_m_;
+    std::condition_variable idle_cv_;
+
+    // the first exception thrown by a job: the other jobs are skipped and it is thrown again by run
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+    std::mutex error_m_;
+
+    void push(unsigned int index, T job) {
+        pending_.fetch_add(1);
+        {
+            std::lock_guard lg(workers_[index]->m);
+            workers_[index]->jobs.push_back(std::move(job));
+        }
+        queued_.fetch_add(1);
+
+        // wake up a thread without jobs, it will steal this one
+        if (sleepers_.load() > 0) {
+            std::lock_guard lg(idle_m_);
+            idle_cv_.notify_one();
+        }
+    }
+
+    std::optional<T> take(unsigned int index) {
+        // own jobs, the last added
+        {
+            Worker &own = *workers_[index];
+            std::lock_guard lg(own.m);
+            if (!own.jobs.empty()) {
+                T job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                queued_.fetch_sub(1);
+                return job;
+            }
+        }
+        // the oldest job of another thread
+        for (unsigned int i = 1; i < n_threads_; i++) {
+            Worker &victim = *workers_[(index + i) % n_threads_];
+            std::lock_guard lg(victim.m);
+            if (!victim.jobs.empty()) {
+                T job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                queued_.fetch_sub(1);
+                return job;
+            }
+        }
+        return {};
+    }
+
+    void finished() {
+        if (pending_.fetch_sub(1) == 1) {
+            std::lock_guard lg(idle_m_);
+            done_ = true;
+            idle_cv_.notify_all();
+        }
+    }
+
+    void work(unsigned int index, const Job &job) {
+        Add add = [this, index](T next) { push(index, std::move(next)); };
+
+        while (true) {
+            std::optional<T> next = take(index);
+            if (next) {
+                if (!failed_) {
+                    try {
+                        job(index, next.value(), add);
+                    } catch (...) {
+                        std::lock_guard lg(error_m_);
+                        if (!error_)
+                            error_ = std::current_exception();
+                        failed_ = true;
+                    }
+                }
+                finished();
+                continue;
+            }
+
+            // no jobs to take: wait until a job is added or all the jobs are done
+            std::unique_lock lock(idle_m_);
+            sleepers_.fetch_add(1);
+            idle_cv_.wait(lock, [this]() { return done_ || queued_.load() > 0; });
+            sleepers_.fetch_sub(1);
+            if (done_)
+                return;
+        }
+    }
+
+public:
+    explicit WorkStealingPool(unsigned int n_threads = std::thread::hardware_concurrency())
+            : n_threads_{std::max(1u, n_threads)} {}
+
+    /**
+     * @return number of threads, the index of a thread is less than this
+     */
+    unsigned int threads() const {
+        return n_threads_;
+    }
+
+    /**
+     * execute the jobs and all the jobs they add, then return when all of them are done.
+     * The first exception thrown by a job stops the others and is thrown again
+     *
+     * @param first jobs, given to the threads in turn
+     * @param job executes a job
+     */
+    void run(std::vector<T> first, const Job &job) {
+        workers_.clear();
+        for (unsigned int i = 0; i < n_threads_; i++)
+            workers_.push_back(std::make_unique<Worker>());
+        pending_ = 0;
+        queued_ = 0;
+        done_ = false;
+        failed_ = false;
+        error_ = nullptr;
+
+        if (first.empty())
+            return;
+        for (std::size_t i = 0; i < first.size(); i++)
+            push(i % n_threads_, std::move(first[i]));
+
+        std::vector<std::thread> threads;
+        threads.reserve(n_threads_);
+        for (unsigned int i = 0; i < n_threads_; i++)
+            threads.emplace_back([this, i, &job]() { work(i, job); });
+
+        for (auto &t: threads)
+            t.join();
+
+        if (error_)
+            std::rethrow_exception(error_);
+    }
+};
+
+
+#endif //CLIENT_WORKSTEALINGPOOL_H
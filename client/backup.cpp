@@ -2,87 +2,157 @@
 // Created by giacomo on 05/08/20.
 //
 
-#include <openssl/evp.h>
-#include <boost/beast/core/detail/base64.hpp>
 #include <memory>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <sys/stat.h>
 
 #include "backup.h"
+#include "HashIndex.h"
+#include "configuration.h"
+#include "digest.h"
 
-#define BUF_SIZE 2048
+// a digest is saved in the index only if the file was not modified in the last seconds before it was computed:
+// with a coarse mtime a change in the same second would not be detected
+#define INDEX_MIN_AGE 2
 
 namespace fs = std::filesystem;
-namespace base64 = boost::beast::detail::base64;
 
 /**
- * compute the SHA256 digest of a file
+ * @return the algorithm of the digests of the files, chosen at the login
+ */
+static digest::Algorithm digest_algorithm() {
+    return digest::from_name(configuration::digest).value_or(digest::algorithm_sha256);
+}
+
+/**
+ * compute the digest of a file with the algorithm chosen at the login
  *
  * @param path of the file to compute the digest
- * @return the digest in hexadecimal format, a empty optional if file doesn't exist or a error occurred
+ * @return the digest in hexadecimal format, a empty string if file doesn't exist or a error occurred
  */
 std::string calculate_digest(std::string path) {
-    EVP_MD_CTX *md;
-    unsigned char md_value[EVP_MAX_MD_SIZE];
-    char hex_digest[EVP_MAX_MD_SIZE*2+1];
-    int n,i;
-    unsigned int md_len;
-    unsigned char buf[BUF_SIZE];
-    FILE * fin;
-
-    if((fin = fopen(path.c_str(),"rb")) == NULL) {
-        return {};
-    }
-
-    md = EVP_MD_CTX_new();
-    EVP_MD_CTX_init(md);
-
-    EVP_DigestInit(md, EVP_sha256());
-
-    while((n = fread(buf,1,BUF_SIZE,fin)) > 0)
-        EVP_DigestUpdate(md, buf,n);
+    return digest::file(path, digest_algorithm()).value_or("");
+}
 
-    if(EVP_DigestFinal_ex(md, md_value, &md_len) != 1) {
-        //error computing the digest
+/**
+ * read the metadata used to validate a digest of the index
+ *
+ * @param path of the file
+ * @return inode, size and mtime of the file (without digest), a empty optional if it isn't a regular file
+ */
+static std::optional<IndexEntry> file_metadata(const std::string &path) {
+    struct stat st{};
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
         return {};
-    }
+    return IndexEntry{static_cast<std::uint64_t>(st.st_ino), static_cast<std::uint64_t>(st.st_size),
+                      static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec, ""};
+}
 
-    EVP_MD_CTX_free(md);
+/**
+ * current time, to know how old a file is when its digest is computed
+ *
+ * @return nanoseconds since the epoch
+ */
+static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
 
-    //convert in hex
-    for(i = 0; i < md_len; i++)
-        sprintf(hex_digest+2*i,"%02x", md_value[i]);
+/**
+ * save a computed digest in the index, only if the file didn't change while it was read (and not too recently)
+ *
+ * @param path of the file
+ * @param metadata of the file read before the digest was computed
+ * @param digest computed
+ * @param start time when the computation started
+ */
+static void store_digest(const std::string &path, IndexEntry metadata, const std::string &digest, std::int64_t start) {
+    std::optional<IndexEntry> after = file_metadata(path);
+    if (!digest.empty() && after && after->inode == metadata.inode && after->size == metadata.size &&
+        after->mtime == metadata.mtime && start - metadata.mtime > INDEX_MIN_AGE * 1000000000LL) {
+        metadata.digest = digest;
+        HashIndex::getInstance()->store(path, metadata);
+    }
+}
 
-    hex_digest[md_len*2] = 0;
+/**
+ * get the digest of a file: if inode, size and mtime are the same saved in the hash index the digest
+ * of the index is used, otherwise it is computed and saved in the index
+ *
+ * @param path of the file
+ * @return the digest in hexadecimal format, a empty string if file doesn't exist or a error occurred
+ */
+std::string file_digest(const std::string &path) {
+    std::optional<IndexEntry> metadata = file_metadata(path);
+    if (!metadata)
+        return {};
 
-    std::string digest(hex_digest);
+    std::optional<std::string> saved = HashIndex::getInstance()->lookup(path, metadata.value());
+    if (saved)
+        return saved.value();
 
+    std::int64_t start = now_ns();
+    std::string digest = calculate_digest(path);
+    store_digest(path, metadata.value(), digest, start);
     return digest;
 }
 
 /**
- * encode a file in base64
+ * get the digests of many files: the ones in the hash index are taken from it, the others are computed
+ * together by the hashing engine (multi-buffer for the small files when available) and saved in the index
  *
- * @param path of the file to encode
- * @return the file encoded in base64 (ASCII string format)
+ * @param paths of the files
+ * @return the digests in hexadecimal format in the same order, a empty string for the files that don't exist
  */
-std::unique_ptr<char[]> encode(const std::string &path) {
-    std::size_t original_len = fs::file_size(path);
-    std::size_t encoded_len = base64::encoded_size(original_len);
-
-
-    std::unique_ptr<char[]> encoded_file{new char[encoded_len + 1]};
-    std::unique_ptr<char[]> original_file{new char[original_len]};
-
-    std::ifstream file (path, std::ios::in | std::ios::binary);
-    file.read (original_file.get(), original_len);
-
-    std::size_t real_len = base64::encode(encoded_file.get(), original_file.get(), original_len);
-    // the resulting string is not null terminated
-    encoded_file[real_len] = 0;
+std::vector<std::string> file_digests(const std::vector<std::string> &paths) {
+    HashIndex *index = HashIndex::getInstance();
+    std::vector<std::string> digests(paths.size());
+
+    // the files to compute, with their position and metadata
+    std::vector<std::string> missing;
+    std::vector<std::pair<std::size_t, IndexEntry>> positions;
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        std::optional<IndexEntry> metadata = file_metadata(paths[i]);
+        if (!metadata)
+            continue;
+        std::optional<std::string> saved = index->lookup(paths[i], metadata.value());
+        if (saved) {
+            digests[i] = saved.value();
+        } else {
+            missing.push_back(paths[i]);
+            positions.emplace_back(i, metadata.value());
+        }
+    }
+    if (missing.empty())
+        return digests;
+
+    std::int64_t start = now_ns();
+    std::vector<std::optional<std::string>> computed = digest::files(missing, digest_algorithm());
+    for (std::size_t j = 0; j < missing.size(); j++) {
+        auto &[i, metadata] = positions[j];
+        digests[i] = computed[j].value_or("");
+        store_digest(paths[i], metadata, digests[i], start);
+    }
+    return digests;
+}
 
-    return encoded_file;
+/**
+ * compute the hash of a folder as the server does: SHA256 of its children sorted by name, each one as
+ * type, hash, name and a '\0'
+ *
+ * @param children of the folder, by name
+ * @return the hash in hexadecimal format
+ */
+std::string tree_hash(const std::map<std::string, TreeChild> &children) {
+    digest::Hasher hasher(digest::algorithm_sha256);
+    for (const auto &[name, child]: children) {
+        hasher.update(&child.type, 1);
+        hasher.update(child.hash.data(), child.hash.size());
+        hasher.update(name.c_str(), name.size() + 1);
+    }
+    return hasher.final();
 }
 
 /**
@@ -8,12 +8,30 @@
 
 #include <string>
 #include <set>
+#include <map>
+#include <vector>
+
+// types of the children of a folder in the Merkle tree (the same used by the server)
+#define TREE_FILE 'f'
+#define TREE_FOLDER 'd'
+
+// a child of a folder: its type and its hash (digest for a file, hash of the folder otherwise)
+struct TreeChild {
+    char type;
+    std::string hash;
+};
 
 // calculate digest of a file
 std::string calculate_digest(std::string path);
 
-// encode a file in base64
-std::unique_ptr<char[]> encode(const std::string &original_path);
+// digest of a file, taken from the hash index if the file didn't change
+std::string file_digest(const std::string &path);
+
+// digests of many files (e.g. the files of a folder), the ones not in the hash index are computed together
+std::vector<std::string> file_digests(const std::vector<std::string> &paths);
+
+// hash of a folder built from names, types and hashes of its children
+std::string tree_hash(const std::map<std::string, TreeChild> &children);
 
 // get a set of direct children of a directory
 std::set<std::string> get_children(const std::string &path);
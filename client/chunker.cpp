@@ -0,0 +1,117 @@
+//
+// Created by giacomo on 16/09/20.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "chunker.h"
+#include "sha256.h"
+
+// the file is read in blocks of this size (at least CHUNK_MAX_SIZE)
+#define CHUNK_BUF_SIZE (4 * 1024 * 1024)
+
+// the cut point is where the rolling hash has all the bits of the mask to zero: before the average size
+// a mask with more bits is used (harder to match), after it a mask with less bits (easier to match),
+// so the size of the chunks stays close to the average (normalized chunking).
+// The highest bits are used because they depend on the last 64 bytes
+#define MASK_S (((1ULL << 18) - 1) << 46)
+#define MASK_L (((1ULL << 14) - 1) << 50)
+
+/**
+ * random values for the gear rolling hash, always the same so the chunks don't change between executions
+ *
+ * @return the table of 256 values (one for each byte)
+ */
+static const std::uint64_t *gear_table() {
+    static std::uint64_t table[256];
+    static bool init = [] {
+        // splitmix64 with a fixed seed
+        std::uint64_t x = 0x6261636b7570ULL;
+        for (std::uint64_t &value : table) {
+            std::uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            value = z ^ (z >> 31);
+        }
+        return true;
+    }();
+    (void) init;
+    return table;
+}
+
+/**
+ * find the end of the next chunk (FastCDC)
+ *
+ * @param src data where the chunk starts
+ * @param n number of bytes available
+ * @return the size of the chunk
+ */
+static std::size_t cut_point(const unsigned char *src, std::size_t n) {
+    const std::uint64_t *gear = gear_table();
+
+    if (n <= CHUNK_MIN_SIZE)
+        return n;
+    if (n > CHUNK_MAX_SIZE)
+        n = CHUNK_MAX_SIZE;
+    std::size_t normal = n < CHUNK_AVG_SIZE ? n : CHUNK_AVG_SIZE;
+
+    std::uint64_t fp = 0;
+    std::size_t i = CHUNK_MIN_SIZE;
+    for (; i < normal; i++) {
+        fp = (fp << 1) + gear[src[i]];
+        if (!(fp & MASK_S))
+            return i;
+    }
+    for (; i < n; i++) {
+        fp = (fp << 1) + gear[src[i]];
+        if (!(fp & MASK_L))
+            return i;
+    }
+    return n;
+}
+
+/**
+ * split a file in content-defined chunks and compute the digest of each one
+ *
+ * @param path of the file
+ * @return the chunks of the file in order, a empty vector if the file can't be read
+ */
+std::vector<Chunk> chunk_file(const std::string &path) {
+    std::vector<Chunk> chunks;
+    FILE *fin;
+
+    if ((fin = fopen(path.c_str(), "rb")) == nullptr)
+        return chunks;
+
+    std::unique_ptr<unsigned char[]> buf{new unsigned char[CHUNK_BUF_SIZE]};
+    std::size_t start = 0, end = 0;
+    std::uint64_t offset = 0;
+    bool eof = false;
+
+    while (true) {
+        // keep in the buffer at least a chunk of the max size
+        if (!eof && end - start < CHUNK_MAX_SIZE) {
+            std::memmove(buf.get(), buf.get() + start, end - start);
+            end -= start;
+            start = 0;
+
+            std::size_t n = fread(buf.get() + end, 1, CHUNK_BUF_SIZE - end, fin);
+            end += n;
+            if (n == 0)
+                eof = true;
+            continue;
+        }
+        if (start == end)
+            break;
+
+        std::size_t size = cut_point(buf.get() + start, end - start);
+        chunks.push_back(Chunk{offset, size, sha256::digest(buf.get() + start, size)});
+        start += size;
+        offset += size;
+    }
+
+    fclose(fin);
+    return chunks;
+}
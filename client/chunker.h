@@ -0,0 +1,28 @@
+//
+// Created by giacomo on 16/09/20.
+//
+
+#ifndef CLIENT_CHUNKER_H
+#define CLIENT_CHUNKER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// sizes of the chunks (FastCDC content-defined chunking)
+#define CHUNK_MIN_SIZE (16 * 1024)
+#define CHUNK_AVG_SIZE (64 * 1024)
+#define CHUNK_MAX_SIZE (256 * 1024)
+
+// a part of a file, its boundaries depend on the content so an insertion changes only the chunks around it
+struct Chunk {
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::string hash; // SHA256 of the content
+};
+
+// split a file in chunks, return a empty vector if the file can't be read
+std::vector<Chunk> chunk_file(const std::string &path);
+
+
+#endif //CLIENT_CHUNKER_H
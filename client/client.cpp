@@ -3,29 +3,103 @@
 //
 
 #include <iostream>
+#include <fstream>
+#include <algorithm>
 #include <thread>
+#include <mutex>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
 #include <nlohmann/json.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <future>
+#include <charconv>
 
 #include "client.h"
 #include "backup.h"
 #include "configuration.h"
 #include "Session.h"
 #include "ExceptionBackup.h"
+#include "chunker.h"
+#include "delta.h"
+#include "gzip.h"
 
 // define the target for using the server API
 #define api_probefile "/probefile/"
 #define api_probefolder "/probefolder/"
+#define api_probetree "/probetree/"
 #define api_backup "/backup/"
+#define api_upload "/upload/"
+#define api_commit "/commit/"
+#define api_chunks "/chunks"
+#define api_signature "/signature/"
+#define api_delta "/delta/"
+#define api_refresh "/refresh"
+
+// files bigger than this are split in chunks and only the chunks not on the server are sent
+#define CHUNKED_UPLOAD_SIZE (1024 * 1024)
+// the chunks are sent with a resumable upload, in parts of this size
+#define RESUMABLE_PART_SIZE (8 * 1024 * 1024)
+// how many times the upload starts again if the server lost some chunks before the commit
+#define CHUNKED_UPLOAD_RETRIES 3
+// files smaller than this are not compressed, the gzip header would take most of the gain
+#define COMPRESS_MIN_SIZE 512
+// bytes read at the start and in the middle of a file to check if it is worth compressing
+#define COMPRESS_SAMPLE_SIZE (32 * 1024)
+// modified files smaller than this are always sent whole
+#define DELTA_MIN_SIZE (64 * 1024)
+// the delta is not used if it contains more new bytes than this (or than half of the file)
+#define DELTA_MAX_LITERAL (32 * 1024 * 1024)
+// header of the responses with a token, with the seconds it is valid
+#define TOKEN_LIFETIME_HEADER "Token-Lifetime"
+// seconds before asking again a new token, if the server didn't give it
+#define TOKEN_REFRESH_RETRY 60
 
 // define folder and file standards
-enum TargetType { probefolder, probefile, backupfile, backupfolder, delete_ };
+enum TargetType { probefolder, probefile, backupfolder, delete_ };
 
 
 using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// extensions of the formats already compressed, these files are sent as they are
+const std::unordered_set<std::string> compressed_extensions = {
+        ".gz", ".tgz", ".bz2", ".xz", ".zst", ".lz4", ".zip", ".7z", ".rar", ".jar", ".apk",
+        ".jpg", ".jpeg", ".png", ".gif", ".webp", ".heic", ".mp3", ".aac", ".ogg", ".flac", ".opus",
+        ".mp4", ".mkv", ".avi", ".mov", ".webm", ".docx", ".xlsx", ".pptx", ".odt", ".ods", ".epub"};
+
+// a chunked upload started on the server, it can be continued only if the file didn't change
+struct ChunkedUpload {
+    std::string id;
+    std::uintmax_t size;
+    fs::file_time_type last_write_time;
+    std::vector<Chunk> chunks;
+    std::vector<bool> sent;     // the chunk is in the uploaded data, otherwise the server already has it
+    std::uint64_t pack_size;    // bytes to upload, the sum of the chunks sent
+};
+
+// chunked uploads not completed, by absolute path of the file. They are saved in the file hash_index + ".uploads",
+// so they are resumed (or deleted on the server) also after a restart of the client
+std::unordered_map<std::string, ChunkedUpload> chunked_uploads;
+std::mutex mutex_chunked_uploads;
 
 void replaceSpaces(std::string &str);
+std::unordered_set<std::string> query_missing_chunks(const std::vector<Chunk> &chunks);
+std::optional<ChunkedUpload> plan_upload(const std::string &abs_path, const std::string &relative_path,
+                                         std::uintmax_t size, fs::file_time_type last_write_time);
+std::vector<std::pair<std::uint64_t, std::uint64_t>> pack_ranges(const ChunkedUpload &upload, std::uint64_t offset,
+                                                                std::uint64_t length);
+bool chunked_upload(const std::string &abs_path, const std::string &relative_path, std::uintmax_t size,
+                    fs::file_time_type last_write_time, const std::string &previous_digest);
+void save_chunked_uploads();
+std::uint64_t received_bytes(const http::response<http::string_body> &res);
+http::response<http::string_body> empty_request(http::verb method, const std::string &target);
 bool send_request(http::verb method, const std::string &abs_path, TargetType type);
+bool compress_file(const std::string &abs_path, std::uintmax_t size);
+std::chrono::steady_clock::time_point token_refresh_time(const http::response<http::string_body> &res);
+void refresh_token();
+template<class Body>
+void perform_request(http::request<Body> &req, http::response<http::string_body> &res);
 
 
 void replaceSpaces(std::string &str) {
@@ -35,6 +109,120 @@ void replaceSpaces(std::string &str) {
     }
 }
 
+/**
+ * check if a file is worth compressing when it is sent: the server must accept compressed bodies, the format must
+ * not be already compressed and a sample of the content (from the start and from the middle) must shrink
+ *
+ * @param abs_path absolute path of the file
+ * @param size of the file
+ * @return true if the file must be sent compressed
+ */
+bool compress_file(const std::string &abs_path, std::uintmax_t size) {
+    if (!configuration::compression || size < COMPRESS_MIN_SIZE)
+        return false;
+
+    std::string extension = fs::path(abs_path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (compressed_extensions.count(extension) > 0)
+        return false;
+
+    std::ifstream file(abs_path, std::ios::binary);
+    std::string sample(std::min<std::uintmax_t>(size, 2 * COMPRESS_SAMPLE_SIZE), 0);
+    if (size > sample.size()) {
+        file.read(&sample[0], COMPRESS_SAMPLE_SIZE);
+        file.seekg(static_cast<std::streamoff>(size / 2));
+        file.read(&sample[COMPRESS_SAMPLE_SIZE], COMPRESS_SAMPLE_SIZE);
+    } else {
+        file.read(&sample[0], static_cast<std::streamsize>(sample.size()));
+    }
+    if (!file)
+        return false;
+    return gzip::compressible(sample.data(), sample.size());
+}
+
+/**
+ * send a request on a connection of the pool and wait for the response,
+ * can throws an ExceptionBackup if the connection fails
+ *
+ * @param req request to send
+ * @param res where the response is saved
+ */
+template<class Body>
+void perform_request(http::request<Body> &req, http::response<http::string_body> &res) {
+    // a token near its expiry is replaced before it is sent
+    refresh_token();
+
+    // Launch the asynchronous operation, the shared io_context is run by the pool
+    std::future<void> done = std::make_shared<Session<Body>>(*ConnectionPool::getInstance(), req, res)->run();
+
+    // The call will return when the request is complete
+    done.get();
+}
+
+/**
+ * @param res response of the server with a new token
+ * @return when the token must be refreshed: after half of its lifetime, never if the server doesn't tell it
+ */
+std::chrono::steady_clock::time_point token_refresh_time(const http::response<http::string_body> &res) {
+    auto lifetime = res[TOKEN_LIFETIME_HEADER];
+    int seconds = 0;
+    if (lifetime.empty() ||
+        std::from_chars(lifetime.data(), lifetime.data() + lifetime.size(), seconds).ec != std::errc() ||
+        seconds <= 0)
+        return std::chrono::steady_clock::time_point::max();
+    return std::chrono::steady_clock::now() + std::chrono::seconds(seconds / 2);
+}
+
+/**
+ * ask the server a new token when half of the lifetime of the current one has passed, so a client running for a
+ * long time stays authenticated; can throws an ExceptionBackup if the connection fails
+ */
+void refresh_token() {
+    {
+        std::lock_guard<std::mutex> lg(configuration::token_mutex);
+        if (configuration::token.empty() || std::chrono::steady_clock::now() < configuration::token_refresh)
+            return;
+        // the requests sent in the meantime (this one too) use the current token
+        configuration::token_refresh = std::chrono::steady_clock::time_point::max();
+    }
+
+    http::response<http::string_body> res;
+    try {
+        res = empty_request(http::verb::post, api_refresh);
+    } catch (const ExceptionBackup &e) {
+        res.result(http::status::service_unavailable);
+    }
+
+    std::lock_guard<std::mutex> lg(configuration::token_mutex);
+    if (res.result() == http::status::ok) {
+        configuration::token = res.body();
+        configuration::token_refresh = token_refresh_time(res);
+    } else {
+        configuration::token_refresh = std::chrono::steady_clock::now() + std::chrono::seconds(TOKEN_REFRESH_RETRY);
+    }
+}
+
+/**
+ * send a request without body and wait for the response, can throws an ExceptionBackup if the connection fails
+ *
+ * @param method of the request
+ * @param target of the request
+ * @return the response of the server
+ */
+http::response<http::string_body> empty_request(http::verb method, const std::string &target) {
+    http::request<http::string_body> req;
+    http::response<http::string_body> res;
+    res.result(http::status::unknown);
+
+    req.method(method);
+    req.target(target);
+    req.prepare_payload();
+
+    perform_request(req, res);
+    return res;
+}
+
 /**
  * send requests to the server, for all requests except the probe_file which is different
  *
@@ -61,7 +249,7 @@ bool send_request(http::verb method, const std::string &abs_path, TargetType typ
     switch (type){
         case probefolder : target = api_probefolder; break;
         case probefile : target = api_probefile; break;
-        case backupfile :  case backupfolder : case delete_ : target = api_backup; break;
+        case backupfolder : case delete_ : target = api_backup; break;
     }
     req.target(target + relative_path);
 
@@ -72,24 +260,14 @@ bool send_request(http::verb method, const std::string &abs_path, TargetType typ
     else if(type == backupfolder) {
         j["type"] = "folder";
     }
-    else if(type == backupfile) {
-        auto encoded_file = encode(abs_path);
-        j["type"] = "file";
-        j["encodedfile"] = encoded_file.get();
-    }
 
     if(!j.empty()) {
         req.set(http::field::content_type, "application/json");
         req.body() = j.dump();
-        req.content_length(j.dump().length());
+        req.prepare_payload();
     }
 
-    net::io_context ioc;
-    // Launch the asynchronous operation
-    std::make_shared<Session>(ioc, req, res)->run();
-
-    // Run the I/O service. The call will return when the get operation is complete.
-    ioc.run();
+    perform_request(req, res);
 
     if(res.result() == http::status::ok) {
         return true;
@@ -121,20 +299,13 @@ bool probe_file(const std::string& abs_path) {
     req.method(http::verb::get);
     req.target(api_probefile + relative_path);
 
-    net::io_context ioc;
-    // Launch the asynchronous operation
-    std::make_shared<Session>(ioc, req, res)->run();
-
-    // Run the I/O service. The call will return when the get operation is complete.
-    std::thread t_probe_file(
-            [&ioc] {
-                ioc.run();
-            });
+    // Launch the asynchronous operation on a pooled connection
+    std::future<void> done = std::make_shared<Session<http::string_body>>(*ConnectionPool::getInstance(), req, res)->run();
 
-    // digest calculation while waiting for the http response
-    std::string local_digest = calculate_digest(abs_path);
+    // digest calculation while waiting for the http response (from the hash index if the file didn't change)
+    std::string local_digest = file_digest(abs_path);
 
-    t_probe_file.join();
+    done.get();
 
     if(res.result() == http::status::ok){
         if ( res.body() == local_digest) {
@@ -142,9 +313,10 @@ bool probe_file(const std::string& abs_path) {
             return true;
         }
         else {
-            // digests are different -> delete file from server and re-send it. Then check with probe file
-            delete_path(abs_path);
-            backup_file(abs_path);
+            // digests are different -> the server replaces its copy in a single request, if it is still the one
+            // probed. Otherwise it changed in the meantime and it is checked again
+            if (update_file(abs_path, res.body()))
+                return true;
             return probe_file(abs_path);
         }
     }
@@ -158,11 +330,481 @@ bool probe_file(const std::string& abs_path) {
 
 /**
  * send a backup_file request to the server and can throws an ExceptionBackup
+ * the file is sent as raw bytes with chunked transfer encoding, reading it a block at a time.
+ * The server replaces its copy only when the new one is complete, so it always has a version of the file
  *
  * @param abs_path absolute path of the file to be backed up
+ * @param previous_digest digest of the copy on the server to replace (If-Match), empty to replace any copy.
+ * It is not checked for the big files sent in chunks
+ * @return false if the copy on the server is not previous_digest (it is not replaced)
  */
-void backup_file(const std::string& abs_path) {
-    send_request(http::verb::post, abs_path, backupfile);
+bool backup_file(const std::string& abs_path, const std::string& previous_digest) {
+    http::request<UploadBody> req;
+    http::response<http::string_body> res;
+    res.result(http::status::unknown);
+
+    // make the relative path
+    std::string relative_path = abs_path.substr(configuration::backup_path.length());
+    // substitute spaces with %20
+    replaceSpaces(relative_path);
+
+    // prepare the request message
+    req.method(http::verb::post);
+    req.target(api_backup + relative_path);
+    req.set(http::field::content_type, "application/octet-stream");
+
+    std::error_code size_ec, time_ec;
+    std::uintmax_t size = fs::file_size(abs_path, size_ec);
+    fs::file_time_type last_write_time = fs::last_write_time(abs_path, time_ec);
+    if(size_ec || time_ec) {
+        // the file was removed in the meantime, the deletion will be detected by the FileWatcher
+        return true;
+    }
+
+    if(size > CHUNKED_UPLOAD_SIZE) {
+        // big files are sent in chunks, only the chunks not already on the server are uploaded
+        return chunked_upload(abs_path, relative_path, size, last_write_time, previous_digest);
+    }
+
+    beast::error_code ec;
+    req.body().open(abs_path, ec);
+    if(ec) {
+        // the file was removed in the meantime, the deletion will be detected by the FileWatcher
+        return true;
+    }
+    if(!previous_digest.empty())
+        req.set(http::field::if_match, "\"" + previous_digest + "\"");
+    if(compress_file(abs_path, size)) {
+        req.set(http::field::content_encoding, GZIP_ENCODING);
+        req.body().compress(true);
+    }
+    req.chunked(true);
+
+    perform_request(req, res);
+
+    if(res.result() == http::status::precondition_failed && !previous_digest.empty())
+        return false;
+    if(res.result() != http::status::ok)
+        throw (ExceptionBackup(res.body(), res.result()));
+    return true;
+}
+
+/**
+ * ask to the server which chunks it doesn't have, can throws an ExceptionBackup
+ *
+ * @param chunks of the file
+ * @return the hashes of the chunks that must be sent
+ */
+std::unordered_set<std::string> query_missing_chunks(const std::vector<Chunk> &chunks) {
+    http::request<http::string_body> req;
+    http::response<http::string_body> res;
+    res.result(http::status::unknown);
+
+    std::unordered_set<std::string> hashes;
+    for (const Chunk &chunk: chunks)
+        hashes.insert(chunk.hash);
+
+    json j;
+    j["chunks"] = hashes;
+
+    req.method(http::verb::post);
+    req.target(api_chunks);
+    req.set(http::field::content_type, "application/json");
+    req.body() = j.dump();
+    req.prepare_payload();
+
+    perform_request(req, res);
+
+    if (res.result() != http::status::ok)
+        throw (ExceptionBackup(res.body(), res.result()));
+
+    std::unordered_set<std::string> missing;
+    try {
+        json::parse(res.body()).at("missing").get_to(missing);
+    } catch (json::exception &e) {
+        throw (ExceptionBackup("Bad response to " api_chunks, res.result()));
+    }
+    return missing;
+}
+
+/**
+ * split the file in chunks, find the ones to send and open an upload session for them.
+ * Can throws an ExceptionBackup
+ *
+ * @param abs_path absolute path of the file to be backed up
+ * @param relative_path path of the file on the server (with %20 instead of spaces)
+ * @param size of the file
+ * @param last_write_time of the file
+ * @return the upload to do, a empty optional if the file can't be read
+ */
+std::optional<ChunkedUpload> plan_upload(const std::string &abs_path, const std::string &relative_path,
+                                         std::uintmax_t size, fs::file_time_type last_write_time) {
+    std::vector<Chunk> chunks = chunk_file(abs_path);
+    if (chunks.empty())
+        return {};
+
+    std::unordered_set<std::string> missing = query_missing_chunks(chunks);
+
+    // a chunk repeated in the file is sent only the first time
+    std::vector<bool> sent(chunks.size(), false);
+    std::uint64_t pack_size = 0;
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        if (missing.erase(chunks[i].hash) > 0) {
+            sent[i] = true;
+            pack_size += chunks[i].size;
+        }
+    }
+
+    http::response<http::string_body> res = empty_request(http::verb::post, api_upload + relative_path);
+    if (res.result() != http::status::ok)
+        throw (ExceptionBackup(res.body(), res.result()));
+
+    return ChunkedUpload{res.body(), size, last_write_time, std::move(chunks), std::move(sent), pack_size};
+}
+
+/**
+ * find where a part of the uploaded data is in the file: the uploaded data is the concatenation
+ * of the chunks to send
+ *
+ * @param upload the upload in progress
+ * @param offset first byte of the uploaded data
+ * @param length number of bytes
+ * @return the ranges of the file to send, as offset and size
+ */
+std::vector<std::pair<std::uint64_t, std::uint64_t>> pack_ranges(const ChunkedUpload &upload, std::uint64_t offset,
+                                                                std::uint64_t length) {
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+    std::uint64_t pack_offset = 0;
+
+    for (std::size_t i = 0; i < upload.chunks.size() && length > 0; i++) {
+        if (!upload.sent[i])
+            continue;
+
+        const Chunk &chunk = upload.chunks[i];
+        if (pack_offset + chunk.size > offset) {
+            std::uint64_t skip = offset - std::min(offset, pack_offset);
+            std::uint64_t n = std::min(chunk.size - skip, length);
+            std::uint64_t file_offset = chunk.offset + skip;
+
+            // consecutive chunks are sent as a single range
+            if (!ranges.empty() && ranges.back().first + ranges.back().second == file_offset)
+                ranges.back().second += n;
+            else
+                ranges.emplace_back(file_offset, n);
+            offset += n;
+            length -= n;
+        }
+        pack_offset += chunk.size;
+    }
+    return ranges;
+}
+
+/**
+ * @param res response of the server to a part of an upload, containing the number of bytes received
+ * @return the number of bytes received; throws an ExceptionBackup if the body is not a number (e.g. the error page
+ * of a proxy)
+ */
+std::uint64_t received_bytes(const http::response<http::string_body> &res) {
+    const std::string &body = res.body();
+    std::uint64_t received = 0;
+    auto [end, ec] = std::from_chars(body.data(), body.data() + body.size(), received);
+    if (body.empty() || ec != std::errc() || end != body.data() + body.size())
+        throw (ExceptionBackup("Bad response to " api_upload, res.result()));
+    return received;
+}
+
+/**
+ * load the chunked uploads not completed in the previous executions of the client
+ */
+void load_chunked_uploads() {
+    std::ifstream file(configuration::hash_index + ".uploads");
+    if (!file.is_open())
+        return;
+
+    std::lock_guard lg(mutex_chunked_uploads);
+    try {
+        json j = json::parse(file);
+        for (const json &u: j) {
+            ChunkedUpload upload;
+            u.at("id").get_to(upload.id);
+            u.at("size").get_to(upload.size);
+            auto mtime = fs::file_time_type::duration(u.at("mtime").get<std::int64_t>());
+            upload.last_write_time = fs::file_time_type(mtime);
+            for (const json &c: u.at("chunks"))
+                upload.chunks.push_back(Chunk{c.at("offset").get<std::uint64_t>(), c.at("size").get<std::uint64_t>(),
+                                              c.at("hash").get<std::string>()});
+            u.at("sent").get_to(upload.sent);
+            u.at("pack_size").get_to(upload.pack_size);
+            if (upload.sent.size() == upload.chunks.size())
+                chunked_uploads[u.at("path").get<std::string>()] = std::move(upload);
+        }
+    } catch (json::exception &e) {
+        // a corrupted file, the uploads on the server expire
+        chunked_uploads.clear();
+    }
+}
+
+/**
+ * save the chunked uploads not completed, with mutex_chunked_uploads locked. The file is written in a temporary file
+ * and then renamed, so a crash never leaves a truncated file
+ */
+void save_chunked_uploads() {
+    json j = json::array();
+    for (const auto &[path, upload]: chunked_uploads) {
+        json chunks = json::array();
+        for (const Chunk &chunk: upload.chunks)
+            chunks.push_back({{"offset", chunk.offset}, {"size", chunk.size}, {"hash", chunk.hash}});
+        j.push_back({{"path", path},
+                     {"id", upload.id},
+                     {"size", upload.size},
+                     {"mtime", static_cast<std::int64_t>(upload.last_write_time.time_since_epoch().count())},
+                     {"chunks", std::move(chunks)},
+                     {"sent", upload.sent},
+                     {"pack_size", upload.pack_size}});
+    }
+
+    std::string path = configuration::hash_index + ".uploads";
+    std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::out | std::ios::trunc);
+    out << j.dump();
+    out.close();
+    if (out.fail() || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        std::remove(tmp_path.c_str());
+}
+
+/**
+ * send a file in content-defined chunks: only the chunks that the server doesn't have are uploaded, then
+ * the server builds the file from the list of its chunks. The chunks are sent with a resumable upload in
+ * parts of RESUMABLE_PART_SIZE bytes: if the upload was interrupted (and the file didn't change) it restarts
+ * from the last byte received by the server. Can throws an ExceptionBackup
+ *
+ * @param abs_path absolute path of the file to be backed up
+ * @param relative_path path of the file on the server (with %20 instead of spaces)
+ * @param size of the file
+ * @param last_write_time of the file
+ * @param previous_digest digest of the copy on the server to replace (If-Match of the commit), empty to replace any copy
+ * @return false if the copy on the server is not previous_digest (it is not replaced)
+ */
+bool chunked_upload(const std::string &abs_path, const std::string &relative_path, std::uintmax_t size,
+                    fs::file_time_type last_write_time, const std::string &previous_digest) {
+    std::optional<ChunkedUpload> upload;
+    std::uint64_t offset = 0;
+    int retries = 0;
+    bool compress = compress_file(abs_path, size);
+
+    // look for an upload of the same file not completed
+    {
+        std::lock_guard lg(mutex_chunked_uploads);
+        auto it = chunked_uploads.find(abs_path);
+        if (it != chunked_uploads.end()) {
+            upload = std::move(it->second);
+            chunked_uploads.erase(it);
+            save_chunked_uploads();
+        }
+    }
+    if (upload) {
+        if (upload->size == size && upload->last_write_time == last_write_time) {
+            // ask how many bytes the server received
+            http::response<http::string_body> res = empty_request(http::verb::get, api_upload + upload->id);
+            if (res.result() == http::status::ok)
+                offset = received_bytes(res);
+            else
+                upload.reset();
+        } else {
+            // the file changed, the data already sent is useless
+            empty_request(http::verb::delete_, api_upload + upload->id);
+            upload.reset();
+        }
+    }
+
+    while (true) {
+        if (!upload) {
+            upload = plan_upload(abs_path, relative_path, size, last_write_time);
+            if (!upload) {
+                // the file was removed in the meantime, the deletion will be detected by the FileWatcher
+                return true;
+            }
+            offset = 0;
+        }
+
+        {
+            // if an exception is thrown the upload can be resumed later
+            std::lock_guard lg(mutex_chunked_uploads);
+            chunked_uploads[abs_path] = upload.value();
+            save_chunked_uploads();
+        }
+
+        while (offset < upload->pack_size) {
+            http::request<UploadBody> req;
+            http::response<http::string_body> res;
+            res.result(http::status::unknown);
+
+            req.method(http::verb::put);
+            req.target(api_upload + upload->id + "?offset=" + std::to_string(offset));
+            req.set(http::field::content_type, "application/octet-stream");
+
+            beast::error_code ec;
+            req.body().open(abs_path, ec);
+            if (ec)
+                return true;
+            req.body().ranges(pack_ranges(upload.value(), offset,
+                                          std::min<std::uint64_t>(RESUMABLE_PART_SIZE, upload->pack_size - offset)));
+            if (compress) {
+                // each part is a complete gzip stream, the offsets are of the data not compressed
+                req.set(http::field::content_encoding, GZIP_ENCODING);
+                req.body().compress(true);
+            }
+            req.chunked(true);
+
+            perform_request(req, res);
+
+            // the server answers with the number of bytes received (also if the offset was wrong)
+            if (res.result() != http::status::ok && res.result() != http::status::conflict)
+                throw (ExceptionBackup(res.body(), res.result()));
+
+            std::uint64_t received = received_bytes(res);
+            if (res.result() == http::status::ok && received <= offset) {
+                // the file became shorter while it was sent: the modification will be detected by the FileWatcher
+                empty_request(http::verb::delete_, api_upload + upload->id);
+                std::lock_guard lg(mutex_chunked_uploads);
+                chunked_uploads.erase(abs_path);
+                save_chunked_uploads();
+                return true;
+            }
+            offset = received;
+        }
+
+        // the list of the chunks of the file, the server takes the ones not sent from its files
+        json j;
+        j["chunks"] = json::array();
+        for (std::size_t i = 0; i < upload->chunks.size(); i++) {
+            j["chunks"].push_back({{"hash", upload->chunks[i].hash},
+                                   {"size", upload->chunks[i].size},
+                                   {"sent", static_cast<bool>(upload->sent[i])}});
+        }
+
+        http::request<http::string_body> req;
+        http::response<http::string_body> res;
+        res.result(http::status::unknown);
+
+        req.method(http::verb::post);
+        req.target(api_commit + upload->id + "?size=" + std::to_string(upload->pack_size));
+        req.set(http::field::content_type, "application/json");
+        if (!previous_digest.empty())
+            req.set(http::field::if_match, "\"" + previous_digest + "\"");
+        req.body() = j.dump();
+        req.prepare_payload();
+
+        perform_request(req, res);
+
+        if (res.result() == http::status::ok)
+            break;
+        if (res.result() == http::status::precondition_failed && res.body().empty() && !previous_digest.empty()) {
+            // the copy on the server is not previous_digest: the server removed the upload without replacing it
+            std::lock_guard lg(mutex_chunked_uploads);
+            chunked_uploads.erase(abs_path);
+            save_chunked_uploads();
+            return false;
+        }
+        if (res.result() == http::status::conflict) {
+            offset = received_bytes(res);
+        } else if (res.result() == http::status::precondition_failed && retries < CHUNKED_UPLOAD_RETRIES) {
+            // the server lost some chunks in the meantime (e.g. the file containing them changed): start again
+            empty_request(http::verb::delete_, api_upload + upload->id);
+            upload.reset();
+            retries++;
+        } else {
+            throw (ExceptionBackup(res.body(), res.result()));
+        }
+    }
+
+    std::lock_guard lg(mutex_chunked_uploads);
+    chunked_uploads.erase(abs_path);
+    save_chunked_uploads();
+    return true;
+}
+
+/**
+ * send a modified file: the server sends the signatures of the blocks of its copy, the client sends only the
+ * differences (delta) and the server builds the new version from them. If the delta can't be used the whole
+ * file is sent with backup_file, the server replaces its copy with a single request. Can throws an ExceptionBackup
+ *
+ * @param abs_path absolute path of the file modified
+ * @param previous_digest digest of the copy on the server to replace, empty to replace any copy
+ * @return false if the copy on the server is not previous_digest (it is not replaced)
+ */
+bool update_file(const std::string& abs_path, const std::string& previous_digest) {
+    // make the relative path
+    std::string relative_path = abs_path.substr(configuration::backup_path.length());
+    // substitute spaces with %20
+    replaceSpaces(relative_path);
+
+    std::error_code size_ec;
+    std::uintmax_t size = fs::file_size(abs_path, size_ec);
+    if(size_ec) {
+        // the file was removed in the meantime, the deletion will be detected by the FileWatcher
+        return true;
+    }
+    if(size < DELTA_MIN_SIZE)
+        return backup_file(abs_path, previous_digest);
+
+    http::response<http::string_body> res = empty_request(http::verb::get, api_signature + relative_path);
+    if(res.result() == http::status::not_found)
+        return backup_file(abs_path, previous_digest);
+    if(res.result() != http::status::ok)
+        throw (ExceptionBackup(res.body(), res.result()));
+
+    Signatures signatures;
+    try {
+        json j = json::parse(res.body());
+        j.at("version").get_to(signatures.version);
+        j.at("size").get_to(signatures.size);
+        j.at("block_size").get_to(signatures.block_size);
+        j.at("weak").get_to(signatures.weak);
+        j.at("strong").get_to(signatures.strong);
+    } catch (json::exception &e) {
+        return backup_file(abs_path, previous_digest);
+    }
+
+    std::optional<Delta> delta = compute_delta(abs_path, signatures,
+                                               std::min<std::uint64_t>(size / 2, DELTA_MAX_LITERAL),
+                                               digest::from_name(configuration::digest).value_or(digest::algorithm_sha256));
+    if(!delta) {
+        // too many differences, the delta is not useful
+        return backup_file(abs_path, previous_digest);
+    }
+
+    http::request<http::string_body> req;
+    res = {};
+    res.result(http::status::unknown);
+
+    req.method(http::verb::post);
+    req.target(api_delta + relative_path + "?base=" + signatures.version + "&digest=" + delta->digest);
+    req.set(http::field::content_type, "application/octet-stream");
+    // the delta replaces only the version of the copy expected, as the whole file would
+    if(!previous_digest.empty())
+        req.set(http::field::if_match, "\"" + previous_digest + "\"");
+    req.body() = std::move(delta->data);
+    if(configuration::compression && req.body().size() >= COMPRESS_MIN_SIZE &&
+       gzip::compressible(req.body().data(), std::min<std::size_t>(req.body().size(), COMPRESS_SAMPLE_SIZE))) {
+        // the new bytes of the delta are compressed if they shrink
+        std::string compressed = gzip::compress(req.body().data(), req.body().size());
+        if(compressed.size() < req.body().size()) {
+            req.set(http::field::content_encoding, GZIP_ENCODING);
+            req.body() = std::move(compressed);
+        }
+    }
+    req.prepare_payload();
+
+    perform_request(req, res);
+
+    if(res.result() == http::status::precondition_failed) {
+        // the copy on the server changed in the meantime (or it is not previous_digest, then backup_file fails too)
+        return backup_file(abs_path, previous_digest);
+    }
+    if(res.result() != http::status::ok)
+        throw (ExceptionBackup(res.body(), res.result()));
+    return true;
 }
 
 /**
@@ -175,6 +817,40 @@ bool probe_folder(const std::string& abs_path) {
     return send_request(http::verb::post, abs_path, probefolder);
 }
 
+/**
+ * send a probe_tree request to the server, can throws an ExceptionBackup
+ *
+ * @param abs_path absolute path of the folder to be checked
+ * @param local_hash hash of the local folder: if the server has the same the children are not sent
+ * @return the hash of the folder on the server with the hashes of its children (empty if the hash is local_hash),
+ * a empty optional if the folder is not found
+ */
+std::optional<TreeNode> probe_tree(const std::string& abs_path, const std::string& local_hash) {
+    // make the relative path
+    std::string relative_path = abs_path.substr(configuration::backup_path.length());
+    // substitute spaces with %20
+    replaceSpaces(relative_path);
+
+    http::response<http::string_body> res = empty_request(http::verb::get,
+                                                          api_probetree + relative_path + "?hash=" + local_hash);
+    if (res.result() == http::status::not_found)
+        return {};
+    if (res.result() != http::status::ok)
+        throw (ExceptionBackup(res.body(), res.result()));
+
+    TreeNode node;
+    try {
+        json j = json::parse(res.body());
+        node.hash = j.at("hash");
+        for (const json &child: j.at("children"))
+            node.children[child.at("name")] = TreeChild{child.at("type") == "folder" ? TREE_FOLDER : TREE_FILE,
+                                                        child.at("hash")};
+    } catch (json::exception &e) {
+        throw (ExceptionBackup("Bad response to probe tree", res.result()));
+    }
+    return node;
+}
+
 /**
  * send a backup_folder request to the server and can throws an ExceptionBackup
  *
@@ -212,28 +888,36 @@ void authenticateToServer(){
     req.method(http::verb::post);
     req.target("/login");
     req.set(http::field::content_type, "application/json");
-    // the body contains a json with username and password
+    // the body contains a json with username, password and the digest algorithms of the client (the preferred first)
+    json digests = json::array({configuration::digest});
+    if (configuration::digest != "sha256")
+        digests.push_back("sha256");
     json j = {
             {"username", configuration::username},
-            {"password", password}
+            {"password", password},
+            {"digests", digests}
     };
     req.body() = j.dump();
     req.content_length(j.dump().length());
 
-    net::io_context ioc;
-    // Launch the asynchronous operation
-    std::make_shared<Session>(ioc, req, res)->run();
-
-    // Run the I/O service. The call will return when the get operation is complete.
-    ioc.run();
+    perform_request(req, res);
 
     if(res.result() == http::status::ok) {
         std::string token = res.body();
 
         // save the token got from the server in the configuration
-        configuration::token = std::move(token);
+        {
+            std::lock_guard<std::mutex> lg(configuration::token_mutex);
+            configuration::token = std::move(token);
+            configuration::token_refresh = token_refresh_time(res);
+        }
+        // the algorithm chosen by the server, a server that doesn't choose it uses SHA256
+        auto algorithm = res[DIGEST_ALGORITHM_HEADER];
+        configuration::digest = algorithm.empty() ? "sha256" : algorithm.to_string();
+        // the bodies are compressed only if the server accepts them
+        configuration::compression = configuration::compression &&
+                                     res[http::field::accept_encoding].find(GZIP_ENCODING) != beast::string_view::npos;
 
-        ioc.stop();
         return;
     }
     else {
@@ -253,16 +937,13 @@ void logout(){
     req.method(http::verb::post);
     req.target("/logout");
 
-    net::io_context ioc;
-    // Launch the asynchronous operation
-    std::make_shared<Session>(ioc, req, res)->run();
-    // Run the I/O service. The call will return when the get operation is complete.
-    ioc.run();
+    perform_request(req, res);
 
     if(res.result() == http::status::ok) {
 
         std::string token;
         // delete the token from the configuration because invalid
+        std::lock_guard<std::mutex> lg(configuration::token_mutex);
         configuration::token = std::move(token);
 
         return ;
@@ -6,16 +6,28 @@
 #define CLIENT_CLIENT_H
 
 #include <boost/beast/http.hpp>
+#include <optional>
+
+#include "backup.h"
 
 namespace http = boost::beast::http;       // from <boost/beast/http.hpp>
 
+// a folder on the server with the hashes of its direct children (by name)
+struct TreeNode {
+    std::string hash;
+    std::map<std::string, TreeChild> children;
+};
+
 
 bool probe_file(const std::string& original_path);
-void backup_file(const std::string& original_path);
+bool backup_file(const std::string& original_path, const std::string& previous_digest = "");
+bool update_file(const std::string& original_path, const std::string& previous_digest = "");
 bool probe_folder(const std::string& original_path);
+std::optional<TreeNode> probe_tree(const std::string& original_path, const std::string& local_hash);
 void backup_folder(const std::string& original_path);
 void delete_path(const std::string& original_path);
 void authenticateToServer();
+void load_chunked_uploads();
 void logout();
 
 
@@ -18,6 +18,14 @@ namespace configuration
     std::string backup_path;
     std::string username;
     std::string token;
+    std::chrono::steady_clock::time_point token_refresh = std::chrono::steady_clock::time_point::max();
+    std::mutex token_mutex;
+    std::string hash_index;
+    std::string watch_mode;
+    std::string digest;
+    bool compression;
+    int delay;
+    int max_inflight;
 }
 
 
@@ -45,6 +53,18 @@ bool configuration::load_config_file(const std::string &config_file)
             ("port", "host port")
             ("backup_path", "path where you want the backup done")
             ("username", "username for authentication to the server")
+            ("hash_index", po::value<std::string>()->default_value(home_dir + "/.backup_index"),
+                    "file where the digests of the files are saved")
+            ("watch_mode", po::value<std::string>()->default_value("inotify"),
+                    "how the changes are detected: inotify or polling")
+            ("digest", po::value<std::string>()->default_value("sha256"),
+                    "algorithm of the digests of the files: sha256 or blake3 (if the server supports it)")
+            ("compression", po::value<bool>()->default_value(true),
+                    "compress the files sent when the server accepts it (true or false)")
+            ("delay", po::value<int>()->default_value(5000),
+                    "milliseconds between two checks of the backup path in polling mode")
+            ("max_inflight", po::value<int>()->default_value(8),
+                    "max number of requests for the changes sent to the server at the same time")
             ;
 
     po::variables_map vm;
@@ -57,6 +77,17 @@ bool configuration::load_config_file(const std::string &config_file)
         configuration::backup_path = vm["backup_path"].as<std::string>();
         configuration::username = vm["username"].as<std::string>();
         configuration::token = "";
+        configuration::hash_index = vm["hash_index"].as<std::string>();
+        configuration::watch_mode = vm["watch_mode"].as<std::string>();
+        configuration::digest = vm["digest"].as<std::string>();
+        configuration::compression = vm["compression"].as<bool>();
+        configuration::delay = vm["delay"].as<int>();
+        configuration::max_inflight = vm["max_inflight"].as<int>();
+
+        if((configuration::watch_mode != "inotify" && configuration::watch_mode != "polling") ||
+           (configuration::digest != "sha256" && configuration::digest != "blake3") ||
+           configuration::max_inflight < 1)
+            throw boost::bad_any_cast();
 
         char end_slash = 47; // "/"
         if(configuration::backup_path.back() != end_slash) {
@@ -6,6 +6,8 @@
 #define CLIENT_CONFIGURATION_H
 
 
+#include <chrono>
+#include <mutex>
 #include <string>
 
 
@@ -16,6 +18,16 @@ namespace configuration
     extern std::string backup_path;
     extern std::string username;
     extern std::string token;
+    // when the token must be refreshed; the token is refreshed while the requests are sent, token and
+    // token_refresh are used with token_mutex
+    extern std::chrono::steady_clock::time_point token_refresh;
+    extern std::mutex token_mutex;
+    extern std::string hash_index;
+    extern std::string watch_mode;
+    extern std::string digest;
+    extern bool compression;
+    extern int delay;
+    extern int max_inflight;
 
     bool load_config_file(const std::string &config_file);
 }
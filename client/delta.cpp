@@ -0,0 +1,181 @@
+//
+// Created by giacomo on 17/09/20.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#include "delta.h"
+#include "sha256.h"
+
+// the file is read in blocks of this size (at least 4 times the size of the blocks of the signatures)
+#define DELTA_BUF_SIZE (4 * 1024 * 1024)
+
+/**
+ * @param data the block
+ * @param n size of the block
+ * @return the first 16 bytes of the SHA256 of the block, in hexadecimal format
+ */
+static std::string strong_checksum(const unsigned char *data, std::size_t n) {
+    return sha256::digest(data, n).substr(0, 32);
+}
+
+/**
+ * append a number to the delta (8 bytes, little endian)
+ *
+ * @param data the delta
+ * @param value the number
+ */
+static void write_u64(std::string &data, std::uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        data.push_back(static_cast<char>(value & 0xff));
+        value >>= 8;
+    }
+}
+
+/**
+ * compute the delta of a file against the signatures of the copy on the server (as in rsync): a window of the
+ * size of a block slides on the file and its rolling checksum is searched between the ones of the blocks,
+ * when also the strong checksum matches the block is copied from the copy on the server, otherwise the
+ * bytes are sent
+ *
+ * @param path of the file
+ * @param signatures of the copy on the server
+ * @param max_literal the delta is not useful if more bytes than these must be sent
+ * @param algorithm of the digest of the file
+ * @return the delta, a empty optional if the new bytes are more than max_literal or the file can't be read
+ */
+std::optional<Delta> compute_delta(const std::string &path, const Signatures &signatures, std::uint64_t max_literal,
+                                   digest::Algorithm algorithm) {
+    const std::size_t block_size = signatures.block_size;
+    if (block_size == 0 || signatures.weak.size() != signatures.strong.size())
+        return {};
+
+    // the blocks by rolling checksum, the last block is used only if complete
+    std::unordered_map<std::uint32_t, std::vector<std::size_t>> blocks;
+    for (std::size_t i = 0; i < signatures.weak.size(); i++) {
+        if ((i + 1) * block_size <= signatures.size)
+            blocks[signatures.weak[i]].push_back(i);
+    }
+
+    FILE *fin;
+    if ((fin = fopen(path.c_str(), "rb")) == nullptr)
+        return {};
+
+    std::size_t capacity = std::max<std::size_t>(DELTA_BUF_SIZE, 4 * block_size);
+    std::unique_ptr<unsigned char[]> buf{new unsigned char[capacity]};
+    // the window is [start, start + block_size), the bytes from literal to start are not in a block of the server
+    std::size_t start = 0, end = 0, literal = 0;
+    bool eof = false;
+
+    digest::Hasher hasher{algorithm};
+
+    Delta delta;
+    std::uint64_t literal_total = 0;
+    // the last copy is kept until the next operation, so consecutive blocks are copied with one operation
+    std::uint64_t copy_offset = 0, copy_size = 0;
+
+    auto flush_copy = [&]() {
+        if (copy_size == 0)
+            return;
+        delta.data.push_back(DELTA_OP_COPY);
+        write_u64(delta.data, copy_offset);
+        write_u64(delta.data, copy_size);
+        copy_size = 0;
+    };
+    auto flush_literal = [&]() {
+        if (start > literal) {
+            flush_copy();
+            delta.data.push_back(DELTA_OP_LITERAL);
+            write_u64(delta.data, start - literal);
+            delta.data.append(reinterpret_cast<char *>(buf.get() + literal), start - literal);
+            hasher.update(buf.get() + literal, start - literal);
+            literal_total += start - literal;
+        }
+        literal = start;
+    };
+
+    std::uint32_t a = 0, b = 0;
+    bool have_checksum = false;
+
+    while (true) {
+        // keep in the buffer the window and the next byte
+        if (!eof && end - start <= block_size) {
+            flush_literal();
+            std::memmove(buf.get(), buf.get() + start, end - start);
+            end -= start;
+            start = literal = 0;
+
+            std::size_t n = fread(buf.get() + end, 1, capacity - end, fin);
+            end += n;
+            if (n == 0)
+                eof = true;
+            continue;
+        }
+        if (end - start < block_size)
+            break;
+
+        if (!have_checksum) {
+            a = b = 0;
+            for (std::size_t i = 0; i < block_size; i++) {
+                a += buf[start + i];
+                b += (block_size - i) * buf[start + i];
+            }
+            have_checksum = true;
+        }
+
+        auto it = blocks.find((a & 0xffff) | ((b & 0xffff) << 16));
+        if (it != blocks.end()) {
+            std::string strong = strong_checksum(buf.get() + start, block_size);
+            auto match = std::find_if(it->second.begin(), it->second.end(),
+                                      [&](std::size_t i) { return signatures.strong[i] == strong; });
+            if (match != it->second.end()) {
+                flush_literal();
+                hasher.update(buf.get() + start, block_size);
+
+                std::uint64_t offset = *match * block_size;
+                if (copy_size > 0 && copy_offset + copy_size == offset) {
+                    copy_size += block_size;
+                } else {
+                    flush_copy();
+                    copy_offset = offset;
+                    copy_size = block_size;
+                }
+
+                start += block_size;
+                literal = start;
+                have_checksum = false;
+                continue;
+            }
+        }
+
+        if (start + block_size == end)
+            break;
+
+        // slide the window of a byte
+        unsigned char out = buf[start], in = buf[start + block_size];
+        a = a - out + in;
+        b = b - block_size * out + a;
+        start++;
+
+        if (literal_total + (start - literal) > max_literal) {
+            fclose(fin);
+            return {};
+        }
+    }
+    fclose(fin);
+
+    // the last bytes are not in a block
+    start = end;
+    flush_literal();
+    flush_copy();
+    if (literal_total > max_literal)
+        return {};
+
+    delta.digest = hasher.final();
+
+    return delta;
+}
@@ -0,0 +1,40 @@
+//
+// Created by giacomo on 17/09/20.
+//
+
+#ifndef CLIENT_DELTA_H
+#define CLIENT_DELTA_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "digest.h"
+
+// operations of a delta: copy a range of the old file, or take the next bytes (literal) of the delta
+#define DELTA_OP_COPY 'C'
+#define DELTA_OP_LITERAL 'L'
+
+// signatures of the blocks of the copy of a file on the server
+struct Signatures {
+    std::string version;            // the delta can be applied only to this version of the file
+    std::uint64_t size;
+    std::uint64_t block_size;
+    std::vector<std::uint32_t> weak;  // rolling checksum of each block
+    std::vector<std::string> strong;  // SHA256 (first 16 bytes) of each block
+};
+
+// differences between a file and the copy on the server
+struct Delta {
+    std::string data;   // sequence of operations to build the file from the copy on the server
+    std::string digest; // digest of the file, with the algorithm of compute_delta
+};
+
+// compute the delta of a file, a empty optional if the new bytes are more than max_literal
+// or the file can't be read
+std::optional<Delta> compute_delta(const std::string &path, const Signatures &signatures, std::uint64_t max_literal,
+                                   digest::Algorithm algorithm = digest::algorithm_sha256);
+
+
+#endif //CLIENT_DELTA_H
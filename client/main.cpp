@@ -1,16 +1,37 @@
 #include <iostream>
 #include <csignal>
+#include <thread>
+#include <pthread.h>
 
 #include "configuration.h"
 #include "client.h"
 #include "FileWatcher.h"
 #include "ExceptionBackup.h"
+#include "ConnectionPool.h"
+#include "HashIndex.h"
+
+/**
+ * wait for SIGINT or SIGTERM and exit after saving the state: the signals are blocked in all the threads and only
+ * this thread receives them, so the shutdown never interrupts a thread that holds a lock it needs (e.g. of the
+ * HashIndex) and it can wait for the logout
+ *
+ * @param signals SIGINT and SIGTERM
+ */
+void waitSignals(sigset_t signals) {
+    int signum;
+    if (sigwait(&signals, &signum) != 0)
+        return;
 
-void signalHandler( int signum ) {
     std::stringstream ss;
     ss << "Exit after signal with code " << signum << std::endl;
+    // statistics of the connections to the server
+    ConnectionPool *pool = ConnectionPool::getInstance();
+    ss << "Connection pool: " << pool->hits() << " hits, " << pool->misses() << " misses" << std::endl;
     std::cout << ss.str();
 
+    // keep the digests computed until now for the next start
+    HashIndex::getInstance()->save();
+
     // if the client was authenticated, send logout request to server before exit
     try{
         if (!configuration::token.empty())
@@ -24,9 +45,14 @@ void signalHandler( int signum ) {
 
 int main() {
 
-    // set handler for signals SIGINT and SIGTERM in order to manage them correctly
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    // SIGINT and SIGTERM are blocked before any thread is created, so every thread inherits the mask, and they are
+    // received by a thread of their own in order to manage them correctly
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread(waitSignals, signals).detach();
 
     try {
         // load the config file
@@ -40,11 +66,20 @@ int main() {
             return EXIT_FAILURE;
         }
 
+        // digests of the files computed in the previous executions
+        HashIndex::getInstance()->load(configuration::hash_index);
+        // chunked uploads interrupted in the previous executions, they are resumed when the files are sent again
+        load_chunked_uploads();
+
         // login to server
         authenticateToServer();
+        // the digests saved with another algorithm than the one chosen at the login are no more valid
+        HashIndex::getInstance()->set_algorithm(configuration::digest);
 
         // FileWatcher refer to a path with a time interval at which we check for changes
-        FileWatcher fw{configuration::backup_path, std::chrono::seconds (5)};
+        FileWatcher fw{configuration::backup_path, std::chrono::milliseconds(configuration::delay),
+                       configuration::watch_mode == "polling" ? watch_polling : watch_inotify,
+                       static_cast<unsigned int>(configuration::max_inflight)};
 
         // start a continuous check
         fw.start();
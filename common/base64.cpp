@@ -0,0 +1,439 @@
+#include <cstdint>
+
+#include "base64.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BASE64_NEON
+#endif
+
+namespace base64 {
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @return table of the value of each character, -1 for the characters not in the alphabet
+ */
+static const signed char *inverse() {
+    static const auto table = []() {
+        struct { signed char values[256]; } t{};
+        for (signed char &v: t.values)
+            v = -1;
+        for (int i = 0; i < 64; i++)
+            t.values[static_cast<unsigned char>(alphabet[i])] = static_cast<signed char>(i);
+        return t;
+    }();
+    return table.values;
+}
+
+// the SIMD functions encode/decode whole blocks from the start of the input and advance the pointers,
+// the scalar code completes the rest
+using EncodeBlocks = void (*)(const unsigned char *&in, std::size_t &len, char *&out);
+using DecodeBlocks = void (*)(const char *&in, std::size_t &len, unsigned char *&out);
+
+struct Implementation {
+    const char *name;
+    EncodeBlocks encode;
+    DecodeBlocks decode;
+    bool (*supported)();
+};
+
+/**
+ * encode the bytes left (the final group is padded)
+ */
+static std::size_t encode_scalar(const unsigned char *in, std::size_t len, char *out) {
+    char *start = out;
+    for (std::size_t n = len / 3; n--;) {
+        *out++ = alphabet[in[0] >> 2];
+        *out++ = alphabet[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+        *out++ = alphabet[((in[1] & 0x0f) << 2) | (in[2] >> 6)];
+        *out++ = alphabet[in[2] & 0x3f];
+        in += 3;
+    }
+
+    switch (len % 3) {
+        case 2:
+            *out++ = alphabet[in[0] >> 2];
+            *out++ = alphabet[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+            *out++ = alphabet[(in[1] & 0x0f) << 2];
+            *out++ = '=';
+            break;
+        case 1:
+            *out++ = alphabet[in[0] >> 2];
+            *out++ = alphabet[(in[0] & 0x03) << 4];
+            *out++ = '=';
+            *out++ = '=';
+            break;
+        default:
+            break;
+    }
+    return out - start;
+}
+
+/**
+ * decode the characters left: 4 at a time while they are valid, then one at a time until the padding or
+ * the first invalid character
+ *
+ * @return number of bytes written and number of characters read
+ */
+static std::pair<std::size_t, std::size_t> decode_scalar(const char *src, std::size_t len, unsigned char *out) {
+    const signed char *table = inverse();
+    const auto *in = reinterpret_cast<const unsigned char *>(src);
+    unsigned char *start = out;
+    std::size_t i = 0;
+
+    for (; len - i >= 4; i += 4) {
+        int a = table[in[i]], b = table[in[i + 1]], c = table[in[i + 2]], d = table[in[i + 3]];
+        if ((a | b | c | d) < 0)
+            break;
+        *out++ = static_cast<unsigned char>((a << 2) | (b >> 4));
+        *out++ = static_cast<unsigned char>((b << 4) | (c >> 2));
+        *out++ = static_cast<unsigned char>((c << 6) | d);
+    }
+
+    // the last group, partial or with padding
+    int group[4] = {0, 0, 0, 0};
+    int n = 0;
+    for (; i < len; i++) {
+        int v = table[in[i]];
+        if (v < 0)
+            break;
+        group[n++] = v;
+        if (n == 4) {
+            *out++ = static_cast<unsigned char>((group[0] << 2) | (group[1] >> 4));
+            *out++ = static_cast<unsigned char>((group[1] << 4) | (group[2] >> 2));
+            *out++ = static_cast<unsigned char>((group[2] << 6) | group[3]);
+            n = 0;
+        }
+    }
+    if (n > 1)
+        *out++ = static_cast<unsigned char>((group[0] << 2) | (group[1] >> 4));
+    if (n > 2)
+        *out++ = static_cast<unsigned char>((group[1] << 4) | (group[2] >> 2));
+
+    return {static_cast<std::size_t>(out - start), i};
+}
+
+static void encode_none(const unsigned char *&, std::size_t &, char *&) {}
+static void decode_none(const char *&, std::size_t &, unsigned char *&) {}
+static bool always() { return true; }
+
+#ifdef BASE64_X86
+
+// x86-64: blocks of 12 bytes (16 characters) with SSSE3, 24 bytes (32 characters) with AVX2.
+// Encode: the 3 bytes of each group are spread in 4 bytes of 6 bits with shuffle and multiplications,
+// then the 6 bits values are turned into characters adding an offset that depends on their range.
+// Decode: the two nibbles of each character select two masks whose AND is not zero for the invalid characters,
+// the high nibble selects the offset from the character to its value, then the values are packed with
+// multiply-add and shuffle
+
+__attribute__((target("ssse3")))
+static __m128i encode_values_ssse3(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i values = _mm_or_si128(t1, t3);
+
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12: index of the offset to add
+    __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+    range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                          '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), values);
+}
+
+__attribute__((target("ssse3")))
+static void encode_ssse3(const unsigned char *&in, std::size_t &len, char *&out) {
+    // 16 bytes are loaded, 12 are used
+    while (len >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), encode_values_ssse3(block));
+        in += 12;
+        len -= 12;
+        out += 16;
+    }
+}
+
+__attribute__((target("ssse3")))
+static void decode_ssse3(const char *&in, std::size_t &len, unsigned char *&out) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+    // 16 bytes are stored, 12 are used: the input left must be enough to not write after the output
+    while (len >= 24) {
+        __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        // invalid characters (or padding): the scalar code finds where to stop
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+            break;
+
+        __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+        str = _mm_add_epi8(str, roll);
+
+        __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), packed);
+
+        in += 16;
+        len -= 16;
+        out += 12;
+    }
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2(const unsigned char *&in, std::size_t &len, char *&out) {
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0);
+
+    // each lane encodes 12 bytes: the second lane is loaded from the 12th byte (16 bytes after it are read)
+    while (len >= 28) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 12));
+        __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+        block = _mm256_shuffle_epi8(block, shuffle);
+        __m256i t0 = _mm256_and_si256(block, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(block, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i values = _mm256_or_si256(t1, t3);
+
+        __m256i range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values);
+        range = _mm256_or_si256(range, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        __m256i chars = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), values);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), chars);
+
+        in += 24;
+        len -= 24;
+        out += 32;
+    }
+}
+
+__attribute__((target("avx2")))
+static void decode_avx2(const char *&in, std::size_t &len, unsigned char *&out) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+
+    // 32 bytes are stored, 24 are used: the input left must be enough to not write after the output
+    while (len >= 48) {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+
+        __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        // the 12 bytes of each lane together
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), packed);
+
+        in += 32;
+        len -= 32;
+        out += 24;
+    }
+}
+
+static bool has_ssse3() { return __builtin_cpu_supports("ssse3"); }
+static bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+#endif
+
+#ifdef BASE64_NEON
+
+// ARM64: blocks of 48 bytes (64 characters), the interleaved load/store split the groups of 3 bytes and
+// of 4 characters in separate registers, and the table lookups cover 64 entries
+
+static void encode_neon(const unsigned char *&in, std::size_t &len, char *&out) {
+    const auto *table_bytes = reinterpret_cast<const std::uint8_t *>(alphabet);
+    uint8x16x4_t table = {vld1q_u8(table_bytes), vld1q_u8(table_bytes + 16),
+                          vld1q_u8(table_bytes + 32), vld1q_u8(table_bytes + 48)};
+    const uint8x16_t mask = vdupq_n_u8(0x3f);
+
+    while (len >= 48) {
+        uint8x16x3_t bytes = vld3q_u8(in);
+        uint8x16x4_t chars;
+        chars.val[0] = vshrq_n_u8(bytes.val[0], 2);
+        chars.val[1] = vandq_u8(vorrq_u8(vshrq_n_u8(bytes.val[1], 4), vshlq_n_u8(bytes.val[0], 4)), mask);
+        chars.val[2] = vandq_u8(vorrq_u8(vshrq_n_u8(bytes.val[2], 6), vshlq_n_u8(bytes.val[1], 2)), mask);
+        chars.val[3] = vandq_u8(bytes.val[2], mask);
+        for (uint8x16_t &c: chars.val)
+            c = vqtbl4q_u8(table, c);
+        vst4q_u8(reinterpret_cast<std::uint8_t *>(out), chars);
+
+        in += 48;
+        len -= 48;
+        out += 64;
+    }
+}
+
+static void decode_neon(const char *&in, std::size_t &len, unsigned char *&out) {
+    // value + 1 of the characters 0..63 and 64..127, 0 for the invalid ones (also the result of a lookup
+    // out of the table)
+    static const auto tables = []() {
+        struct { std::uint8_t values[128]; } t{};
+        const signed char *table = inverse();
+        for (int i = 0; i < 128; i++)
+            t.values[i] = static_cast<std::uint8_t>(table[i] + 1);
+        return t;
+    }();
+    uint8x16x4_t low = {vld1q_u8(tables.values), vld1q_u8(tables.values + 16),
+                        vld1q_u8(tables.values + 32), vld1q_u8(tables.values + 48)};
+    uint8x16x4_t high = {vld1q_u8(tables.values + 64), vld1q_u8(tables.values + 80),
+                         vld1q_u8(tables.values + 96), vld1q_u8(tables.values + 112)};
+    const uint8x16_t one = vdupq_n_u8(1);
+    const uint8x16_t offset = vdupq_n_u8(64);
+
+    while (len >= 64) {
+        uint8x16x4_t chars = vld4q_u8(reinterpret_cast<const std::uint8_t *>(in));
+        uint8x16_t valid = vdupq_n_u8(0xff);
+        for (uint8x16_t &c: chars.val) {
+            c = vorrq_u8(vqtbl4q_u8(low, c), vqtbl4q_u8(high, vsubq_u8(c, offset)));
+            valid = vminq_u8(valid, c);
+            c = vsubq_u8(c, one);
+        }
+        if (vminvq_u8(valid) == 0)
+            break;
+
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(chars.val[0], 2), vshrq_n_u8(chars.val[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(chars.val[1], 4), vshrq_n_u8(chars.val[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(chars.val[2], 6), chars.val[3]);
+        vst3q_u8(out, bytes);
+
+        in += 64;
+        len -= 64;
+        out += 48;
+    }
+}
+
+#endif
+
+// the implementations from the fastest, the first supported is used
+static const Implementation implementations_list[] = {
+#ifdef BASE64_X86
+        {"avx2", encode_avx2, decode_avx2, has_avx2},
+        {"ssse3", encode_ssse3, decode_ssse3, has_ssse3},
+#endif
+#ifdef BASE64_NEON
+        {"neon", encode_neon, decode_neon, always},
+#endif
+        {"scalar", encode_none, decode_none, always}
+};
+
+static const Implementation *selected = nullptr;
+
+/**
+ * @return the implementation in use, the fastest supported by the CPU unless another was chosen
+ */
+static const Implementation *current() {
+    static const Implementation *best = []() {
+        for (const Implementation &impl: implementations_list) {
+            if (impl.supported())
+                return &impl;
+        }
+        return &implementations_list[0];
+    }();
+    return selected ? selected : best;
+}
+
+/**
+ * encode a series of bytes as a padded base64 string (not null terminated)
+ *
+ * @param dest where the characters are written, at least encoded_size(len) bytes
+ * @param src bytes to encode
+ * @param len number of bytes
+ * @return number of characters written
+ */
+std::size_t encode(void *dest, const void *src, std::size_t len) {
+    const auto *in = static_cast<const unsigned char *>(src);
+    char *out = static_cast<char *>(dest);
+
+    current()->encode(in, len, out);
+    out += encode_scalar(in, len, out);
+    return out - static_cast<char *>(dest);
+}
+
+/**
+ * decode a padded base64 string
+ *
+ * @param dest where the bytes are written, at least decoded_size(len) bytes
+ * @param src characters to decode
+ * @param len number of characters
+ * @return number of bytes written and number of characters read (until the padding or the first invalid character)
+ */
+std::pair<std::size_t, std::size_t> decode(void *dest, const char *src, std::size_t len) {
+    const char *in = src;
+    auto *out = static_cast<unsigned char *>(dest);
+
+    current()->decode(in, len, out);
+    std::pair<std::size_t, std::size_t> rest = decode_scalar(in, len, out);
+    return {out - static_cast<unsigned char *>(dest) + rest.first, in - src + rest.second};
+}
+
+const char *implementation() {
+    return current()->name;
+}
+
+std::vector<std::string> implementations() {
+    std::vector<std::string> names;
+    for (const Implementation &impl: implementations_list) {
+        if (impl.supported())
+            names.emplace_back(impl.name);
+    }
+    return names;
+}
+
+bool use_implementation(const std::string &name) {
+    for (const Implementation &impl: implementations_list) {
+        if (impl.name == name && impl.supported()) {
+            selected = &impl;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
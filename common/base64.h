@@ -0,0 +1,42 @@
+#ifndef COMMON_BASE64_H
+#define COMMON_BASE64_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Base64 (standard alphabet, padded) used by client and server. The blocks of the input are encoded/decoded
+// with SIMD instructions (AVX2 or SSSE3 on x86-64, NEON on ARM64) when the CPU supports them, chosen at runtime;
+// the rest of the input (and the whole input on the other CPUs) with a scalar implementation.
+// The interface and the results are the ones of boost::beast::detail::base64
+namespace base64 {
+
+    // number of characters needed to encode n bytes (with padding)
+    inline std::size_t encoded_size(std::size_t n) {
+        return 4 * ((n + 2) / 3);
+    }
+
+    // max number of bytes decoded from n characters
+    inline std::size_t decoded_size(std::size_t n) {
+        return n / 4 * 3;
+    }
+
+    // encode len bytes of src in dest (at least encoded_size(len) bytes), return the number of characters written
+    std::size_t encode(void *dest, const void *src, std::size_t len);
+
+    // decode up to len characters of src in dest (at least decoded_size(len) bytes), stopping at the padding or at
+    // the first invalid character: return the number of bytes written and the number of characters read
+    std::pair<std::size_t, std::size_t> decode(void *dest, const char *src, std::size_t len);
+
+    // name of the implementation in use: "avx2", "ssse3", "neon" or "scalar"
+    const char *implementation();
+
+    // the implementations supported by this CPU, the first is the fastest
+    std::vector<std::string> implementations();
+
+    // use an implementation supported by this CPU (for benchmarks), not to be called while encoding/decoding
+    bool use_implementation(const std::string &name);
+}
+
+#endif //COMMON_BASE64_H
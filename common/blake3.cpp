@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "blake3.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define CHUNK_LEN 1024
+#define BLOCK_LEN 64
+
+// domain flags of a compression
+#define CHUNK_START 1
+#define CHUNK_END 2
+#define PARENT 4
+#define ROOT 8
+
+// a file is read in segments of this size (a power of 2 of chunks)
+#define SEGMENT_SIZE (16 * 1024 * 1024)
+
+// subtrees smaller than this are hashed by the thread that reaches them, a new thread would cost more
+#define PARALLEL_MIN_SIZE (512 * 1024)
+
+namespace blake3 {
+
+static const std::uint32_t IV[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static const unsigned int MSG_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+static inline std::uint32_t rotr(std::uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline void g(std::uint32_t s[16], int a, int b, int c, int d, std::uint32_t mx, std::uint32_t my) {
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 7);
+}
+
+/**
+ * compress a block
+ *
+ * @param cv input chaining value
+ * @param block 64 bytes (zero padded)
+ * @param counter index of the chunk (0 for the parents)
+ * @param block_len number of bytes of the block used
+ * @param flags domain flags
+ * @param out the first 8 words of the output, the new chaining value
+ */
+static void compress(const std::uint32_t cv[8], const unsigned char block[BLOCK_LEN], std::uint64_t counter,
+                     std::uint32_t block_len, std::uint32_t flags, std::uint32_t out[8]) {
+    std::uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        const unsigned char *p = block + 4 * i;
+        m[i] = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    std::uint32_t s[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                           IV[0], IV[1], IV[2], IV[3],
+                           static_cast<std::uint32_t>(counter), static_cast<std::uint32_t>(counter >> 32),
+                           block_len, flags};
+    for (int round = 0; round < 7; round++) {
+        g(s, 0, 4, 8, 12, m[0], m[1]);
+        g(s, 1, 5, 9, 13, m[2], m[3]);
+        g(s, 2, 6, 10, 14, m[4], m[5]);
+        g(s, 3, 7, 11, 15, m[6], m[7]);
+        g(s, 0, 5, 10, 15, m[8], m[9]);
+        g(s, 1, 6, 11, 12, m[10], m[11]);
+        g(s, 2, 7, 8, 13, m[12], m[13]);
+        g(s, 3, 4, 9, 14, m[14], m[15]);
+
+        std::uint32_t permuted[16];
+        for (int i = 0; i < 16; i++)
+            permuted[i] = m[MSG_PERMUTATION[i]];
+        std::memcpy(m, permuted, sizeof(m));
+    }
+
+    for (int i = 0; i < 8; i++)
+        out[i] = s[i] ^ s[i + 8];
+}
+
+// the last compression of a node: done without ROOT for a chaining value, with ROOT for the digest
+struct Output {
+    std::uint32_t cv[8];
+    unsigned char block[BLOCK_LEN];
+    std::uint64_t counter;
+    std::uint32_t block_len;
+    std::uint32_t flags;
+
+    void chaining_value(std::uint32_t out[8]) const {
+        compress(cv, block, counter, block_len, flags, out);
+    }
+
+    std::string root() const {
+        std::uint32_t words[8];
+        compress(cv, block, 0, block_len, flags | ROOT, words);
+
+        static const char digits[] = "0123456789abcdef";
+        std::string hex(64, 0);
+        for (int i = 0; i < 32; i++) {
+            unsigned char byte = words[i / 4] >> (8 * (i % 4));
+            hex[2 * i] = digits[byte >> 4];
+            hex[2 * i + 1] = digits[byte & 0x0f];
+        }
+        return hex;
+    }
+};
+
+/**
+ * @return the output of a parent node with the chaining values of its children
+ */
+static Output parent_output(const std::uint32_t left[8], const std::uint32_t right[8]) {
+    Output output{};
+    std::memcpy(output.cv, IV, sizeof(IV));
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) {
+            output.block[4 * i + j] = left[i] >> (8 * j);
+            output.block[32 + 4 * i + j] = right[i] >> (8 * j);
+        }
+    }
+    output.block_len = BLOCK_LEN;
+    output.flags = PARENT;
+    return output;
+}
+
+Hasher::ChunkState::ChunkState(std::uint64_t counter) : counter{counter}, block{}, block_len{0},
+                                                        blocks_compressed{0} {
+    std::memcpy(cv, IV, sizeof(IV));
+}
+
+std::size_t Hasher::ChunkState::len() const {
+    return BLOCK_LEN * blocks_compressed + block_len;
+}
+
+void Hasher::ChunkState::update(const unsigned char *data, std::size_t len) {
+    while (len > 0) {
+        // the block is compressed only when there are more bytes: the last one is compressed with CHUNK_END
+        if (block_len == BLOCK_LEN) {
+            compress(cv, block, counter, BLOCK_LEN, blocks_compressed == 0 ? CHUNK_START : 0, cv);
+            blocks_compressed++;
+            std::memset(block, 0, sizeof(block));
+            block_len = 0;
+        }
+        std::size_t take = std::min(BLOCK_LEN - block_len, len);
+        std::memcpy(block + block_len, data, take);
+        block_len += take;
+        data += take;
+        len -= take;
+    }
+}
+
+/**
+ * @return the output of the last block of a chunk
+ */
+static Output chunk_output(const Hasher::ChunkState &chunk) {
+    Output output{};
+    std::memcpy(output.cv, chunk.cv, sizeof(output.cv));
+    std::memcpy(output.block, chunk.block, sizeof(output.block));
+    output.counter = chunk.counter;
+    output.block_len = chunk.block_len;
+    output.flags = (chunk.blocks_compressed == 0 ? CHUNK_START : 0) | CHUNK_END;
+    return output;
+}
+
+Hasher::Hasher() : chunk_{0} {}
+
+void Hasher::update(const void *data, std::size_t len) {
+    const auto *in = static_cast<const unsigned char *>(data);
+    while (len > 0) {
+        // the chunk is complete and there are more bytes: its chaining value is merged with the complete subtrees
+        if (chunk_.len() == CHUNK_LEN) {
+            std::uint32_t cv[8];
+            chunk_output(chunk_).chaining_value(cv);
+            std::uint64_t total_chunks = chunk_.counter + 1;
+            while ((total_chunks & 1) == 0) {
+                stack_len_--;
+                parent_output(stack_[stack_len_], cv).chaining_value(cv);
+                total_chunks >>= 1;
+            }
+            std::memcpy(stack_[stack_len_++], cv, sizeof(cv));
+            chunk_ = ChunkState(chunk_.counter + 1);
+        }
+        std::size_t take = std::min(CHUNK_LEN - chunk_.len(), len);
+        chunk_.update(in, take);
+        in += take;
+        len -= take;
+    }
+}
+
+std::string Hasher::final() const {
+    Output output = chunk_output(chunk_);
+    for (std::size_t i = stack_len_; i > 0; i--) {
+        std::uint32_t cv[8];
+        output.chaining_value(cv);
+        output = parent_output(stack_[i - 1], cv);
+    }
+    return output.root();
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define ROTR16(x) _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, \
+                                                          2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13))
+#define ROTR8(x) _mm256_shuffle_epi8(x, _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12, \
+                                                         1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12))
+#define ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define ADD(a, b) _mm256_add_epi32(a, b)
+
+__attribute__((target("avx2")))
+static inline void g8(__m256i v[16], int a, int b, int c, int d, __m256i mx, __m256i my) {
+    v[a] = ADD(ADD(v[a], v[b]), mx);
+    v[d] = ROTR16(_mm256_xor_si256(v[d], v[a]));
+    v[c] = ADD(v[c], v[d]);
+    v[b] = ROTR(_mm256_xor_si256(v[b], v[c]), 12);
+    v[a] = ADD(ADD(v[a], v[b]), my);
+    v[d] = ROTR8(_mm256_xor_si256(v[d], v[a]));
+    v[c] = ADD(v[c], v[d]);
+    v[b] = ROTR(_mm256_xor_si256(v[b], v[c]), 7);
+}
+
+/**
+ * hash 8 consecutive full chunks at the same time, one in each 32 bits lane of the AVX2 registers
+ *
+ * @param data the 8 chunks
+ * @param counter index of the first chunk
+ * @param cvs the chaining value of each chunk
+ */
+__attribute__((target("avx2")))
+static void hash8_avx2(const unsigned char *data, std::uint64_t counter, std::uint32_t cvs[8][8]) {
+    __m256i cv[8];
+    for (int i = 0; i < 8; i++)
+        cv[i] = _mm256_set1_epi32(static_cast<int>(IV[i]));
+
+    // the word i of a block of each chunk
+    const __m256i chunk_offsets = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+    alignas(32) std::uint32_t counters_lo[8], counters_hi[8];
+    for (int l = 0; l < 8; l++) {
+        counters_lo[l] = static_cast<std::uint32_t>(counter + l);
+        counters_hi[l] = static_cast<std::uint32_t>((counter + l) >> 32);
+    }
+    const __m256i counter_lo = _mm256_load_si256(reinterpret_cast<const __m256i *>(counters_lo));
+    const __m256i counter_hi = _mm256_load_si256(reinterpret_cast<const __m256i *>(counters_hi));
+
+    for (int b = 0; b < CHUNK_LEN / BLOCK_LEN; b++) {
+        __m256i m[16];
+        for (int i = 0; i < 16; i++)
+            m[i] = _mm256_i32gather_epi32(reinterpret_cast<const int *>(data + BLOCK_LEN * b + 4 * i),
+                                          chunk_offsets, 4);
+
+        int flags = (b == 0 ? CHUNK_START : 0) | (b == CHUNK_LEN / BLOCK_LEN - 1 ? CHUNK_END : 0);
+        __m256i v[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                         _mm256_set1_epi32(static_cast<int>(IV[0])), _mm256_set1_epi32(static_cast<int>(IV[1])),
+                         _mm256_set1_epi32(static_cast<int>(IV[2])), _mm256_set1_epi32(static_cast<int>(IV[3])),
+                         counter_lo, counter_hi, _mm256_set1_epi32(BLOCK_LEN), _mm256_set1_epi32(flags)};
+        for (int round = 0; round < 7; round++) {
+            g8(v, 0, 4, 8, 12, m[0], m[1]);
+            g8(v, 1, 5, 9, 13, m[2], m[3]);
+            g8(v, 2, 6, 10, 14, m[4], m[5]);
+            g8(v, 3, 7, 11, 15, m[6], m[7]);
+            g8(v, 0, 5, 10, 15, m[8], m[9]);
+            g8(v, 1, 6, 11, 12, m[10], m[11]);
+            g8(v, 2, 7, 8, 13, m[12], m[13]);
+            g8(v, 3, 4, 9, 14, m[14], m[15]);
+
+            __m256i permuted[16];
+            for (int i = 0; i < 16; i++)
+                permuted[i] = m[MSG_PERMUTATION[i]];
+            for (int i = 0; i < 16; i++)
+                m[i] = permuted[i];
+        }
+        for (int i = 0; i < 8; i++)
+            cv[i] = _mm256_xor_si256(v[i], v[i + 8]);
+    }
+
+    alignas(32) std::uint32_t words[8][8];
+    for (int i = 0; i < 8; i++)
+        _mm256_store_si256(reinterpret_cast<__m256i *>(words[i]), cv[i]);
+    for (int l = 0; l < 8; l++) {
+        for (int i = 0; i < 8; i++)
+            cvs[l][i] = words[i][l];
+    }
+}
+
+#undef ROTR16
+#undef ROTR8
+#undef ROTR
+#undef ADD
+
+static bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#define HAS_HASH8
+
+#endif
+
+/**
+ * compute the output of the root of a subtree: the left subtree has the biggest power of 2 of chunks that leaves
+ * at least a byte to the right one. The two subtrees are hashed by different threads while there are threads and
+ * they are big enough
+ *
+ * @param data of the subtree
+ * @param len number of bytes
+ * @param counter index of the first chunk
+ * @param threads number of threads that can hash the subtree
+ * @return the output of the root of the subtree
+ */
+static Output subtree_output(const unsigned char *data, std::size_t len, std::uint64_t counter,
+                             unsigned int threads) {
+    if (len <= CHUNK_LEN) {
+        Hasher::ChunkState chunk(counter);
+        chunk.update(data, len);
+        return chunk_output(chunk);
+    }
+#ifdef HAS_HASH8
+    // a subtree of 8 chunks: the chunks are hashed together, then merged in 4, 2 and 1 parents
+    if (len == 8 * CHUNK_LEN && has_avx2()) {
+        std::uint32_t cvs[8][8];
+        hash8_avx2(data, counter, cvs);
+        for (int n = 8; n > 2; n /= 2) {
+            for (int i = 0; i < n / 2; i++)
+                parent_output(cvs[2 * i], cvs[2 * i + 1]).chaining_value(cvs[i]);
+        }
+        return parent_output(cvs[0], cvs[1]);
+    }
+#endif
+
+    std::size_t left_len = CHUNK_LEN;
+    while (2 * left_len < len)
+        left_len *= 2;
+    std::uint64_t right_counter = counter + left_len / CHUNK_LEN;
+
+    std::uint32_t left[8], right[8];
+    if (threads > 1 && len >= PARALLEL_MIN_SIZE) {
+        unsigned int left_threads = threads / 2;
+        std::future<void> left_done = std::async(std::launch::async, [&]() {
+            subtree_output(data, left_len, counter, left_threads).chaining_value(left);
+        });
+        subtree_output(data + left_len, len - left_len, right_counter, threads - left_threads).chaining_value(right);
+        left_done.get();
+    } else {
+        subtree_output(data, left_len, counter, 1).chaining_value(left);
+        subtree_output(data + left_len, len - left_len, right_counter, 1).chaining_value(right);
+    }
+    return parent_output(left, right);
+}
+
+std::string digest(const void *data, std::size_t len, unsigned int threads) {
+    return subtree_output(static_cast<const unsigned char *>(data), len, 0, std::max(1u, threads)).root();
+}
+
+std::optional<std::string> file_digest(const std::string &path, unsigned int threads) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return {};
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return {};
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // the file is read in segments, each one is a complete subtree (a power of 2 of chunks) hashed by all the
+    // threads: their chaining values are merged as the ones of the chunks in Hasher
+    std::uint64_t size = st.st_size;
+    std::unique_ptr<unsigned char[]> buf{new unsigned char[std::min<std::uint64_t>(SEGMENT_SIZE, size) + 1]};
+    std::uint32_t stack[54][8];
+    std::size_t stack_len = 0;
+    std::uint64_t offset = 0;
+
+    while (true) {
+        std::size_t len = std::min<std::uint64_t>(SEGMENT_SIZE, size - offset);
+        std::size_t got = 0;
+        while (got < len) {
+            ssize_t n = pread(fd, buf.get() + got, len - got, offset + got);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                // error, or the file was truncated while it was read
+                close(fd);
+                return {};
+            }
+            got += n;
+        }
+
+        Output output = subtree_output(buf.get(), len, offset / CHUNK_LEN, std::max(1u, threads));
+        offset += len;
+        if (offset == size) {
+            close(fd);
+            for (std::size_t i = stack_len; i > 0; i--) {
+                std::uint32_t cv[8];
+                output.chaining_value(cv);
+                output = parent_output(stack[i - 1], cv);
+            }
+            return output.root();
+        }
+
+        std::uint32_t cv[8];
+        output.chaining_value(cv);
+        for (std::uint64_t total = offset / SEGMENT_SIZE; (total & 1) == 0; total >>= 1) {
+            stack_len--;
+            parent_output(stack[stack_len], cv).chaining_value(cv);
+        }
+        std::memcpy(stack[stack_len++], cv, sizeof(cv));
+    }
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef COMMON_BLAKE3_H
+#define COMMON_BLAKE3_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// BLAKE3 digests (32 bytes, in hexadecimal format). The input is split in chunks of 1 KiB that are the leaves of
+// a binary tree: the subtrees are independent, so a big input is hashed by many threads at the same time (and
+// 8 chunks at a time with AVX2, one in each lane).
+// Hasher computes the same digest incrementally, for data that is not all in memory
+namespace blake3 {
+
+    class Hasher {
+    public:
+        // state of the chunk being hashed (also used to hash the chunks of the tree)
+        struct ChunkState {
+            std::uint32_t cv[8];
+            std::uint64_t counter;
+            unsigned char block[64];
+            std::size_t block_len;
+            std::size_t blocks_compressed;
+
+            explicit ChunkState(std::uint64_t counter);
+            std::size_t len() const;
+            void update(const unsigned char *data, std::size_t len);
+        };
+
+    private:
+        ChunkState chunk_;
+        // chaining values of the complete subtrees on the left, one for each bit set in the number of chunks
+        std::uint32_t stack_[54][8];
+        std::size_t stack_len_ = 0;
+
+    public:
+        Hasher();
+
+        void update(const void *data, std::size_t len);
+        std::string final() const;
+    };
+
+    // digest of len bytes, the subtrees are hashed by up to threads threads
+    std::string digest(const void *data, std::size_t len, unsigned int threads = 1);
+
+    // digest of the content of a file, read in big segments hashed by up to threads threads, a empty optional if it
+    // can't be read
+    std::optional<std::string> file_digest(const std::string &path, unsigned int threads = 1);
+}
+
+#endif //COMMON_BLAKE3_H
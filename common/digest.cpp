@@ -0,0 +1,93 @@
+#include <openssl/evp.h>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include "digest.h"
+#include "sha256.h"
+
+// the files up to this size are hashed by a single thread also with BLAKE3
+#define BLAKE3_PARALLEL_SIZE (4 * 1024 * 1024)
+
+namespace digest {
+
+const char *name(Algorithm algorithm) {
+    return algorithm == algorithm_blake3 ? "blake3" : "sha256";
+}
+
+std::optional<Algorithm> from_name(const std::string &name) {
+    if (name == "sha256")
+        return algorithm_sha256;
+    if (name == "blake3")
+        return algorithm_blake3;
+    return {};
+}
+
+std::string buffer(const void *data, std::size_t len, Algorithm algorithm) {
+    if (algorithm == algorithm_blake3)
+        return blake3::digest(data, len);
+    return sha256::digest(data, len);
+}
+
+/**
+ * @return the number of threads that hash a file with BLAKE3, all the cores for the big files
+ */
+static unsigned int blake3_threads(const std::string &path) {
+    std::error_code ec;
+    std::uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec || size < BLAKE3_PARALLEL_SIZE)
+        return 1;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::optional<std::string> file(const std::string &path, Algorithm algorithm) {
+    if (algorithm == algorithm_blake3)
+        return blake3::file_digest(path, blake3_threads(path));
+    return sha256::file_digest(path);
+}
+
+std::vector<std::optional<std::string>> files(const std::vector<std::string> &paths, Algorithm algorithm) {
+    if (algorithm == algorithm_sha256)
+        return sha256::file_digests(paths);
+
+    std::vector<std::optional<std::string>> results;
+    results.reserve(paths.size());
+    for (const std::string &path: paths)
+        results.push_back(file(path, algorithm));
+    return results;
+}
+
+Hasher::Hasher(Algorithm algorithm) : algorithm_{algorithm} {
+    if (algorithm_ == algorithm_sha256) {
+        sha256_ = std::shared_ptr<void>(EVP_MD_CTX_new(), [](void *ctx) {
+            EVP_MD_CTX_free(static_cast<EVP_MD_CTX *>(ctx));
+        });
+        EVP_DigestInit_ex(static_cast<EVP_MD_CTX *>(sha256_.get()), EVP_sha256(), nullptr);
+    }
+}
+
+void Hasher::update(const void *data, std::size_t len) {
+    if (algorithm_ == algorithm_blake3)
+        blake3_.update(data, len);
+    else
+        EVP_DigestUpdate(static_cast<EVP_MD_CTX *>(sha256_.get()), data, len);
+}
+
+std::string Hasher::final() {
+    if (algorithm_ == algorithm_blake3)
+        return blake3_.final();
+
+    unsigned char md_value[EVP_MAX_MD_SIZE];
+    unsigned int md_len;
+    EVP_DigestFinal_ex(static_cast<EVP_MD_CTX *>(sha256_.get()), md_value, &md_len);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * md_len, 0);
+    for (unsigned int i = 0; i < md_len; i++) {
+        hex[2 * i] = digits[md_value[i] >> 4];
+        hex[2 * i + 1] = digits[md_value[i] & 0x0f];
+    }
+    return hex;
+}
+
+}
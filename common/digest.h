@@ -0,0 +1,53 @@
+#ifndef COMMON_DIGEST_H
+#define COMMON_DIGEST_H
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "blake3.h"
+
+// header of the requests with the digest algorithm used by the client (SHA256 if missing), and of the responses
+// with the algorithm of the digests they contain
+#define DIGEST_ALGORITHM_HEADER "Digest-Algorithm"
+
+// Digests of the files (in hexadecimal format, 64 characters for all the algorithms), with the algorithm chosen by
+// the client: SHA256, used by the first versions, or BLAKE3, whose tree of chunks lets a big file be hashed by all
+// the cores
+namespace digest {
+
+    enum Algorithm { algorithm_sha256, algorithm_blake3 };
+
+    // name of the algorithm in the requests and in the configuration: "sha256" or "blake3"
+    const char *name(Algorithm algorithm);
+
+    // the algorithm with the given name, a empty optional if it is not supported
+    std::optional<Algorithm> from_name(const std::string &name);
+
+    // digest of len bytes
+    std::string buffer(const void *data, std::size_t len, Algorithm algorithm);
+
+    // digest of the content of a file (BLAKE3 uses all the cores for the big files), a empty optional if it can't
+    // be read
+    std::optional<std::string> file(const std::string &path, Algorithm algorithm);
+
+    // digests of many files, in the same order (a empty optional for the files that can't be read)
+    std::vector<std::optional<std::string>> files(const std::vector<std::string> &paths, Algorithm algorithm);
+
+    // digest of data received in parts
+    class Hasher {
+        Algorithm algorithm_;
+        std::shared_ptr<void> sha256_;      // EVP_MD_CTX
+        blake3::Hasher blake3_;
+
+    public:
+        explicit Hasher(Algorithm algorithm);
+
+        void update(const void *data, std::size_t len);
+        std::string final();
+    };
+}
+
+#endif //COMMON_DIGEST_H
@@ -0,0 +1,159 @@
+#include <zlib.h>
+
+#include "gzip.h"
+
+// windowBits of zlib for the gzip format (the maximum window, 32 KiB, plus 16)
+#define GZIP_WINDOW_BITS (15 + 16)
+// size of the output produced at each step
+#define GZIP_OUT_SIZE (64 * 1024)
+// a sample compressed to more than this fraction of its size is considered incompressible
+#define GZIP_MIN_RATIO 0.9
+
+namespace gzip {
+
+static void free_deflate(void *stream) {
+    deflateEnd(static_cast<z_stream *>(stream));
+    delete static_cast<z_stream *>(stream);
+}
+
+static void free_inflate(void *stream) {
+    inflateEnd(static_cast<z_stream *>(stream));
+    delete static_cast<z_stream *>(stream);
+}
+
+/**
+ * @param level of compression, from 1 (fastest) to 9 (smallest output)
+ */
+Deflater::Deflater(int level) : stream_(new z_stream{}, free_deflate) {
+    deflateInit2(static_cast<z_stream *>(stream_.get()), level, Z_DEFLATED, GZIP_WINDOW_BITS, 8,
+                 Z_DEFAULT_STRATEGY);
+}
+
+/**
+ * compress a part of the stream
+ *
+ * @param data to compress
+ * @param len number of bytes
+ * @param finish true for the last part, the rest of the stream is written in out
+ * @param out where the compressed bytes are appended (they may be none until enough data is received)
+ * @return false if a error occurred
+ */
+bool Deflater::update(const void *data, std::size_t len, bool finish, std::string &out) {
+    auto *stream = static_cast<z_stream *>(stream_.get());
+    stream->next_in = static_cast<Bytef *>(const_cast<void *>(data));
+    stream->avail_in = static_cast<uInt>(len);
+
+    int ret;
+    do {
+        std::size_t size = out.size();
+        out.resize(size + GZIP_OUT_SIZE);
+        stream->next_out = reinterpret_cast<Bytef *>(&out[size]);
+        stream->avail_out = GZIP_OUT_SIZE;
+        ret = deflate(stream, finish ? Z_FINISH : Z_NO_FLUSH);
+        out.resize(out.size() - stream->avail_out);
+        if (ret == Z_STREAM_ERROR)
+            return false;
+    } while (stream->avail_out == 0 || (finish && ret != Z_STREAM_END));
+    return true;
+}
+
+Inflater::Inflater() : stream_(new z_stream{}, free_inflate) {
+    inflateInit2(static_cast<z_stream *>(stream_.get()), GZIP_WINDOW_BITS);
+}
+
+/**
+ * decompress a part of the stream
+ *
+ * @param data compressed
+ * @param len number of bytes
+ * @param sink receives the decompressed bytes, it returns false to stop
+ * @return false if the data is not valid (also after the end of the stream) or sink failed
+ */
+bool Inflater::update(const void *data, std::size_t len,
+                      const std::function<bool(const char *, std::size_t)> &sink) {
+    auto *stream = static_cast<z_stream *>(stream_.get());
+    if (len == 0)
+        return true;
+    if (finished_)
+        return false;
+
+    stream->next_in = static_cast<Bytef *>(const_cast<void *>(data));
+    stream->avail_in = static_cast<uInt>(len);
+    char out[GZIP_OUT_SIZE];
+
+    while (stream->avail_in > 0 || stream->avail_out == 0) {
+        stream->next_out = reinterpret_cast<Bytef *>(out);
+        stream->avail_out = GZIP_OUT_SIZE;
+        int ret = inflate(stream, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+            return false;
+
+        std::size_t n = GZIP_OUT_SIZE - stream->avail_out;
+        if (n > 0 && !sink(out, n))
+            return false;
+
+        if (ret == Z_STREAM_END) {
+            finished_ = true;
+            // nothing can follow the end of the stream
+            return stream->avail_in == 0;
+        }
+        if (ret == Z_BUF_ERROR && stream->avail_in == 0)
+            break;
+    }
+    return true;
+}
+
+bool Inflater::finished() const {
+    return finished_;
+}
+
+/**
+ * @param data to compress
+ * @param len number of bytes
+ * @param level of compression
+ * @return the data in gzip format
+ */
+std::string compress(const void *data, std::size_t len, int level) {
+    std::string out;
+    out.reserve(compressBound(len) + 32);
+    Deflater deflater{level};
+    deflater.update(data, len, true, out);
+    return out;
+}
+
+/**
+ * @param data in gzip format
+ * @param len number of bytes
+ * @param max_size max size of the output (against the bodies that expand too much)
+ * @return the decompressed data, a empty optional if not valid, truncated or bigger than max_size
+ */
+std::optional<std::string> decompress(const void *data, std::size_t len, std::size_t max_size) {
+    std::string out;
+    Inflater inflater;
+    bool ok = inflater.update(data, len, [&out, max_size](const char *part, std::size_t n) {
+        if (out.size() + n > max_size)
+            return false;
+        out.append(part, n);
+        return true;
+    });
+    if (!ok || !inflater.finished())
+        return {};
+    return out;
+}
+
+/**
+ * check if data is worth compressing, compressing a sample of it with the fastest level
+ * (text, source code and logs are compressed to less than half, compressed or encrypted data doesn't shrink)
+ *
+ * @param sample of the data
+ * @param len number of bytes
+ * @return true if the sample is compressed enough
+ */
+bool compressible(const void *sample, std::size_t len) {
+    if (len == 0)
+        return false;
+    std::string out = compress(sample, len, 1);
+    return static_cast<double>(out.size()) < GZIP_MIN_RATIO * static_cast<double>(len);
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef COMMON_GZIP_H
+#define COMMON_GZIP_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+// value of the Content-Encoding header of the compressed bodies, and of the Accept-Encoding header of the server
+#define GZIP_ENCODING "gzip"
+
+// level used to compress the bodies: the fastest levels already halve source code and logs, the higher ones cost
+// much more CPU for a few percent
+#define GZIP_LEVEL 3
+
+// Compression of the bodies of the requests with zlib, in gzip format (Content-Encoding: gzip).
+// Deflater and Inflater work on a stream received or sent in parts, so a body is never all in memory
+namespace gzip {
+
+    class Deflater {
+        std::unique_ptr<void, void (*)(void *)> stream_;    // z_stream
+
+    public:
+        explicit Deflater(int level = GZIP_LEVEL);
+
+        // compress len bytes appending the output to out, with finish the stream is completed
+        bool update(const void *data, std::size_t len, bool finish, std::string &out);
+    };
+
+    class Inflater {
+        std::unique_ptr<void, void (*)(void *)> stream_;    // z_stream
+        bool finished_ = false;
+
+    public:
+        Inflater();
+
+        // decompress len bytes, the output is passed to sink in parts (false from sink stops with a error),
+        // false if the data is not valid
+        bool update(const void *data, std::size_t len, const std::function<bool(const char *, std::size_t)> &sink);
+
+        // true when the end of the stream was received
+        bool finished() const;
+    };
+
+    // compress a whole buffer
+    std::string compress(const void *data, std::size_t len, int level = GZIP_LEVEL);
+
+    // decompress a whole buffer, a empty optional if it is not valid or the output is bigger than max_size
+    std::optional<std::string> decompress(const void *data, std::size_t len, std::size_t max_size);
+
+    // true if a sample of data is compressed enough to be worth compressing the data it comes from
+    bool compressible(const void *sample, std::size_t len);
+}
+
+#endif //COMMON_GZIP_H
@@ -0,0 +1,447 @@
+#include <openssl/evp.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sha256.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86
+#endif
+
+// size of the reads of a file, the buffer is aligned to the pages
+#define READ_BUF_SIZE (1024 * 1024)
+#define READ_BUF_ALIGN 4096
+
+// the files up to this size are read at once in a lane of the multi-buffer engine, the bigger ones are hashed alone
+#define MULTI_MAX_SIZE (256 * 1024)
+
+// files hashed at the same time by the multi-buffer engine (32 bits words in a AVX2 register)
+#define LANES 8
+
+namespace sha256 {
+
+/**
+ * @param md digest
+ * @param len number of bytes of the digest
+ * @return the digest in hexadecimal format
+ */
+static std::string to_hex(const unsigned char *md, std::size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * len, 0);
+    for (std::size_t i = 0; i < len; i++) {
+        hex[2 * i] = digits[md[i] >> 4];
+        hex[2 * i + 1] = digits[md[i] & 0x0f];
+    }
+    return hex;
+}
+
+/**
+ * @return the SHA256 implementation of OpenSSL, fetched once (OpenSSL 3 looks for it at every init otherwise)
+ */
+static const EVP_MD *sha256_md() {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static EVP_MD *md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    if (md)
+        return md;
+#endif
+    return EVP_sha256();
+}
+
+// context and read buffer of a thread, reused for all the files it hashes
+struct ThreadState {
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx{EVP_MD_CTX_new(), EVP_MD_CTX_free};
+    std::unique_ptr<unsigned char, decltype(&std::free)> buf{
+            static_cast<unsigned char *>(std::aligned_alloc(READ_BUF_ALIGN, READ_BUF_SIZE)), std::free};
+};
+
+static ThreadState &thread_state() {
+    thread_local ThreadState state;
+    return state;
+}
+
+/**
+ * @param fd file descriptor to read until the end
+ * @return the digest, a empty optional if a read failed
+ */
+static std::optional<std::string> digest_fd(int fd) {
+    ThreadState &state = thread_state();
+    EVP_DigestInit_ex(state.ctx.get(), sha256_md(), nullptr);
+
+    ssize_t n;
+    while ((n = read(fd, state.buf.get(), READ_BUF_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return {};
+        }
+        EVP_DigestUpdate(state.ctx.get(), state.buf.get(), n);
+    }
+
+    unsigned char md_value[EVP_MAX_MD_SIZE];
+    unsigned int md_len;
+    if (EVP_DigestFinal_ex(state.ctx.get(), md_value, &md_len) != 1)
+        return {};
+    return to_hex(md_value, md_len);
+}
+
+/**
+ * @param path of a file
+ * @return a descriptor of the file opened for reading, -1 if it isn't a regular file or it can't be opened
+ */
+static int open_file(const std::string &path, struct stat &st) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::string digest(const void *data, std::size_t len) {
+    ThreadState &state = thread_state();
+    unsigned char md_value[EVP_MAX_MD_SIZE];
+    unsigned int md_len;
+    EVP_DigestInit_ex(state.ctx.get(), sha256_md(), nullptr);
+    EVP_DigestUpdate(state.ctx.get(), data, len);
+    EVP_DigestFinal_ex(state.ctx.get(), md_value, &md_len);
+    return to_hex(md_value, md_len);
+}
+
+std::optional<std::string> file_digest(const std::string &path) {
+    struct stat st{};
+    int fd = open_file(path, st);
+    if (fd < 0)
+        return {};
+    // the kernel reads ahead more
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    std::optional<std::string> result = digest_fd(fd);
+    close(fd);
+    return result;
+}
+
+/**
+ * hash the files one at a time, taking the next index from the shared counter
+ */
+static void digests_single(const std::vector<std::string> &paths, std::atomic<std::size_t> &next,
+                           std::vector<std::optional<std::string>> &results) {
+    for (std::size_t i; (i = next.fetch_add(1)) < paths.size();)
+        results[i] = file_digest(paths[i]);
+}
+
+#ifdef SHA256_X86
+
+static const std::uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static const std::uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define XOR3(a, b, c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+#define ADD(a, b) _mm256_add_epi32(a, b)
+
+/**
+ * process a block of 64 bytes for each lane
+ *
+ * @param state the 8 words of the state of each lane, state[word][lane]
+ * @param blocks the block of each lane
+ */
+__attribute__((target("avx2")))
+static void compress_avx2(std::uint32_t state[8][LANES], const unsigned char *const blocks[LANES]) {
+    // the words of the blocks transposed: w[t] has the word t of all the lanes
+    alignas(32) std::uint32_t words[16][LANES];
+    for (int lane = 0; lane < LANES; lane++) {
+        for (int t = 0; t < 16; t++) {
+            std::uint32_t v;
+            std::memcpy(&v, blocks[lane] + 4 * t, 4);
+            words[t][lane] = __builtin_bswap32(v);
+        }
+    }
+    __m256i w[16];
+    for (int t = 0; t < 16; t++)
+        w[t] = _mm256_load_si256(reinterpret_cast<const __m256i *>(words[t]));
+
+    __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[0]));
+    __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[1]));
+    __m256i c = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[2]));
+    __m256i d = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[3]));
+    __m256i e = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[4]));
+    __m256i f = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[5]));
+    __m256i g = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[6]));
+    __m256i h = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[7]));
+
+    for (int t = 0; t < 64; t++) {
+        __m256i wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            __m256i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+            __m256i s1 = XOR3(ROTR(w2, 17), ROTR(w2, 19), _mm256_srli_epi32(w2, 10));
+            __m256i s0 = XOR3(ROTR(w15, 7), ROTR(w15, 18), _mm256_srli_epi32(w15, 3));
+            wt = ADD(ADD(s1, w[(t - 7) & 15]), ADD(s0, w[t & 15]));
+            w[t & 15] = wt;
+        }
+
+        __m256i sum1 = XOR3(ROTR(e, 6), ROTR(e, 11), ROTR(e, 25));
+        __m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+        __m256i t1 = ADD(ADD(h, sum1), ADD(ch, ADD(_mm256_set1_epi32(static_cast<int>(K[t])), wt)));
+        __m256i sum0 = XOR3(ROTR(a, 2), ROTR(a, 13), ROTR(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i t2 = ADD(sum0, maj);
+
+        h = g;
+        g = f;
+        f = e;
+        e = ADD(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = ADD(t1, t2);
+    }
+
+    __m256i *s = reinterpret_cast<__m256i *>(state);
+    _mm256_store_si256(s + 0, ADD(a, _mm256_load_si256(s + 0)));
+    _mm256_store_si256(s + 1, ADD(b, _mm256_load_si256(s + 1)));
+    _mm256_store_si256(s + 2, ADD(c, _mm256_load_si256(s + 2)));
+    _mm256_store_si256(s + 3, ADD(d, _mm256_load_si256(s + 3)));
+    _mm256_store_si256(s + 4, ADD(e, _mm256_load_si256(s + 4)));
+    _mm256_store_si256(s + 5, ADD(f, _mm256_load_si256(s + 5)));
+    _mm256_store_si256(s + 6, ADD(g, _mm256_load_si256(s + 6)));
+    _mm256_store_si256(s + 7, ADD(h, _mm256_load_si256(s + 7)));
+}
+
+#undef ROTR
+#undef XOR3
+#undef ADD
+
+// a file in a lane: its full blocks are read from the data, the last bytes with the padding from the tail
+struct Lane {
+    bool active = false;
+    std::size_t job = 0;
+    std::unique_ptr<unsigned char[]> data{new unsigned char[MULTI_MAX_SIZE]};
+    std::size_t full_blocks = 0;
+    unsigned char tail[128];
+    std::size_t total_blocks = 0;
+    std::size_t done = 0;
+
+    const unsigned char *block() const {
+        return done < full_blocks ? data.get() + 64 * done : tail + 64 * (done - full_blocks);
+    }
+};
+
+/**
+ * read a small file in a lane and prepare its padding
+ *
+ * @param fd descriptor of the file
+ * @return false if the file can't be read in the lane (read error or it grew)
+ */
+static bool load_lane(Lane &lane, int fd) {
+    std::size_t len = 0;
+    while (len < MULTI_MAX_SIZE) {
+        ssize_t n = read(fd, lane.data.get() + len, MULTI_MAX_SIZE - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        len += n;
+    }
+    // more data than the lane can keep (the file grew)
+    unsigned char extra;
+    if (len == MULTI_MAX_SIZE && read(fd, &extra, 1) != 0)
+        return false;
+
+    std::size_t rest = len % 64;
+    lane.full_blocks = len / 64;
+    std::memset(lane.tail, 0, sizeof(lane.tail));
+    std::memcpy(lane.tail, lane.data.get() + 64 * lane.full_blocks, rest);
+    lane.tail[rest] = 0x80;
+    std::size_t tail_blocks = rest + 9 <= 64 ? 1 : 2;
+    std::uint64_t bits = static_cast<std::uint64_t>(len) * 8;
+    for (int i = 0; i < 8; i++)
+        lane.tail[64 * tail_blocks - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+
+    lane.total_blocks = lane.full_blocks + tail_blocks;
+    lane.done = 0;
+    return true;
+}
+
+/**
+ * hash the files with the multi-buffer engine, taking the next index from the shared counter: the small files are
+ * hashed in the lanes, the big ones (and the ones that changed size while they were read) one at a time
+ */
+static void digests_multi(const std::vector<std::string> &paths, std::atomic<std::size_t> &next,
+                          std::vector<std::optional<std::string>> &results) {
+    alignas(32) std::uint32_t state[8][LANES];
+    // the buffers of the lanes are reused by the next calls of the thread
+    thread_local std::unique_ptr<Lane[]> storage{new Lane[LANES]};
+    Lane *lanes = storage.get();
+
+    // give the next small file to a lane, false if there are no more files
+    auto refill = [&](int l) {
+        Lane &lane = lanes[l];
+        for (std::size_t i; (i = next.fetch_add(1)) < paths.size();) {
+            struct stat st{};
+            int fd = open_file(paths[i], st);
+            if (fd < 0)
+                continue;
+            bool loaded = st.st_size <= MULTI_MAX_SIZE && load_lane(lane, fd);
+            if (!loaded) {
+                lseek(fd, 0, SEEK_SET);
+                results[i] = digest_fd(fd);
+                close(fd);
+                continue;
+            }
+            close(fd);
+            lane.job = i;
+            for (int word = 0; word < 8; word++)
+                state[word][l] = initial[word];
+            return lane.active = true;
+        }
+        return lane.active = false;
+    };
+
+    int active = 0;
+    for (int l = 0; l < LANES; l++)
+        active += refill(l);
+
+    // the lanes without a file process a block of zeros, their result is not used
+    static const unsigned char empty[64] = {};
+    const unsigned char *blocks[LANES];
+    while (active > 0) {
+        for (int l = 0; l < LANES; l++)
+            blocks[l] = lanes[l].active ? lanes[l].block() : empty;
+        compress_avx2(state, blocks);
+
+        for (int l = 0; l < LANES; l++) {
+            Lane &lane = lanes[l];
+            if (!lane.active || ++lane.done < lane.total_blocks)
+                continue;
+            unsigned char md[32];
+            for (int word = 0; word < 8; word++) {
+                std::uint32_t v = __builtin_bswap32(state[word][l]);
+                std::memcpy(md + 4 * word, &v, 4);
+            }
+            results[lane.job] = to_hex(md, sizeof(md));
+            active -= !refill(l);
+        }
+    }
+}
+
+static bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+/**
+ * @return true if the CPU has the SHA extensions, used by OpenSSL
+ */
+static bool has_sha_ni() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ebx & bit_SHA) != 0;
+}
+
+#endif
+
+struct Implementation {
+    const char *name;
+    void (*digests)(const std::vector<std::string> &, std::atomic<std::size_t> &,
+                    std::vector<std::optional<std::string>> &);
+    bool (*supported)();
+};
+
+static bool always() { return true; }
+
+static const Implementation implementations_list[] = {
+#ifdef SHA256_X86
+        {"avx2x8", digests_multi, has_avx2},
+#endif
+        {"evp", digests_single, always}
+};
+
+static const Implementation *selected = nullptr;
+
+/**
+ * @return the default engine: the multi-buffer one if the CPU has AVX2 and not SHA-NI
+ */
+static const Implementation *best() {
+    static const Implementation *impl = []() {
+#ifdef SHA256_X86
+        if (has_sha_ni())
+            return &implementations_list[1];
+#endif
+        for (const Implementation &impl: implementations_list) {
+            if (impl.supported())
+                return &impl;
+        }
+        return &implementations_list[0];
+    }();
+    return impl;
+}
+
+/**
+ * @return the engine in use, the default one unless another was chosen
+ */
+static const Implementation *current() {
+    return selected ? selected : best();
+}
+
+std::vector<std::optional<std::string>> file_digests(const std::vector<std::string> &paths, unsigned int threads) {
+    std::vector<std::optional<std::string>> results(paths.size());
+    std::atomic<std::size_t> next{0};
+    const Implementation *impl = current();
+
+    threads = std::max(1u, std::min<unsigned int>(threads, paths.size()));
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; i++)
+        workers.emplace_back([&]() { impl->digests(paths, next, results); });
+    impl->digests(paths, next, results);
+    for (auto &t: workers)
+        t.join();
+
+    return results;
+}
+
+const char *implementation() {
+    return current()->name;
+}
+
+std::vector<std::string> implementations() {
+    std::vector<std::string> names{best()->name};
+    for (const Implementation &impl: implementations_list) {
+        if (impl.supported() && impl.name != names.front())
+            names.emplace_back(impl.name);
+    }
+    return names;
+}
+
+bool use_implementation(const std::string &name) {
+    for (const Implementation &impl: implementations_list) {
+        if (impl.name == name && impl.supported()) {
+            selected = &impl;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef COMMON_SHA256_H
+#define COMMON_SHA256_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// SHA256 digests (in hexadecimal format) used by client and server.
+// A single buffer is hashed by OpenSSL, which uses the SHA extensions (SHA-NI) of the CPU when present; the files are
+// read with large reads in a page-aligned buffer reused by each thread.
+// Many small files are hashed together by the multi-buffer engine: each lane of the AVX2 registers computes the
+// digest of a different file, a lane that finishes takes the next file. It is used when the CPU has AVX2 but not
+// SHA-NI, otherwise the files are hashed one at a time (a single SHA-NI stream is faster than 8 AVX2 lanes)
+namespace sha256 {
+
+    // digest of len bytes
+    std::string digest(const void *data, std::size_t len);
+
+    // digest of the content of a file, a empty optional if it can't be read
+    std::optional<std::string> file_digest(const std::string &path);
+
+    // digests of many files, in the same order (a empty optional for the files that can't be read), computed by
+    // the given number of threads
+    std::vector<std::optional<std::string>> file_digests(const std::vector<std::string> &paths,
+                                                         unsigned int threads = 1);
+
+    // name of the engine used for file_digests: "avx2x8" (multi-buffer) or "evp" (one file at a time)
+    const char *implementation();
+
+    // the engines supported by this CPU, the first is the one used by default
+    std::vector<std::string> implementations();
+
+    // use an engine supported by this CPU (for benchmarks), not to be called while hashing
+    bool use_implementation(const std::string &name);
+}
+
+#endif //COMMON_SHA256_H
@@ -0,0 +1,157 @@
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "GroupCommit.h"
+#include "configuration.h"
+#include "storage.h"
+#include "IoRing.h"
+
+namespace fs = std::filesystem;
+
+GroupCommit* GroupCommit::instance = nullptr;
+std::once_flag GroupCommit::inited;
+
+GroupCommit *GroupCommit::getInstance() {
+
+    std::call_once(inited, []() {
+        instance = new GroupCommit;
+    });
+
+    return instance;
+}
+
+GroupCommit::GroupCommit() {
+    if (configuration::durability == "file") {
+        policy_ = policy_file;
+    } else if (configuration::durability == "group") {
+        policy_ = policy_group;
+        fs_fd_ = ::open(configuration::backuppath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fs_fd_ < 0) {
+            std::cerr << "Can't open the backuppath for the group commits: " << std::strerror(errno) << std::endl;
+            ready_ = false;
+            return;
+        }
+        // the thread lives as the process, as the singleton
+        committer_ = std::thread(&GroupCommit::run, this);
+        committer_.detach();
+    } else {
+        policy_ = policy_none;
+    }
+}
+
+/**
+ * @return false if the backuppath can't be opened for the group commits, every commit would fail
+ */
+bool GroupCommit::ready() const {
+    return ready_;
+}
+
+/**
+ * flush a file or a folder to the disk
+ *
+ * @param path of the file/folder
+ * @return false if a error occurred
+ */
+static bool sync_path(const std::string &path) {
+    if (ring_storage())
+        return IoRing::getInstance()->sync_file(path);
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    return close(fd) == 0 && ok;
+}
+
+/**
+ * thread of the commits: wait for the first request, then for commit_interval ms or commit_files requests, and
+ * flush the whole filesystem of the backuppath
+ */
+void GroupCommit::run() {
+    std::unique_lock<std::mutex> ul(m_);
+    for (;;) {
+        commit_cv_.wait(ul, [this]() { return requested_ > committed_; });
+        commit_cv_.wait_until(ul, first_ + std::chrono::milliseconds(configuration::commit_interval), [this]() {
+            return requested_ - committed_ >= static_cast<std::uint64_t>(configuration::commit_files);
+        });
+
+        // the requests made during the syncfs can have written after its start, they wait for the next one
+        std::uint64_t covered = requested_;
+        ul.unlock();
+        bool ok = syncfs(fs_fd_) == 0;
+        ul.lock();
+
+        committed_ = covered;
+        commits_++;
+        if (!ok)
+            errors_++;
+        if (requested_ > committed_)
+            first_ = std::chrono::steady_clock::now();
+        cv_.notify_all();
+    }
+}
+
+/**
+ * wait for a commit started after the call
+ *
+ * @return false if a commit failed while waiting (the data written before the call may not be durable)
+ */
+bool GroupCommit::wait_commit() {
+    std::unique_lock<std::mutex> ul(m_);
+    if (requested_ == committed_)
+        first_ = std::chrono::steady_clock::now();
+    std::uint64_t ticket = ++requested_;
+    std::uint64_t errors = errors_;
+    commit_cv_.notify_one();
+
+    cv_.wait(ul, [this, ticket]() { return committed_ >= ticket; });
+    return errors_ == errors;
+}
+
+/**
+ * make the content of a new file durable before it is renamed in place
+ *
+ * @param tmp_path temporary file completely written
+ * @return false if the content can't be flushed, the file must not be saved
+ */
+bool GroupCommit::before_rename(const std::string &tmp_path) {
+    switch (policy_) {
+        case policy_file: return sync_path(tmp_path);
+        case policy_group: return wait_commit();
+        default: return true;
+    }
+}
+
+/**
+ * make the rename of a new file durable, the request that saved it can be acknowledged after the call
+ *
+ * @param abs_path where the file was renamed
+ * @return false if the rename can't be flushed
+ */
+bool GroupCommit::after_rename(const std::string &abs_path) {
+    switch (policy_) {
+        case policy_file: return sync_path(fs::path(abs_path).parent_path().string());
+        case policy_group: return wait_commit();
+        default: return true;
+    }
+}
+
+/**
+ * @return number of requests of a group commit
+ */
+std::uint64_t GroupCommit::requests() {
+    std::lock_guard<std::mutex> lg(m_);
+    return requested_;
+}
+
+/**
+ * @return number of group commits (syncfs) done
+ */
+std::uint64_t GroupCommit::commits() {
+    std::lock_guard<std::mutex> lg(m_);
+    return commits_;
+}
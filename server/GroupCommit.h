@@ -0,0 +1,62 @@
+#ifndef SERVER_PROGETTO_GROUPCOMMIT_H
+#define SERVER_PROGETTO_GROUPCOMMIT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//singleton, makes the files saved in the backuppath durable before the requests that saved them are acknowledged,
+//as set by the durability option:
+//- none: the kernel flushes the files when it wants, a crash can lose the last files saved
+//- file: the content of each file is flushed before it is renamed in place, then its folder is flushed
+//- group: the threads wait for a commit, a single syncfs of the backuppath that covers the files of all the sessions.
+//  A thread of the commits starts it after commit_interval ms from the first file waiting or as soon as
+//  commit_files files are waiting
+//With file and group the content is durable before the rename, so after a crash a path has the old or the new
+//content, never a part of it
+class GroupCommit {
+    enum Policy {
+        policy_none,
+        policy_file,
+        policy_group
+    };
+
+    Policy policy_;
+    bool ready_ = true;                         // false if the commits can't be done
+    int fs_fd_ = -1;                            // backuppath, for syncfs
+    std::mutex m_;
+    std::condition_variable cv_;                // of the threads waiting for a commit
+    std::condition_variable commit_cv_;         // of the thread of the commits
+    std::uint64_t requested_ = 0;               // requests of a commit
+    std::uint64_t committed_ = 0;               // requests covered by the finished commits
+    std::uint64_t errors_ = 0;                  // failed commits
+    std::uint64_t commits_ = 0;
+    std::chrono::steady_clock::time_point first_;   // first request after the last commit
+    std::thread committer_;
+
+    GroupCommit();
+    void run();
+    bool wait_commit();
+
+public:
+    static GroupCommit* instance;
+    static std::once_flag inited;
+
+    static GroupCommit *getInstance();
+
+    bool ready() const;
+    bool before_rename(const std::string &tmp_path);
+    bool after_rename(const std::string &abs_path);
+
+    std::uint64_t requests();
+    std::uint64_t commits();
+
+    GroupCommit(const GroupCommit&)= delete;
+    GroupCommit& operator=(const GroupCommit&)= delete;
+};
+
+
+#endif //SERVER_PROGETTO_GROUPCOMMIT_H
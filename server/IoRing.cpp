@@ -0,0 +1,584 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include "IoRing.h"
+
+IoRing* IoRing::instance = nullptr;
+std::once_flag IoRing::inited;
+
+IoRing *IoRing::getInstance() {
+
+    std::call_once(inited, []() {
+        instance = new IoRing;
+    });
+
+    return instance;
+}
+
+/**
+ * @return true if the storage operations can use the ring
+ */
+bool IoRing::available() const {
+    return available_;
+}
+
+/**
+ * @return true if the digests can read the files in the registered buffers
+ */
+bool IoRing::fixed_reads() const {
+    return fixed_reads_;
+}
+
+/**
+ * @return why io_uring or its buffers can't be used, empty if they can
+ */
+const std::string &IoRing::error() const {
+    return error_;
+}
+
+/**
+ * @return number of io_uring_enter calls that submitted operations
+ */
+std::uint64_t IoRing::enters() const {
+    return enters_.load();
+}
+
+/**
+ * @return number of operations submitted
+ */
+std::uint64_t IoRing::operations() const {
+    return operations_.load();
+}
+
+#if __has_include(<linux/io_uring.h>)
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct IoRing::Batch {
+    // the user_data of an operation points to its Pending
+    struct Pending {
+        Batch *batch;
+        std::size_t index;
+    };
+
+    std::vector<Op> ops;
+    std::vector<Pending> pending;
+    // with cq_m_
+    std::vector<int> results;
+    std::size_t remaining;
+
+    explicit Batch(std::vector<Op> batch_ops)
+            : ops(std::move(batch_ops)), results(ops.size(), -ECANCELED), remaining(ops.size()) {
+        for (std::size_t i = 0; i < ops.size(); i++)
+            pending.push_back(Pending{this, i});
+    }
+};
+
+static int ring_setup(unsigned entries, io_uring_params *params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int ring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+IoRing::IoRing() {
+    available_ = setup();
+    fixed_reads_ = available_ && register_buffers();
+}
+
+/**
+ * create the ring, map its queues and check that the kernel supports all the operations used
+ *
+ * @return false if io_uring can't be used, nothing is left open
+ */
+bool IoRing::setup() {
+    io_uring_params params{};
+    fd_ = ring_setup(IO_RING_ENTRIES, &params);
+    if (fd_ < 0) {
+        error_ = std::string("io_uring_setup: ") + std::strerror(errno);
+        return false;
+    }
+    auto fail = [this](const std::string &reason) {
+        error_ = reason;
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    };
+
+    // the queues are mapped with one mmap (kernel 5.4)
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+        return fail("the kernel can't map the queues with one mmap");
+
+    // the operations must be supported (rename: kernel 5.11)
+    std::size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::unique_ptr<char[]> probe_buf(new char[probe_size]());
+    auto *probe = reinterpret_cast<io_uring_probe *>(probe_buf.get());
+    if (ring_register(fd_, IORING_REGISTER_PROBE, probe, 256) < 0)
+        return fail(std::string("IORING_REGISTER_PROBE: ") + std::strerror(errno));
+    for (int op: {IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_FSYNC,
+                  IORING_OP_RENAMEAT}) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            return fail("operation " + std::to_string(op) + " not supported by the kernel");
+    }
+
+    std::size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    std::size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    std::size_t ring_size = std::max(sq_size, cq_size);
+    std::size_t sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                      IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED)
+        return fail(std::string("mmap of the queues: ") + std::strerror(errno));
+    void *sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        std::string reason = std::string("mmap of the submissions: ") + std::strerror(errno);
+        munmap(ring, ring_size);
+        return fail(reason);
+    }
+
+    char *base = static_cast<char *>(ring);
+    sq_head_ = reinterpret_cast<unsigned *>(base + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+    cq_head_ = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(base + params.cq_off.cqes);
+    tail_ = submitted_ = *sq_tail_;
+    return true;
+}
+
+/**
+ * register the buffers of the reads, so they are pinned once and not at each read. They are
+ * IO_RING_BUFFERS * IO_RING_BUFFER_SIZE bytes of locked memory, counted in RLIMIT_MEMLOCK (by default 64 KB
+ * before the kernel 5.16)
+ *
+ * @return false if they can't be registered, the ring can still be used without them
+ */
+bool IoRing::register_buffers() {
+    std::vector<iovec> iovecs;
+    bool ok = true;
+    for (int i = 0; ok && i < IO_RING_BUFFERS; i++) {
+        void *buffer = nullptr;
+        if (posix_memalign(&buffer, 4096, IO_RING_BUFFER_SIZE) != 0) {
+            error_ = "can't allocate the buffers of the reads";
+            ok = false;
+            break;
+        }
+        buffers_.push_back(static_cast<char *>(buffer));
+        iovecs.push_back(iovec{buffer, IO_RING_BUFFER_SIZE});
+    }
+    if (ok && ring_register(fd_, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) != 0) {
+        error_ = std::string("IORING_REGISTER_BUFFERS: ") + std::strerror(errno) +
+                 (errno == ENOMEM ? " (RLIMIT_MEMLOCK too low)" : "");
+        ok = false;
+    }
+
+    if (!ok) {
+        for (char *buffer: buffers_)
+            free(buffer);
+        buffers_.clear();
+        return false;
+    }
+    for (int i = 0; i < IO_RING_BUFFERS; i++)
+        free_buffers_.push_back(i);
+    return true;
+}
+
+/**
+ * add the operations of a batch to the submission queue and submit them, with the ones added by the other threads
+ * in the meantime. The batch must stay alive until all its operations complete
+ *
+ * @param batch operations to submit
+ */
+void IoRing::submit(Batch &batch) {
+    std::unique_lock<std::mutex> ul(sq_m_);
+    std::size_t i = 0;
+    while (i < batch.ops.size()) {
+        unsigned free = sq_entries_ - (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE));
+        if (free == 0) {
+            // the queue is full until the kernel takes the operations
+            if (submitting_)
+                sq_cv_.wait(ul);
+            else
+                flush(ul);
+            continue;
+        }
+
+        for (; i < batch.ops.size() && free > 0; i++, free--) {
+            const Op &op = batch.ops[i];
+            unsigned index = tail_ & *sq_mask_;
+            io_uring_sqe *sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = op.opcode;
+            sqe->fd = op.fd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(op.addr);
+            sqe->len = op.len;
+            sqe->off = op.offset;
+            sqe->user_data = reinterpret_cast<std::uint64_t>(&batch.pending[i]);
+            if (op.opcode == IORING_OP_OPENAT) {
+                sqe->fd = AT_FDCWD;
+                sqe->open_flags = op.flags;
+            } else if (op.opcode == IORING_OP_RENAMEAT) {
+                sqe->fd = AT_FDCWD;
+                sqe->len = AT_FDCWD;
+                sqe->addr2 = reinterpret_cast<std::uint64_t>(op.addr2);
+            } else if (op.opcode == IORING_OP_READ_FIXED) {
+                sqe->buf_index = op.buf_index;
+            }
+            sq_array_[index] = index;
+            tail_++;
+        }
+        __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+    }
+    operations_ += batch.ops.size();
+
+    // a thread already in io_uring_enter submits these operations too when it returns
+    if (!submitting_)
+        flush(ul);
+}
+
+/**
+ * pass to the kernel all the operations added, also by other threads while the system call runs
+ *
+ * @param ul lock of the submission queue, released during the system call
+ */
+void IoRing::flush(std::unique_lock<std::mutex> &ul) {
+    submitting_ = true;
+    while (submitted_ != tail_) {
+        unsigned n = tail_ - submitted_;
+        ul.unlock();
+        int ret = ring_enter(fd_, n, 0, 0);
+        int err = errno;
+        ul.lock();
+        enters_++;
+        if (ret < 0) {
+            if (err == EINTR || err == EAGAIN || err == EBUSY) {
+                // the completions must be collected before submitting more
+                ul.unlock();
+                {
+                    std::lock_guard<std::mutex> lg(cq_m_);
+                    collect();
+                }
+                std::this_thread::yield();
+                ul.lock();
+                continue;
+            }
+            std::cerr << "io_uring_enter: " << std::strerror(err) << std::endl;
+            std::abort();
+        }
+        submitted_ += ret;
+    }
+    submitting_ = false;
+    sq_cv_.notify_all();
+}
+
+/**
+ * take the completions in the queue and save their results in their batches, with cq_m_ locked
+ */
+void IoRing::collect() {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return;
+
+    for (; head != tail; head++) {
+        io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+        auto *pending = reinterpret_cast<Batch::Pending *>(cqe->user_data);
+        pending->batch->results[pending->index] = cqe->res;
+        pending->batch->remaining--;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    cq_cv_.notify_all();
+}
+
+/**
+ * wait for the completion of all the operations of a batch: if no other thread is waiting in the kernel, this
+ * thread waits there and collects the completions of all the threads
+ *
+ * @param batch submitted operations
+ */
+void IoRing::wait(Batch &batch) {
+    std::unique_lock<std::mutex> ul(cq_m_);
+    for (;;) {
+        collect();
+        if (batch.remaining == 0)
+            return;
+        if (reaping_) {
+            cq_cv_.wait(ul);
+            continue;
+        }
+
+        reaping_ = true;
+        ul.unlock();
+        ring_enter(fd_, 0, 1, IORING_ENTER_GETEVENTS);
+        ul.lock();
+        reaping_ = false;
+        // another thread can wait in the kernel, if this one is done
+        cq_cv_.notify_all();
+    }
+}
+
+/**
+ * submit some operations and wait for them
+ *
+ * @param ops operations
+ * @return the result of each operation (negative errno for an error)
+ */
+std::vector<int> IoRing::run(const std::vector<Op> &ops) {
+    Batch batch(ops);
+    submit(batch);
+    wait(batch);
+    return batch.results;
+}
+
+/**
+ * take some registered buffers, waiting if they are used by other threads
+ *
+ * @param n number of buffers (at most IO_RING_BUFFERS)
+ * @return indexes of the buffers
+ */
+std::vector<int> IoRing::acquire_buffers(std::size_t n) {
+    std::unique_lock<std::mutex> ul(buffers_m_);
+    // all the buffers are taken together, so two threads can't wait for each other
+    buffers_cv_.wait(ul, [this, n]() { return free_buffers_.size() >= n; });
+    std::vector<int> indexes(free_buffers_.end() - n, free_buffers_.end());
+    free_buffers_.resize(free_buffers_.size() - n);
+    return indexes;
+}
+
+void IoRing::release_buffers(const std::vector<int> &indexes) {
+    std::lock_guard<std::mutex> lg(buffers_m_);
+    free_buffers_.insert(free_buffers_.end(), indexes.begin(), indexes.end());
+    buffers_cv_.notify_all();
+}
+
+/**
+ * @param path of the file
+ * @param flags of open(2)
+ * @return the file descriptor, negative errno if the file can't be opened
+ */
+int IoRing::open(const std::string &path, int flags) {
+    Op op{IORING_OP_OPENAT};
+    op.addr = path.c_str();
+    op.len = 0644;      // mode of a new file
+    op.flags = flags | O_CLOEXEC;
+    return run({op})[0];
+}
+
+int IoRing::close(int fd) {
+    Op op{IORING_OP_CLOSE};
+    op.fd = fd;
+    return run({op})[0];
+}
+
+/**
+ * create (or truncate) a file with the given content: the content is written in parts of IO_RING_BUFFER_SIZE
+ * bytes, IO_RING_DEPTH of them in flight at the same time
+ *
+ * @param path of the file
+ * @param data content of the file
+ * @param n number of bytes
+ * @param sync if true the file is flushed to the disk before returning
+ * @return false if a error occurred
+ */
+bool IoRing::write_file(const std::string &path, const char *data, std::size_t n, bool sync) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd < 0)
+        return false;
+
+    bool ok = true;
+    std::size_t offset = 0;
+    while (ok && offset < n) {
+        std::vector<Op> ops;
+        for (int i = 0; i < IO_RING_DEPTH && offset < n; i++) {
+            Op op{IORING_OP_WRITE};
+            op.fd = fd;
+            op.addr = data + offset;
+            op.len = static_cast<std::uint32_t>(std::min<std::size_t>(IO_RING_BUFFER_SIZE, n - offset));
+            op.offset = offset;
+            ops.push_back(op);
+            offset += op.len;
+        }
+
+        std::vector<int> results = run(ops);
+        for (std::size_t i = 0; ok && i < ops.size(); i++) {
+            if (results[i] < 0) {
+                ok = false;
+                break;
+            }
+            // a short write (e.g. interrupted) is completed with pwrite
+            for (std::size_t done = results[i]; done < ops[i].len;) {
+                ssize_t ret = pwrite(fd, static_cast<const char *>(ops[i].addr) + done, ops[i].len - done,
+                                     static_cast<off_t>(ops[i].offset + done));
+                if (ret <= 0) {
+                    ok = false;
+                    break;
+                }
+                done += ret;
+            }
+        }
+    }
+
+    if (ok && sync) {
+        Op op{IORING_OP_FSYNC};
+        op.fd = fd;
+        ok = run({op})[0] == 0;
+    }
+    return close(fd) == 0 && ok;
+}
+
+/**
+ * flush a file to the disk
+ *
+ * @param path of the file (or of a folder, to flush its entries)
+ * @return false if a error occurred
+ */
+bool IoRing::sync_file(const std::string &path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    Op op{IORING_OP_FSYNC};
+    op.fd = fd;
+    bool ok = run({op})[0] == 0;
+    return close(fd) == 0 && ok;
+}
+
+/**
+ * @param from path of a file
+ * @param to its new path, replaced if it exists
+ * @return false if a error occurred
+ */
+bool IoRing::rename(const std::string &from, const std::string &to) {
+    Op op{IORING_OP_RENAMEAT};
+    op.addr = from.c_str();
+    op.addr2 = to.c_str();
+    return run({op})[0] == 0;
+}
+
+/**
+ * compute the digest of a file reading it in the registered buffers: half of them are read while the other half
+ * is hashed
+ *
+ * @param path of the file
+ * @param algorithm of the digest
+ * @return the digest, a empty optional if the file can't be read or the buffers are not registered
+ */
+std::optional<std::string> IoRing::digest_file(const std::string &path, digest::Algorithm algorithm) {
+    // without buffers acquire_buffers would wait forever
+    if (!fixed_reads_)
+        return {};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return {};
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return {};
+    }
+    auto size = static_cast<std::uint64_t>(st.st_size);
+
+    const std::size_t group = IO_RING_DEPTH / 2;
+    std::vector<int> indexes = acquire_buffers(2 * group);
+    digest::Hasher hasher(algorithm);
+    std::uint64_t next = 0;     // offset of the next read
+
+    // reads of the next parts of the file in the buffers of a group
+    auto read_group = [&](std::size_t g) {
+        std::vector<Op> ops;
+        for (std::size_t i = 0; i < group && next < size; i++) {
+            Op op{IORING_OP_READ_FIXED};
+            op.fd = fd;
+            op.buf_index = indexes[g * group + i];
+            op.addr = buffers_[op.buf_index];
+            op.len = static_cast<std::uint32_t>(std::min<std::uint64_t>(IO_RING_BUFFER_SIZE, size - next));
+            op.offset = next;
+            ops.push_back(op);
+            next += op.len;
+        }
+        auto batch = std::make_unique<Batch>(std::move(ops));
+        submit(*batch);
+        return batch;
+    };
+
+    bool ok = true;
+    std::unique_ptr<Batch> batches[2] = {read_group(0), read_group(1)};
+    for (std::size_t g = 0; !batches[g]->ops.empty(); g = 1 - g) {
+        Batch &batch = *batches[g];
+        wait(batch);
+        for (std::size_t i = 0; ok && i < batch.ops.size(); i++) {
+            const Op &op = batch.ops[i];
+            char *buffer = buffers_[op.buf_index];
+            if (batch.results[i] < 0) {
+                ok = false;
+                break;
+            }
+            // a short read is completed with pread
+            for (std::size_t done = batch.results[i]; done < op.len;) {
+                ssize_t ret = pread(fd, buffer + done, op.len - done, static_cast<off_t>(op.offset + done));
+                if (ret <= 0) {
+                    ok = false;
+                    break;
+                }
+                done += ret;
+            }
+            if (ok)
+                hasher.update(buffer, op.len);
+        }
+        if (!ok) {
+            // the other group must complete before its buffers are released
+            wait(*batches[1 - g]);
+            break;
+        }
+        batches[g] = read_group(g);
+    }
+
+    release_buffers(indexes);
+    if (close(fd) != 0 || !ok)
+        return {};
+    return hasher.final();
+}
+
+#else
+
+// without the header of io_uring the storage uses only the POSIX functions
+
+struct IoRing::Batch {};
+
+IoRing::IoRing() : error_("built without the header of io_uring") {}
+
+bool IoRing::write_file(const std::string &, const char *, std::size_t, bool) {
+    return false;
+}
+
+bool IoRing::sync_file(const std::string &) {
+    return false;
+}
+
+bool IoRing::rename(const std::string &, const std::string &) {
+    return false;
+}
+
+std::optional<std::string> IoRing::digest_file(const std::string &, digest::Algorithm) {
+    return {};
+}
+
+#endif
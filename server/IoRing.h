@@ -0,0 +1,119 @@
+#ifndef SERVER_PROGETTO_IORING_H
+#define SERVER_PROGETTO_IORING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "digest.h"
+
+// entries of the submission queue, shared by all the threads
+#define IO_RING_ENTRIES 256
+// buffers registered in the kernel, used by the reads
+#define IO_RING_BUFFERS 32
+#define IO_RING_BUFFER_SIZE (256 * 1024)
+// reads or writes of a file in flight at the same time
+#define IO_RING_DEPTH 8
+
+//singleton, the storage operations of the server (open, write, fsync, rename, close and the reads of the digests)
+//through an io_uring ring, set up with the raw system calls. The threads that call it add their operations to the
+//same submission queue: a thread submits the operations of all the threads added until then with a single system
+//call. One of the threads waiting for their operations waits in the kernel and collects the completions of all of
+//them (most of the operations on the page cache are already completed when the submission returns).
+//If the kernel doesn't support io_uring (or one of the operations) available() is false and the caller uses the
+//POSIX functions. If only the buffers can't be registered (they are pinned memory, limited by RLIMIT_MEMLOCK) the
+//ring is still used for the writes and the renames, fixed_reads() is false and the digests use the POSIX reads
+class IoRing {
+    IoRing();
+
+    // an operation of a batch
+    struct Op {
+        std::uint8_t opcode;
+        int fd = -1;
+        const void *addr = nullptr;
+        std::uint32_t len = 0;
+        std::uint64_t offset = 0;
+        const void *addr2 = nullptr;    // new path of a rename
+        int flags = 0;                  // of an open
+        int buf_index = -1;             // registered buffer of a fixed read
+    };
+
+    // operations submitted together, the thread waits for all of them
+    struct Batch;
+
+    int fd_ = -1;
+    bool available_ = false;
+    bool fixed_reads_ = false;
+    std::string error_;             // why the ring or its buffers can't be used
+
+    // submission queue, mapped from the kernel
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_mask_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+    struct io_uring_sqe *sqes_ = nullptr;
+    unsigned tail_ = 0;             // operations added
+    unsigned submitted_ = 0;        // operations passed to the kernel
+    bool submitting_ = false;       // a thread is in io_uring_enter
+    std::mutex sq_m_;
+    std::condition_variable sq_cv_;
+
+    // completion queue, mapped from the kernel
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned *cq_mask_ = nullptr;
+    struct io_uring_cqe *cqes_ = nullptr;
+    bool reaping_ = false;          // a thread waits for the completions in io_uring_enter
+    std::mutex cq_m_;               // also of the results of the batches
+    std::condition_variable cq_cv_;
+
+    // registered buffers
+    std::vector<char *> buffers_;
+    std::vector<int> free_buffers_;
+    std::mutex buffers_m_;
+    std::condition_variable buffers_cv_;
+
+    std::atomic<std::uint64_t> enters_{0};
+    std::atomic<std::uint64_t> operations_{0};
+
+    bool setup();
+    bool register_buffers();
+    void submit(Batch &batch);
+    void flush(std::unique_lock<std::mutex> &ul);
+    void collect();
+    void wait(Batch &batch);
+    std::vector<int> run(const std::vector<Op> &ops);
+    std::vector<int> acquire_buffers(std::size_t n);
+    void release_buffers(const std::vector<int> &indexes);
+    int open(const std::string &path, int flags);
+    int close(int fd);
+
+public:
+    static IoRing* instance;
+    static std::once_flag inited;
+
+    static IoRing *getInstance();
+
+    bool available() const;
+    bool fixed_reads() const;
+    const std::string &error() const;
+
+    bool write_file(const std::string &path, const char *data, std::size_t n, bool sync);
+    bool sync_file(const std::string &path);
+    bool rename(const std::string &from, const std::string &to);
+    std::optional<std::string> digest_file(const std::string &path, digest::Algorithm algorithm);
+
+    std::uint64_t enters() const;
+    std::uint64_t operations() const;
+
+    IoRing(const IoRing&)= delete;
+    IoRing& operator=(const IoRing&)= delete;
+};
+
+
+#endif //SERVER_PROGETTO_IORING_H
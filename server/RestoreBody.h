@@ -0,0 +1,66 @@
+#ifndef SERVER_PROGETTO_RESTOREBODY_H
+#define SERVER_PROGETTO_RESTOREBODY_H
+
+#include <memory>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include "storage.h"
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace http = beast::http;           // from <boost/beast/http.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
+
+// size of the blocks read from the stored file while it is sent
+#define RESTORE_BLOCK_SIZE (64 * 1024)
+
+// Body of the response with a file of the backup (GET /backup/{path}): the original content is read in blocks
+// while it is sent, a compressed file is decompressed one frame at a time
+struct RestoreBody {
+
+    using value_type = StoredFile;
+
+    static std::uint64_t size(const value_type &body) {
+        return body.size();
+    }
+
+    class writer {
+        value_type &body_;
+        std::uint64_t remain_ = 0;
+        std::unique_ptr<char[]> buf_;
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template<bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields> &, value_type &body)
+                : body_(body), buf_(new char[RESTORE_BLOCK_SIZE]) {
+        }
+
+        void init(beast::error_code &ec) {
+            body_.seek(0);
+            remain_ = body_.size();
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code &ec) {
+            std::size_t amount = remain_ > RESTORE_BLOCK_SIZE ? RESTORE_BLOCK_SIZE : static_cast<std::size_t>(remain_);
+            if (amount == 0) {
+                ec = {};
+                return boost::none;
+            }
+
+            std::size_t n = body_.read(buf_.get(), amount);
+            if (n < amount) {
+                // the Content-Length can't be respected anymore, the connection is closed
+                ec = beast::errc::make_error_code(beast::errc::io_error);
+                return boost::none;
+            }
+
+            remain_ -= n;
+            return {{const_buffers_type{buf_.get(), n}, remain_ > 0}};
+        }
+    };
+};
+
+#endif //SERVER_PROGETTO_RESTOREBODY_H
@@ -1,11 +1,23 @@
 #include "Session.h"
+#include "configuration.h"
+
+/**
+ * @param req request
+ * @return true if the request is on the account of the user (it uses only the database), false if it is on the
+ * files of the backup
+ */
+static bool is_account_request(const http::request<http::string_body> &req) {
+    beast::string_view target = req.target();
+    return target.starts_with("/login") || target.starts_with("/logout") || target.starts_with("/refresh");
+}
 
 // Take ownership of the stream
 Session::Session(tcp::socket &&socket)
         : stream_(std::move(socket)), lambda_(*this)
 {
-    // Maximize the body size limit
-    parser.body_limit((std::numeric_limits<std::uint64_t>::max)());
+    // Each read fills at most the free space of the buffer (at least 512 bytes),
+    // so a bigger buffer means fewer reads for the body of uploads
+    buffer_.reserve(64 * 1024);
 }
 
 Session::~Session(){
@@ -26,29 +38,136 @@ void Session::run() {
 void Session::do_read() {
     // Make the request empty before reading,
     req_ = {};
-    // Set the timeout.
+    // A new parser for each request
+    header_parser_.emplace();
+    // The Content-Length is checked against the limit of the body type chosen after the header
+    header_parser_->body_limit((std::numeric_limits<std::uint64_t>::max)());
+    parser_.reset();
+    upload_parser_.reset();
+
+    // Set the timeout: after the first request, this is how long an idle connection is kept open
+    if (served_ == 0)
+        stream_.expires_after(std::chrono::seconds(60));
+    else
+        stream_.expires_after(std::chrono::seconds(configuration::keepalive_timeout));
+
+    // Read the header of a request
+    http::async_read_header(stream_, buffer_, *header_parser_,
+                            beast::bind_front_handler(&Session::on_read_header,shared_from_this()));
+}
+
+void Session::on_read_header(beast::error_code ec, std::size_t bytes_transferred) {
+    // The client closed the connection or it was idle for too long
+    if(ec == http::error::end_of_stream || (ec == beast::error::timeout && served_ > 0))
+        return do_close();
+
+    if(ec)
+        return fail(ec, "read");
+
+    if(is_stream_upload(header_parser_->get())) {
+        // The body is written in a temporary file while it is received
+        upload_parser_.emplace(std::move(*header_parser_));
+        upload_parser_->body_limit((std::numeric_limits<std::uint64_t>::max)());
+
+        // If the upload is refused the body is not read, so the connection can't be used again
+        keep_alive_ = false;
+        // The token, the path and the temporary file are checked and opened in a worker thread (disk and
+        // database), then the body is read by the strand of the session. Nothing else uses the session meanwhile
+        WorkerPool::disk()->post([self = shared_from_this()]() {
+            std::optional<Upload> upload = open_upload(self->upload_parser_->get(), self->lambda_);
+            if(!upload)
+                return;
+            self->upload_ = std::move(upload.value());
+
+            net::dispatch(self->stream_.get_executor(),
+                          beast::bind_front_handler(&Session::do_read_upload, self));
+        });
+        return;
+    }
+
+    // The body is kept in memory, up to body_limit bytes
+    parser_.emplace(std::move(*header_parser_));
+    parser_->body_limit(configuration::body_limit);
+    if(parser_->content_length().value_or(0) > configuration::body_limit)
+        return fail(http::error::body_limit, "read");
+
+    // Set the timeout for the body.
     stream_.expires_after(std::chrono::seconds(60));
 
-    // Read a request
-    http::async_read(stream_, buffer_, parser,
+    // Read the body of the request
+    http::async_read(stream_, buffer_, *parser_,
                      beast::bind_front_handler(&Session::on_read,shared_from_this()));
 }
 
 void Session::on_read(beast::error_code ec, std::size_t bytes_transferred) {
-    req_ = parser.get();
-
     if(ec)
         return fail(ec, "read");
 
-    // Generate and send the response
-    handle_request(std::move(req_), lambda_);
+    req_ = parser_->release();
+
+    served_++;
+    keep_alive_ = req_.keep_alive() && served_ < configuration::keepalive_max;
+
+    // Generate the response in a worker thread, it is sent by the strand of the session
+    WorkerPool *pool = is_account_request(req_) ? WorkerPool::database() : WorkerPool::disk();
+    pool->post([self = shared_from_this(), req = std::move(req_)]() mutable {
+        handle_request(std::move(req), self->lambda_);
+    });
+}
+
+void Session::do_read_upload() {
+    // An empty body (Content-Length: 0) is complete with the header, there is nothing to wait for
+    if(upload_parser_->is_done())
+        return on_read_upload({}, 0);
+
+    // The timeout is reset at each part of the body, so a big file can take more than 60 seconds
+    stream_.expires_after(std::chrono::seconds(60));
+
+    // Read a part of the body and write it in the file
+    http::async_read_some(stream_, buffer_, *upload_parser_,
+                          beast::bind_front_handler(&Session::on_read_upload,shared_from_this()));
+}
+
+void Session::on_read_upload(beast::error_code ec, std::size_t bytes_transferred) {
+    if(ec) {
+        upload_parser_->get().body().close();
+        discard_upload(upload_);
+        if(ec == beast::errc::illegal_byte_sequence) {
+            // the compressed body is not valid: the rest of the body is not read, the connection is closed
+            keep_alive_ = false;
+            http::response<http::string_body> res{http::status::bad_request, upload_parser_->get().version(),
+                                                  "Bad compressed body"};
+            res.set(http::field::content_type, "text/plain");
+            return lambda_(std::move(res));
+        }
+        return fail(ec, "read");
+    }
+
+    if(!upload_parser_->is_done())
+        return do_read_upload();
+
+    served_++;
+    keep_alive_ = upload_parser_->get().keep_alive() && served_ < configuration::keepalive_max;
+
+    // Move the file in place (in a worker thread, the digest of the file is computed) and send the response
+    WorkerPool::disk()->post([self = shared_from_this(), req = upload_parser_->release()]() mutable {
+        handle_upload(std::move(req), self->upload_, self->lambda_);
+    });
 }
 
 void Session::on_write(bool close, beast::error_code ec, std::size_t bytes_transferred) {
     if(ec)
-        fail(ec, "write");
+        return fail(ec, "write");
 
+    // The response says that the connection must be closed
+    if(close)
+        return do_close();
+
+    // Read another request on the same connection
+    do_read();
+}
+
+void Session::do_close() {
     // Now the Session object is destroyed (no more shared_pointer)
     // the connection is closed in ~Session
 }
-
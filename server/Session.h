@@ -2,6 +2,7 @@
 #define SERVER_PROGETTO_SESSION_H
 
 #include "server.h"
+#include "WorkerPool.h"
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
@@ -23,21 +24,39 @@ class Session : public std::enable_shared_from_this<Session>{
             // the async operation so we use a shared_ptr to manage it.
             auto sp = std::make_shared<http::message<isRequest, Body, Fields>>(std::move(msg));
 
-            // Store the shared pointer in the class to keep it alive with the Session object.
-            self_.res_ = sp;
+            // Keep the connection open only if the client asked for it and the request cap is not reached
+            sp->keep_alive(self_.keep_alive_);
+            // The body must be delimited by Content-Length (not by EOF) to keep the connection open
+            sp->prepare_payload();
 
-            // Write the response
-            http::async_write(self_.stream_, *sp,
-                    beast::bind_front_handler(&Session::on_write, self_.shared_from_this(), sp->need_eof()));
+            // The response can be created by a worker thread: it is written by the strand of the session
+            net::dispatch(self_.stream_.get_executor(), [self = self_.shared_from_this(), sp]() {
+                // Store the shared pointer in the class to keep it alive with the Session object.
+                self->res_ = sp;
+
+                // The time spent by the workers doesn't count in the timeout of the write
+                self->stream_.expires_after(std::chrono::seconds(60));
+
+                // Write the response
+                http::async_write(self->stream_, *sp,
+                        beast::bind_front_handler(&Session::on_write, self, sp->need_eof()));
+            });
         }
     };
 
     beast::tcp_stream stream_;
     beast::flat_buffer buffer_;
     http::request<http::string_body> req_;
-    http::request_parser<http::string_body> parser;
+    // a new parser is needed for each request read on the connection:
+    // the header is read first, then the body is read in memory or in a file
+    std::optional<http::request_parser<http::empty_body>> header_parser_;
+    std::optional<http::request_parser<http::string_body>> parser_;
+    std::optional<http::request_parser<UploadBody>> upload_parser_;
+    Upload upload_;
     std::shared_ptr<void> res_;
     SendLambda lambda_;
+    int served_ = 0; // number of requests received on the connection
+    bool keep_alive_ = false;
 
 public:
 
@@ -46,8 +65,12 @@ public:
 
     void run();
     void do_read();
+    void on_read_header(beast::error_code ec, std::size_t bytes_transferred);
     void on_read(beast::error_code ec, std::size_t bytes_transferred);
+    void do_read_upload();
+    void on_read_upload(beast::error_code ec, std::size_t bytes_transferred);
     void on_write(bool close, beast::error_code ec, std::size_t bytes_transferred);
+    void do_close();
 };
 
 #endif //SERVER_PROGETTO_SESSION_H
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include <functional>
+
+#include "TokenCache.h"
+
+TokenCache* TokenCache::instance = nullptr;
+std::once_flag TokenCache::inited;
+
+TokenCache *TokenCache::getInstance() {
+
+    std::call_once(inited, []() {
+        instance = new TokenCache;
+    });
+
+    return instance;
+}
+
+/**
+ * @param token authentication token
+ * @return the shard where the token is saved
+ */
+TokenCache::Shard &TokenCache::shard_of(const std::string &token) {
+    return shards_[std::hash<std::string>{}(token) % TOKEN_CACHE_SHARDS];
+}
+
+/**
+ * look for the user of a token, without querying the database
+ *
+ * @param token authentication token
+ * @return the username, a empty optional if the token is not in the cache (or it expired)
+ */
+std::optional<std::string> TokenCache::lookup(const std::string &token) {
+    Shard &shard = shard_of(token);
+    {
+        std::shared_lock sl(shard.m);
+        auto it = shard.tokens.find(token);
+        if (it != shard.tokens.end() && it->second.expire > std::chrono::steady_clock::now()) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return it->second.user;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return {};
+}
+
+/**
+ * @return the current generation, to be read before querying the database for a token not in the cache
+ */
+std::uint64_t TokenCache::generation() const {
+    return generation_.load();
+}
+
+/**
+ * save the user of a token read from the database
+ *
+ * @param token authentication token
+ * @param user username of the token
+ * @param generation read before the query: if a token was invalidated in the meantime the user could be stale
+ * and it is not saved
+ */
+void TokenCache::insert(const std::string &token, const std::string &user, std::uint64_t generation) {
+    Shard &shard = shard_of(token);
+    std::unique_lock ul(shard.m);
+    if (generation_.load() != generation)
+        return;
+    shard.tokens[token] = Entry{user, std::chrono::steady_clock::now() + std::chrono::seconds(TOKEN_CACHE_TTL)};
+}
+
+/**
+ * remove the tokens of a user, after its token was changed or deleted in the database
+ *
+ * @param user username
+ */
+void TokenCache::invalidate_user(const std::string &user) {
+    generation_++;
+    for (Shard &shard: shards_) {
+        std::unique_lock ul(shard.m);
+        for (auto it = shard.tokens.begin(); it != shard.tokens.end();) {
+            if (it->second.user == user)
+                it = shard.tokens.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+/**
+ * remove all the tokens, after all the tokens were deleted in the database
+ */
+void TokenCache::clear() {
+    generation_++;
+    for (Shard &shard: shards_) {
+        std::unique_lock ul(shard.m);
+        shard.tokens.clear();
+    }
+}
+
+std::uint64_t TokenCache::hits() const {
+    return hits_.load();
+}
+
+std::uint64_t TokenCache::misses() const {
+    return misses_.load();
+}
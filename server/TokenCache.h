@@ -0,0 +1,62 @@
+#ifndef SERVER_PROGETTO_TOKENCACHE_H
+#define SERVER_PROGETTO_TOKENCACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// number of independent parts of the cache, each one with its lock
+#define TOKEN_CACHE_SHARDS 16
+// seconds a token is kept in the cache: a token removed from the database by another process is accepted at most
+// for this time (the changes made by the server itself remove it at once)
+#define TOKEN_CACHE_TTL 60
+
+//singleton, the users of the tokens recently verified, so the requests of a logged user don't query the database.
+//The tokens are split in shards by hash: a lookup takes only the shared lock of its shard
+class TokenCache {
+    TokenCache() = default;
+
+    struct Entry {
+        std::string user;
+        std::chrono::steady_clock::time_point expire;
+    };
+
+    struct Shard {
+        std::shared_mutex m;
+        std::unordered_map<std::string, Entry> tokens;
+    };
+
+    Shard shards_[TOKEN_CACHE_SHARDS];
+    // incremented at each invalidation, a user read from the database before it is not cached
+    std::atomic<std::uint64_t> generation_{0};
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+
+    Shard &shard_of(const std::string &token);
+
+public:
+    static TokenCache* instance;
+    static std::once_flag inited;
+
+    static TokenCache *getInstance();
+
+    std::optional<std::string> lookup(const std::string &token);
+    std::uint64_t generation() const;
+    void insert(const std::string &token, const std::string &user, std::uint64_t generation);
+    void invalidate_user(const std::string &user);
+    void clear();
+
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+
+    TokenCache(const TokenCache&)= delete;
+    TokenCache& operator=(const TokenCache&)= delete;
+};
+
+
+#endif //SERVER_PROGETTO_TOKENCACHE_H
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include "TokenSigner.h"
+#include "dao.h"
+
+TokenSigner* TokenSigner::instance = nullptr;
+std::once_flag TokenSigner::inited;
+
+TokenSigner *TokenSigner::getInstance() {
+
+    std::call_once(inited, []() {
+        instance = new TokenSigner;
+    });
+
+    return instance;
+}
+
+static std::string to_hex(const unsigned char *data, std::size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * len, 0);
+    for (std::size_t i = 0; i < len; i++) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0xf];
+    }
+    return hex;
+}
+
+static std::optional<std::string> from_hex(const std::string &hex) {
+    auto value = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    if (hex.size() % 2 != 0)
+        return {};
+    std::string data(hex.size() / 2, 0);
+    for (std::size_t i = 0; i < data.size(); i++) {
+        int high = value(hex[2 * i]), low = value(hex[2 * i + 1]);
+        if (high < 0 || low < 0)
+            return {};
+        data[i] = static_cast<char>(high << 4 | low);
+    }
+    return data;
+}
+
+static std::int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @param secret key of the HMAC
+ * @param data signed part of a token
+ * @return the HMAC-SHA256 (32 bytes)
+ */
+static std::string mac_of(const std::string &secret, const std::string &data) {
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_len = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+         reinterpret_cast<const unsigned char *>(data.data()), data.size(), mac, &mac_len);
+    return std::string(reinterpret_cast<char *>(mac), mac_len);
+}
+
+/**
+ * load the keys that sign the tokens, replacing the ones loaded before. The file has a key for each line:
+ *   kid secret
+ * with kid made of letters, digits, '-' and '_', and the secret in hexadecimal (at least TOKEN_KEY_MIN_SIZE bytes);
+ * empty lines and lines starting with '#' are ignored
+ *
+ * @param key_file path of the key file, empty to sign with a random key (the tokens are not valid anymore
+ * after a restart)
+ * @return false if the file can't be read or is not valid, the keys loaded before are kept
+ */
+bool TokenSigner::load_keys(const std::string &key_file) {
+    std::vector<Key> keys;
+
+    if (key_file.empty()) {
+        unsigned char secret[32];
+        if (RAND_bytes(secret, sizeof(secret)) != 1)
+            return false;
+        keys.push_back(Key{"0", std::string(reinterpret_cast<char *>(secret), sizeof(secret))});
+    } else {
+        std::ifstream file(key_file);
+        if (!file) {
+            std::cerr << "Can't open the key file " << key_file << std::endl;
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string kid, secret_hex;
+            if (!(fields >> kid) || kid[0] == '#')
+                continue;
+            fields >> secret_hex;
+
+            bool valid_kid = true;
+            for (char c: kid)
+                valid_kid = valid_kid && (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_');
+            std::optional<std::string> secret = from_hex(secret_hex);
+            if (!valid_kid || !secret || secret->size() < TOKEN_KEY_MIN_SIZE) {
+                std::cerr << "Bad key in the key file: " << kid << std::endl;
+                return false;
+            }
+            keys.push_back(Key{kid, std::move(secret.value())});
+        }
+        if (keys.empty()) {
+            std::cerr << "No key in the key file " << key_file << std::endl;
+            return false;
+        }
+    }
+
+    std::unique_lock ul(keys_m_);
+    keys_ = std::move(keys);
+    return true;
+}
+
+/**
+ * create a token for a user, signed with the current key
+ *
+ * @param user username
+ * @param lifetime seconds the token is valid
+ * @return the token
+ */
+std::string TokenSigner::sign(const std::string &user, int lifetime) {
+    unsigned char nonce[TOKEN_NONCE_SIZE];
+    RAND_bytes(nonce, TOKEN_NONCE_SIZE);
+
+    std::shared_lock sl(keys_m_);
+    const Key &key = keys_.front();
+    std::string token = key.kid + "." + to_hex(reinterpret_cast<const unsigned char *>(user.data()), user.size()) +
+                        "." + std::to_string(now_seconds() + lifetime) + "." + to_hex(nonce, TOKEN_NONCE_SIZE);
+    std::string mac = mac_of(key.secret, token);
+    return token + "." + to_hex(reinterpret_cast<const unsigned char *>(mac.data()), mac.size());
+}
+
+/**
+ * check the signature and the expiry of a token, without the revocation list
+ *
+ * @param token the token
+ * @param mac where the mac (in hexadecimal) of the token is saved
+ * @param expiry where the expiry of the token is saved
+ * @return the username, a empty optional if the token is not valid
+ */
+std::optional<std::string> TokenSigner::check(const std::string &token, std::string &mac, std::int64_t &expiry) {
+    // kid.username.expiry.nonce.mac
+    std::size_t dots[4];
+    std::size_t pos = 0;
+    for (std::size_t &dot: dots) {
+        dot = token.find('.', pos);
+        if (dot == std::string::npos)
+            return {};
+        pos = dot + 1;
+    }
+    std::string kid = token.substr(0, dots[0]);
+    std::string signed_part = token.substr(0, dots[3]);
+    std::optional<std::string> received = from_hex(token.substr(dots[3] + 1));
+    if (!received || received->size() != 32)
+        return {};
+
+    const char *expiry_begin = token.data() + dots[1] + 1, *expiry_end = token.data() + dots[2];
+    auto [end, ec] = std::from_chars(expiry_begin, expiry_end, expiry);
+    if (ec != std::errc() || end != expiry_end || expiry < now_seconds())
+        return {};
+
+    {
+        std::shared_lock sl(keys_m_);
+        auto key = std::find_if(keys_.begin(), keys_.end(), [&kid](const Key &k) { return k.kid == kid; });
+        if (key == keys_.end())
+            return {};
+        std::string expected = mac_of(key->secret, signed_part);
+        if (CRYPTO_memcmp(expected.data(), received->data(), expected.size()) != 0)
+            return {};
+    }
+
+    // lowercase, so the same token can't be written in another way
+    mac = to_hex(reinterpret_cast<const unsigned char *>(received->data()), received->size());
+    return from_hex(token.substr(dots[0] + 1, dots[1] - dots[0] - 1));
+}
+
+/**
+ * read the revocations saved in the database after the last read (all of them the first time), the expired ones
+ * are removed from the list
+ */
+void TokenSigner::load_revoked() {
+    std::int64_t now = now_seconds();
+    refreshed_ = now;
+
+    std::int64_t after;
+    {
+        std::shared_lock sl(revoked_m_);
+        after = last_revoked_;
+    }
+    // the verifications don't wait for the database
+    std::vector<RevokedToken> tokens = Dao::getInstance()->getRevokedTokens(after, now);
+
+    std::unique_lock ul(revoked_m_);
+    for (auto it = revoked_.begin(); it != revoked_.end();) {
+        if (it->second < now)
+            it = revoked_.erase(it);
+        else
+            ++it;
+    }
+    for (RevokedToken &token: tokens) {
+        revoked_[token.mac] = token.expiry;
+        last_revoked_ = std::max(last_revoked_, token.id);
+    }
+}
+
+/**
+ * verify a token
+ *
+ * @param token the token
+ * @return the username, a empty optional if the signature is not valid, the token expired or it was revoked
+ */
+std::optional<std::string> TokenSigner::verify(const std::string &token) {
+    std::string mac;
+    std::int64_t expiry;
+    std::optional<std::string> user = check(token, mac, expiry);
+    if (!user)
+        return {};
+
+    // only one thread reads the revocations of the other processes, the others use the list as it is
+    std::int64_t refreshed = refreshed_, now = now_seconds();
+    if (now - refreshed >= TOKEN_REVOKED_REFRESH && refreshed_.compare_exchange_strong(refreshed, now))
+        load_revoked();
+
+    std::shared_lock sl(revoked_m_);
+    if (revoked_.count(mac) > 0)
+        return {};
+    return user;
+}
+
+/**
+ * revoke a token (at the logout) until it expires, for all the processes using the database
+ *
+ * @param token the token
+ * @return false if the token was not valid or the revocation can't be saved
+ */
+bool TokenSigner::revoke(const std::string &token) {
+    std::string mac;
+    std::int64_t expiry;
+    if (!check(token, mac, expiry))
+        return false;
+
+    bool saved = Dao::getInstance()->revokeToken(mac, expiry, now_seconds());
+    // the token is not accepted anymore by this process even if it can't be saved
+    std::unique_lock ul(revoked_m_);
+    revoked_[mac] = expiry;
+    return saved;
+}
@@ -0,0 +1,66 @@
+#ifndef SERVER_PROGETTO_TOKENSIGNER_H
+#define SERVER_PROGETTO_TOKENSIGNER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// header of the login response with the seconds the token is valid
+#define TOKEN_LIFETIME_HEADER "Token-Lifetime"
+// minimum size in bytes of a secret of the key file
+#define TOKEN_KEY_MIN_SIZE 16
+// size in bytes of the random part of a token
+#define TOKEN_NONCE_SIZE 8
+// seconds between two reads of the tokens revoked by the other processes
+#define TOKEN_REVOKED_REFRESH 5
+
+//singleton, the session tokens signed by the server: a token is
+//  kid.username.expiry.nonce.mac
+//with the username and the nonce in hexadecimal, the expiry in seconds since the epoch and the mac the
+//HMAC-SHA256 (in hexadecimal) of what precedes it with the key kid. A token is verified without the database.
+//The first key of the key file signs the new tokens, all the keys verify them: a key is rotated adding a new one
+//at the start of the file (and reloading it), the old one can be removed when its tokens expired.
+//The tokens of a logout are saved in the database until they expire and kept in a list read at the start: each
+//process reads the revocations of the others every TOKEN_REVOKED_REFRESH seconds, so a logout applies to all the
+//processes sharing the database within that time, and after a restart too
+class TokenSigner {
+    TokenSigner() = default;
+
+    struct Key {
+        std::string kid;
+        std::string secret;
+    };
+
+    std::shared_mutex keys_m_;
+    std::vector<Key> keys_;                 // the first one signs
+
+    std::shared_mutex revoked_m_;
+    std::unordered_map<std::string, std::int64_t> revoked_;     // mac of the token -> expiry
+    std::int64_t last_revoked_ = 0;                             // id of the last revocation read from the database
+    std::atomic<std::int64_t> refreshed_{0};                    // time of the last read
+
+    std::optional<std::string> check(const std::string &token, std::string &mac, std::int64_t &expiry);
+
+public:
+    static TokenSigner* instance;
+    static std::once_flag inited;
+
+    static TokenSigner *getInstance();
+
+    bool load_keys(const std::string &key_file);
+    std::string sign(const std::string &user, int lifetime);
+    std::optional<std::string> verify(const std::string &token);
+    bool revoke(const std::string &token);
+    void load_revoked();
+
+    TokenSigner(const TokenSigner&)= delete;
+    TokenSigner& operator=(const TokenSigner&)= delete;
+};
+
+
+#endif //SERVER_PROGETTO_TOKENSIGNER_H
@@ -0,0 +1,95 @@
+#ifndef SERVER_PROGETTO_UPLOADBODY_H
+#define SERVER_PROGETTO_UPLOADBODY_H
+
+#include <memory>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include "gzip.h"
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace http = beast::http;           // from <boost/beast/http.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
+
+// Body of a raw upload: it is written in a file while it is received, as with http::file_body.
+// A body sent with Content-Encoding: gzip is decompressed while it is received, so the file always contains the
+// decompressed data (the offsets of the resumable uploads refer to it)
+struct UploadBody {
+
+    class value_type {
+        beast::file file_;
+        std::unique_ptr<gzip::Inflater> inflater_;
+
+        friend struct UploadBody;
+
+    public:
+        void open(const char *path, beast::file_mode mode, beast::error_code &ec) {
+            file_.open(path, mode, ec);
+        }
+
+        beast::file &file() {
+            return file_;
+        }
+
+        bool is_open() const {
+            return file_.is_open();
+        }
+
+        void close() {
+            beast::error_code ec;
+            file_.close(ec);
+        }
+
+        // the body is compressed in gzip format
+        void decompress() {
+            inflater_ = std::make_unique<gzip::Inflater>();
+        }
+    };
+
+    class reader {
+        value_type &body_;
+
+    public:
+        template<bool isRequest, class Fields>
+        reader(http::header<isRequest, Fields> &, value_type &body)
+                : body_(body) {
+        }
+
+        void init(boost::optional<std::uint64_t> const &, beast::error_code &ec) {
+            ec = {};
+        }
+
+        template<class ConstBufferSequence>
+        std::size_t put(ConstBufferSequence const &buffers, beast::error_code &ec) {
+            std::size_t n = 0;
+            for (auto it = net::buffer_sequence_begin(buffers); it != net::buffer_sequence_end(buffers); ++it) {
+                net::const_buffer buffer = *it;
+                if (body_.inflater_) {
+                    bool ok = body_.inflater_->update(buffer.data(), buffer.size(),
+                                                      [this, &ec](const char *data, std::size_t size) {
+                                                          body_.file_.write(data, size, ec);
+                                                          return !ec;
+                                                      });
+                    if (!ok && !ec)
+                        ec = beast::errc::make_error_code(beast::errc::illegal_byte_sequence);
+                } else {
+                    body_.file_.write(buffer.data(), buffer.size(), ec);
+                }
+                if (ec)
+                    return n;
+                n += buffer.size();
+            }
+            return n;
+        }
+
+        void finish(beast::error_code &ec) {
+            // a compressed body must contain the whole stream
+            if (body_.inflater_ && !body_.inflater_->finished())
+                ec = beast::errc::make_error_code(beast::errc::illegal_byte_sequence);
+            else
+                ec = {};
+        }
+    };
+};
+
+#endif //SERVER_PROGETTO_UPLOADBODY_H
@@ -0,0 +1,64 @@
+#include "WorkerPool.h"
+#include "configuration.h"
+
+WorkerPool* WorkerPool::disk_instance = nullptr;
+WorkerPool* WorkerPool::database_instance = nullptr;
+std::once_flag WorkerPool::inited;
+
+WorkerPool::WorkerPool(std::string name, int nthreads) : name_(std::move(name)), pool_(nthreads) {}
+
+void WorkerPool::create() {
+    std::call_once(inited, []() {
+        disk_instance = new WorkerPool("Disk", configuration::disk_threads);
+        database_instance = new WorkerPool("Database", configuration::db_threads);
+    });
+}
+
+/**
+ * @return the pool of the requests on the files of the backup
+ */
+WorkerPool *WorkerPool::disk() {
+    create();
+    return disk_instance;
+}
+
+/**
+ * @return the pool of the requests on the accounts (login, logout)
+ */
+WorkerPool *WorkerPool::database() {
+    create();
+    return database_instance;
+}
+
+const std::string &WorkerPool::name() const {
+    return name_;
+}
+
+/**
+ * @return number of tasks waiting for a thread
+ */
+int WorkerPool::queue_depth() const {
+    return queued_.load();
+}
+
+/**
+ * @return max number of tasks that waited for a thread at the same time
+ */
+int WorkerPool::max_queue_depth() const {
+    return max_queued_.load();
+}
+
+/**
+ * @return number of tasks running
+ */
+int WorkerPool::running() const {
+    return running_.load();
+}
+
+/**
+ * discard the tasks not started and wait for the running ones
+ */
+void WorkerPool::stop() {
+    pool_.stop();
+    pool_.join();
+}
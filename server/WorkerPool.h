@@ -0,0 +1,65 @@
+#ifndef SERVER_PROGETTO_WORKERPOOL_H
+#define SERVER_PROGETTO_WORKERPOOL_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace net = boost::asio;            // from <boost/asio.hpp>
+
+//Threads that run the blocking work of the requests (disk and database), so the threads of the io_context only
+//read and write on the connections. There are two pools: one for the requests on the files of the backup and one
+//for the requests on the accounts; each one counts the tasks waiting for a thread
+class WorkerPool {
+    std::string name_;
+    net::thread_pool pool_;
+    std::atomic<int> queued_{0};       // tasks waiting for a thread
+    std::atomic<int> max_queued_{0};
+    std::atomic<int> running_{0};
+
+    WorkerPool(std::string name, int nthreads);
+    static void create();
+
+public:
+    static WorkerPool* disk_instance;
+    static WorkerPool* database_instance;
+    static std::once_flag inited;
+
+    static WorkerPool *disk();
+    static WorkerPool *database();
+
+    /**
+     * run a task on a thread of the pool
+     *
+     * @param task function without parameters, it can be move-only
+     */
+    template<class Task>
+    void post(Task &&task) {
+        int queued = ++queued_;
+        int max = max_queued_.load();
+        while (queued > max && !max_queued_.compare_exchange_weak(max, queued));
+
+        net::post(pool_, [this, task = std::forward<Task>(task)]() mutable {
+            queued_--;
+            running_++;
+            task();
+            running_--;
+        });
+    }
+
+    const std::string &name() const;
+    int queue_depth() const;
+    int max_queue_depth() const;
+    int running() const;
+
+    void stop();
+
+    WorkerPool(const WorkerPool&)= delete;
+    WorkerPool& operator=(const WorkerPool&)= delete;
+};
+
+
+#endif //SERVER_PROGETTO_WORKERPOOL_H
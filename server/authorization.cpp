@@ -1,18 +1,31 @@
 #include "authorization.h"
+#include "TokenCache.h"
+#include "TokenSigner.h"
 #include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
-#include <boost/beast/core/detail/base64.hpp>
 #include <iostream>
 
 #define MAX_BUF 2048
 
-namespace base64 = boost::beast::detail::base64;
-
 std::optional<std::string> verifyToken(const std::string &token) {
-    Dao *dao = Dao::getInstance();
+    // the tokens created at the login are signed, they are verified without the database
+    if (token.find('.') != std::string::npos)
+        return TokenSigner::getInstance()->verify(token);
+
+    // the others are saved in the database
+    TokenCache *cache = TokenCache::getInstance();
+
+    // the tokens already verified don't query the database
+    std::optional<std::string> opt_user = cache->lookup(token);
+    if (opt_user)
+        return opt_user;
 
-    std::optional<std::string> opt_user = dao->getUserFromToken(token);
+    Dao *dao = Dao::getInstance();
+    std::uint64_t generation = cache->generation();
+    opt_user = dao->getUserFromToken(token);
+    if (opt_user)
+        cache->insert(token, opt_user.value(), generation);
 
     return opt_user;
 };
@@ -95,20 +108,25 @@ std::string createToken(int n){
     return std::move(output);
 }
 
-bool saveTokenToUser(std::string &username, std::string &token){
-    // get dao instance
-    Dao *dao = Dao::getInstance();
-    return dao->insertTokenToUser(username, token);
+std::string createSessionToken(const std::string &username){
+    return TokenSigner::getInstance()->sign(username, configuration::token_lifetime);
 }
 
-bool logoutUser(std::string &username){
+bool logoutUser(std::string &username, const std::string &token){
+    // a signed token is valid until it expires, unless it is revoked
+    if (token.find('.') != std::string::npos)
+        return TokenSigner::getInstance()->revoke(token);
+
     // get dao instance
     Dao *dao = Dao::getInstance();
-    return dao->deleteTokenToUser(username);
+    bool deleted = dao->deleteTokenToUser(username);
+    TokenCache::getInstance()->invalidate_user(username);
+    return deleted;
 }
 
 void deleteAllTokens(){
     // get dao instance
     Dao *dao = Dao::getInstance();
     dao->deleteAllTokens();
+    TokenCache::getInstance()->clear();
 }
\ No newline at end of file
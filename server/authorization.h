@@ -17,11 +17,11 @@ bool verifyUserPassword(const std::string& username, const std::string& password
 // return a new token
 std::string createToken(int n);
 
-// save token into database
-bool saveTokenToUser(std::string &username, std::string &token);
+// return a new signed session token of the user, valid for configuration::token_lifetime seconds
+std::string createSessionToken(const std::string &username);
 
-// logout user (delete token from database)
-bool logoutUser(std::string &username);
+// logout user (revoke a signed token, or delete token from database)
+bool logoutUser(std::string &username, const std::string &token);
 
 // delete all tokens of users
 void deleteAllTokens();
@@ -1,12 +1,22 @@
-#include <openssl/evp.h>
 #include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "backup.h"
 #include "configuration.h"
+#include "chunks.h"
+#include "dao.h"
+#include "tree.h"
+#include "storage.h"
+#include "IoRing.h"
+#include "GroupCommit.h"
 
 namespace fs = std::filesystem;
 
-#define BUF_SIZE 2048
+// mutexes of the paths being replaced
+#define PATH_LOCKS 64
 
 /**
  * compute the absolute path from the username and the relative path
@@ -19,6 +29,98 @@ std::string get_abs_path(const std::string& user,const std::string& path){
     return configuration::backuppath + user + "/" + path;
 }
 
+/**
+ * read the metadata used to validate a saved digest
+ *
+ * @param abs_path absolute path of the file
+ * @return size, last write time and inode of the file (without digest), a empty optional if it isn't a regular file
+ */
+static std::optional<FileDigest> file_metadata(const std::string &abs_path) {
+    struct stat st{};
+    if (stat(abs_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return {};
+    return FileDigest{static_cast<std::uint64_t>(st.st_size),
+                      static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+                      static_cast<std::uint64_t>(st.st_ino), ""};
+}
+
+/**
+ * @param abs_path absolute path of the file
+ * @return a string that changes when the file is modified (size and last write time),
+ * a empty optional if the file doesn't exist
+ */
+std::optional<std::string> file_version(const std::string &abs_path) {
+    std::error_code ec;
+    if (!fs::is_regular_file(abs_path, ec))
+        return {};
+    std::uintmax_t size = fs::file_size(abs_path, ec);
+    if (ec)
+        return {};
+    fs::file_time_type time = fs::last_write_time(abs_path, ec);
+    if (ec)
+        return {};
+    return std::to_string(size) + "-" + std::to_string(time.time_since_epoch().count());
+}
+
+/**
+ * @param a metadata of a file
+ * @param b metadata of a file
+ * @return true if they describe the same version of the file
+ */
+static bool same_version(const FileDigest &a, const FileDigest &b) {
+    return a.size == b.size && a.mtime == b.mtime && a.inode == b.inode;
+}
+
+/**
+ * remove the saved digests of a file or of all the files in a folder
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the file/folder
+ */
+static void forget_digests(const std::string &user, std::string path) {
+    while (!path.empty() && path.back() == '/')
+        path.pop_back();
+    if (!path.empty())
+        Dao::getInstance()->deleteDigests(user, path);
+}
+
+/**
+ * create/override a file with the given data, if the current one is the expected version
+ *
+ * @param user username of the authenticated user
+ * @param path of the file to create/override
+ * @param raw_file data saved in the file (raw bytes)
+ * @param n number of bytes
+ * @param expected version of the file to replace
+ * @return save_ok if the file was saved, save_changed if the file is not the expected version (it is not replaced)
+ */
+SaveState replace_file(const std::string &user, const std::string &path, std::unique_ptr<char[]> &&raw_file,
+                       std::size_t n, const ExpectedVersion &expected) {
+
+    // the data is written in a temporary file moved in place as the uploads received in a file
+    std::string tmp_path = new_temp_path();
+    if (ring_storage()) {
+        if (!IoRing::getInstance()->write_file(tmp_path, raw_file.get(), n, false)) {
+            discard_temp(tmp_path);
+            return save_error;
+        }
+    } else {
+        std::ofstream file(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+            return save_error;
+        file.write(raw_file.get(),n);
+        file.close();
+        if(file.fail()) {
+            discard_temp(tmp_path);
+            return save_error;
+        }
+    }
+
+    // the digest is computed now, so the next probes don't need to read the file
+    return replace_file(user, path, tmp_path, expected, digest::buffer(raw_file.get(), n, digest::algorithm_sha256),
+                        digest::algorithm_sha256);
+}
+
 /**
  * create/override a file with the given data
  *
@@ -29,70 +131,246 @@ std::string get_abs_path(const std::string& user,const std::string& path){
  * @return true if file was saved, false otherwise
  */
 bool save_file(const std::string &user, const std::string &path, std::unique_ptr<char[]> &&raw_file, std::size_t n) {
+    return replace_file(user, path, std::move(raw_file), n, ExpectedVersion{}) == save_ok;
+}
 
-    std::string abs_path = get_abs_path(user, path);
+/**
+ * lock of a path while its version is checked and the file is replaced, a mutex is shared by the paths with the
+ * same hash
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the file
+ * @return the mutex of the path
+ */
+static std::mutex &path_mutex(const std::string &user, const std::string &path) {
+    static std::mutex mutexes[PATH_LOCKS];
+    return mutexes[std::hash<std::string>{}(user + "/" + path) % PATH_LOCKS];
+}
 
-    std::ofstream file(abs_path, std::ios::out | std::ios::binary | std::ios::trunc);
-    if(file.is_open()){
-        file.write(raw_file.get(),n);
-        file.close();
-        return true;
-    } else
+/**
+ * @param user username of the authenticated user
+ * @param path relative path of the file
+ * @param expected version
+ * @return true if the file in path is the expected version
+ */
+static bool is_expected_version(const std::string &user, const std::string &path, const ExpectedVersion &expected) {
+    if (!expected.base.empty() && file_version(get_abs_path(user, path)) != expected.base)
         return false;
+    if (expected.digest.empty())
+        return true;
+    if (expected.digest == "*")
+        return file_metadata(get_abs_path(user, path)).has_value();
+    return get_file_digest(user, path, expected.algorithm) == expected.digest;
 }
 
 /**
- * compute the SHA256 digest of a file
+ * move a completely received temporary file in the backup of the user, compressed if the storage is compressed.
+ * The file is replaced only if it is the expected version: the check and the rename are done with the path locked,
+ * so two uploads that expect the same version can't both replace it
  *
  * @param user username of the authenticated user
- * @param path of the file to compute the digest
- * @return the digest in hexadecimal format, a empty optional if file doesn't exist or a error occurred
+ * @param path of the file to create/override
+ * @param tmp_path temporary file with the content of the file, removed if the file is not saved
+ * @param expected version of the file to replace
+ * @param digest of the content if already known, otherwise its SHA256 is computed (the file was just written,
+ * so it is read from the cache)
+ * @param algorithm of the digest
+ * @return save_ok if the file was saved, save_changed if the file is not the expected version (it is not replaced)
  */
-std::optional<std::string> get_file_digest(const std::string &user, const std::string& path) {
-
-    std::string abs_path = get_abs_path(user,path);
+SaveState replace_file(const std::string &user, const std::string &path, const std::string &tmp_path,
+                       const ExpectedVersion &expected, std::string digest, digest::Algorithm algorithm) {
 
-    if(!fs::is_regular_file(abs_path))
-        return {};
+    std::string abs_path = get_abs_path(user, path);
+    if (!is_expected_version(user, path, expected)) {
+        // checked before the work on the content, checked again with the path locked
+        discard_temp(tmp_path);
+        return save_changed;
+    }
 
-    EVP_MD_CTX *md;
-    unsigned char md_value[EVP_MAX_MD_SIZE];
-    char hex_digest[EVP_MAX_MD_SIZE*2+1];
-    int n,i;
-    unsigned int md_len;
-    unsigned char buf[BUF_SIZE];
-    FILE * fin;
+    if (digest.empty()) {
+        algorithm = digest::algorithm_sha256;
+        digest = digest::file(tmp_path, algorithm).value_or("");
+    }
 
-    if((fin = fopen(abs_path.c_str(),"rb")) == NULL) {
-        return {};
+    // the file is compressed in another temporary file, it is kept as it is if it doesn't shrink
+    std::string stored_path = tmp_path;
+    if (configuration::store_compression > 0) {
+        std::string compressed_path = new_temp_path();
+        if (store_compressed(tmp_path, compressed_path, configuration::store_compression,
+                             configuration::store_frame_size)) {
+            discard_temp(tmp_path);
+            stored_path = compressed_path;
+        } else {
+            discard_temp(compressed_path);
+        }
     }
 
-    md = EVP_MD_CTX_new();
-    EVP_MD_CTX_init(md);
+    // the rename keeps size, last write time and inode, so they can be read from the temporary file
+    std::optional<FileDigest> meta = file_metadata(stored_path);
 
-    EVP_DigestInit(md, EVP_sha256());
+    // the content must be durable before the rename, so a crash leaves the old or the new version of the file
+    if (!GroupCommit::getInstance()->before_rename(stored_path)) {
+        discard_temp(stored_path);
+        return save_error;
+    }
 
-    while((n = fread(buf,1,BUF_SIZE,fin)) > 0)
-        EVP_DigestUpdate(md, buf,n);
+    {
+        std::lock_guard<std::mutex> lg(path_mutex(user, path));
+        if (!is_expected_version(user, path, expected)) {
+            discard_temp(stored_path);
+            return save_changed;
+        }
+        // the file is not described by a manifest anymore
+        remove_manifest(user, path);
 
-    if(EVP_DigestFinal_ex(md, md_value, &md_len) != 1) {
-        //error computing the digest
-        return {};
+        std::error_code ec;
+        // the temporary folder is in the backuppath, so the rename doesn't copy the data
+        if (ring_storage()) {
+            if (!IoRing::getInstance()->rename(stored_path, abs_path))
+                ec = std::make_error_code(std::errc::io_error);
+        } else {
+            fs::rename(stored_path, abs_path, ec);
+        }
+        if (ec) {
+            discard_temp(stored_path);
+            return save_error;
+        }
+
+        if (meta && !digest.empty()) {
+            meta->digest = digest;
+            Dao::getInstance()->saveDigest(user, path, digest::name(algorithm), meta.value());
+        }
     }
+    invalidate_tree(user, path, false);
+    // the file is in place anyway, but the request is acknowledged only if the rename is durable
+    return GroupCommit::getInstance()->after_rename(abs_path) ? save_ok : save_error;
+}
+
+/**
+ * move a completely received temporary file in the backup of the user, compressed if the storage is compressed
+ *
+ * @param user username of the authenticated user
+ * @param path of the file to create/override
+ * @param tmp_path temporary file with the content of the file
+ * @param digest of the content if already known, otherwise its SHA256 is computed
+ * @param algorithm of the digest
+ * @return true if file was saved, false otherwise
+ */
+bool save_file(const std::string &user, const std::string &path, const std::string &tmp_path, std::string digest,
+               digest::Algorithm algorithm) {
+    return replace_file(user, path, tmp_path, ExpectedVersion{}, std::move(digest), algorithm) == save_ok;
+}
+
+/**
+ * generate a unique path in the temporary folder, used to receive the content of uploads
+ *
+ * @return the absolute path of the new temporary file
+ */
+std::string new_temp_path() {
+    static std::atomic<unsigned long> counter{0};
+
+    return configuration::backuppath + TMP_DIR + std::to_string(getpid()) + "_" + std::to_string(counter++);
+}
+
+/**
+ * remove a temporary file of an upload not completed
+ *
+ * @param tmp_path path of the temporary file
+ */
+void discard_temp(const std::string &tmp_path) {
+    std::error_code ec;
+    fs::remove(tmp_path, ec);
+}
 
-    EVP_MD_CTX_free(md);
+/**
+ * get the digest of a file: the digest saved when the file was written is used if the file didn't
+ * change since then (same size, last write time and inode), otherwise it is computed again and saved.
+ * The digests of an algorithm not used before (e.g. BLAKE3 for a backup made with SHA256) are computed the first
+ * time they are requested
+ *
+ * @param user username of the authenticated user
+ * @param path of the file to compute the digest
+ * @param algorithm of the digest
+ * @return the digest in hexadecimal format, a empty optional if file doesn't exist or a error occurred
+ */
+std::optional<std::string> get_file_digest(const std::string &user, const std::string& path,
+                                           digest::Algorithm algorithm) {
 
-    //convert in hex
-    for(i = 0; i < md_len; i++)
-        sprintf(hex_digest+2*i,"%02x", md_value[i]);
+    std::string abs_path = get_abs_path(user,path);
 
-    hex_digest[md_len*2] = 0;
+    std::optional<FileDigest> meta = file_metadata(abs_path);
+    if(!meta)
+        return {};
 
-    std::string digest(hex_digest);
+    std::optional<FileDigest> saved = Dao::getInstance()->getDigest(user, path, digest::name(algorithm));
+    if(saved && same_version(saved.value(), meta.value()))
+        return saved->digest;
+
+    // a compressed file is decompressed while it is hashed
+    std::optional<std::string> digest = stored_digests({abs_path}, algorithm)[0];
+    if(!digest)
+        return {};
+
+    // save the digest only if the file didn't change while it was read
+    std::optional<FileDigest> after = file_metadata(abs_path);
+    if(after && same_version(after.value(), meta.value())) {
+        meta->digest = digest.value();
+        Dao::getInstance()->saveDigest(user, path, digest::name(algorithm), meta.value());
+    }
 
     return digest;
 }
 
+/**
+ * get the digests of many files (e.g. the files of a folder): the saved digests are used for the files that
+ * didn't change, the others are computed together by the hashing engine (multi-buffer for the small files when
+ * available, the compressed files while they are decompressed) and saved
+ *
+ * @param user username of the authenticated user
+ * @param paths of the files
+ * @param algorithm of the digests
+ * @return the digests in hexadecimal format in the same order, a empty optional for the files that don't exist
+ */
+std::vector<std::optional<std::string>> get_file_digests(const std::string &user, const std::vector<std::string> &paths,
+                                                         digest::Algorithm algorithm) {
+    Dao *dao = Dao::getInstance();
+    std::vector<std::optional<std::string>> digests(paths.size());
+
+    // the files to compute, with their position and metadata
+    std::vector<std::string> missing;
+    std::vector<std::pair<std::size_t, FileDigest>> positions;
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        std::string abs_path = get_abs_path(user, paths[i]);
+        std::optional<FileDigest> meta = file_metadata(abs_path);
+        if (!meta)
+            continue;
+        std::optional<FileDigest> saved = dao->getDigest(user, paths[i], digest::name(algorithm));
+        if (saved && same_version(saved.value(), meta.value())) {
+            digests[i] = saved->digest;
+        } else {
+            missing.push_back(abs_path);
+            positions.emplace_back(i, meta.value());
+        }
+    }
+    if (missing.empty())
+        return digests;
+
+    std::vector<std::optional<std::string>> computed = stored_digests(missing, algorithm);
+    for (std::size_t j = 0; j < missing.size(); j++) {
+        auto &[i, meta] = positions[j];
+        digests[i] = computed[j];
+        if (!computed[j])
+            continue;
+        // save the digest only if the file didn't change while it was read
+        std::optional<FileDigest> after = file_metadata(missing[j]);
+        if (after && same_version(after.value(), meta)) {
+            meta.digest = computed[j].value();
+            dao->saveDigest(user, paths[i], digest::name(algorithm), meta);
+        }
+    }
+    return digests;
+}
+
 /**
  * create a new directory
  * @param user username of the authenticated user
@@ -100,7 +378,11 @@ std::optional<std::string> get_file_digest(const std::string &user, const std::s
  * @return true if the directory was created, false otherwise
  */
 bool new_directory(const std::string& user, const std::string& path){
-    return fs::create_directory(get_abs_path(user,path));
+    remove_manifest(user, path);
+    forget_digests(user, path);
+    bool created = fs::create_directory(get_abs_path(user,path));
+    invalidate_tree(user, path, true);
+    return created;
 }
 
 /**
@@ -122,12 +404,16 @@ bool probe_directory(const std::string& user, const std::string& path, const std
 
         //check if the file is still present in the client
         if(children.count(filename)==0){
+            std::string child = path + (path.empty() || path.back() == '/' ? "" : "/") + filename;
+            remove_manifest(user, child);
+            forget_digests(user, child);
             //remove file/directory
             if (fs::is_directory(file_path)) {
                 fs::remove_all(file_path); //recursive elimination!
             } else {
                 fs::remove(file_path);
             }
+            invalidate_tree(user, child, true);
         }
     }
 
@@ -144,12 +430,16 @@ bool probe_directory(const std::string& user, const std::string& path, const std
 bool backup_delete(const std::string& user, const std::string& path){
 
     std::string abs_path = get_abs_path(user,path);
+    remove_manifest(user, path);
+    forget_digests(user, path);
 
+    bool removed = false;
     if (fs::is_directory(abs_path)){
-        return fs::remove_all(abs_path) > 0; //recursive elimination!
-    }
-    if (fs::is_regular_file(abs_path)){
-        return fs::remove(abs_path);
+        removed = fs::remove_all(abs_path) > 0; //recursive elimination!
+    } else if (fs::is_regular_file(abs_path)){
+        removed = fs::remove(abs_path);
     }
-    return false;
+    if (removed)
+        invalidate_tree(user, path, true);
+    return removed;
 }
@@ -17,14 +17,42 @@
 #include <vector>
 #include <fstream>
 #include <set>
+#include <optional>
+
+#include "digest.h"
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
 namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
+// version a file must have to be replaced (If-Match of POST /backup/{path} and POST /delta/{path}): its digest,
+// "*" if it must only exist, and for a delta the file_version it was computed from.
+// With an empty digest and base the file is replaced anyway
+struct ExpectedVersion {
+    std::string digest;
+    digest::Algorithm algorithm = digest::algorithm_sha256;
+    std::string base;
+};
+
+enum SaveState { save_ok, save_changed, save_error };
+
+std::string get_abs_path(const std::string& user,const std::string& path);
+std::optional<std::string> file_version(const std::string &abs_path);
+SaveState replace_file(const std::string &user, const std::string &path, std::unique_ptr<char []> &&raw_file,
+                       std::size_t n, const ExpectedVersion &expected);
+SaveState replace_file(const std::string &user, const std::string &path, const std::string &tmp_path,
+                       const ExpectedVersion &expected, std::string digest = "",
+                       digest::Algorithm algorithm = digest::algorithm_sha256);
 bool save_file(const std::string &user, const std::string &path, std::unique_ptr<char []> &&raw_file, std::size_t n);
-std::optional<std::string> get_file_digest(const std::string &user, const std::string& file_path);
+bool save_file(const std::string &user, const std::string &path, const std::string &tmp_path, std::string digest = "",
+               digest::Algorithm algorithm = digest::algorithm_sha256);
+std::string new_temp_path();
+void discard_temp(const std::string &tmp_path);
+std::optional<std::string> get_file_digest(const std::string &user, const std::string& file_path,
+                                           digest::Algorithm algorithm = digest::algorithm_sha256);
+std::vector<std::optional<std::string>> get_file_digests(const std::string &user, const std::vector<std::string> &paths,
+                                                         digest::Algorithm algorithm = digest::algorithm_sha256);
 bool probe_directory(const std::string& user, const std::string& path, const std::set<std::string> &children);
 bool new_directory(const std::string& user, const std::string& path);
 bool backup_delete(const std::string& user, const std::string& path);
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "chunks.h"
+#include "backup.h"
+#include "configuration.h"
+#include "storage.h"
+#include "sha256.h"
+
+namespace fs = std::filesystem;
+
+// where the content of a chunk can be read: the chunks are not stored apart,
+// they are read from the files received in chunks (listed in their manifest)
+struct ChunkLocation {
+    std::shared_ptr<const std::string> file; // absolute path of the file containing the chunk
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+static std::mutex m_chunks;
+// chunks of the files of each user: a chunk is reused only in the backup of the user that sent it, so a user can't
+// learn whether another user has a chunk or get its content naming its hash
+static std::unordered_map<std::string, std::unordered_map<std::string, ChunkLocation>> chunk_index;
+static bool index_loaded = false;
+
+/**
+ * @param user username of the authenticated user
+ * @param path relative path of the file
+ * @return the path of the manifest of the file
+ */
+static std::string manifest_path_of(const std::string &user, const std::string &path) {
+    return configuration::backuppath + MANIFESTS_DIR + user + "/" + path;
+}
+
+/**
+ * add to the index all the chunks of a manifest (m_chunks must be locked)
+ *
+ * @param user owner of the file
+ * @param file absolute path of the file described by the manifest
+ * @param manifest list of the chunks of the file
+ */
+static void index_manifest(const std::string &user, const std::string &file,
+                           const std::vector<ManifestEntry> &manifest) {
+    auto file_ptr = std::make_shared<const std::string>(file);
+    std::uint64_t offset = 0;
+    std::unordered_map<std::string, ChunkLocation> &user_index = chunk_index[user];
+
+    for (const ManifestEntry &entry: manifest) {
+        user_index[entry.hash] = ChunkLocation{file_ptr, offset, entry.size};
+        offset += entry.size;
+    }
+}
+
+/**
+ * read a manifest file, each line has the hash and the size of a chunk
+ *
+ * @param manifest_path path of the manifest
+ * @return the chunks of the file
+ */
+static std::vector<ManifestEntry> read_manifest(const std::string &manifest_path) {
+    std::vector<ManifestEntry> manifest;
+    std::ifstream in(manifest_path);
+    ManifestEntry entry{"", 0, false};
+
+    while (in >> entry.hash >> entry.size)
+        manifest.push_back(entry);
+    return manifest;
+}
+
+/**
+ * build the chunk index from the manifests saved, the first time it is needed (m_chunks must be locked)
+ */
+static void load_index() {
+    if (index_loaded)
+        return;
+    index_loaded = true;
+
+    std::string dir = configuration::backuppath + MANIFESTS_DIR;
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec))
+        return;
+
+    for (const fs::directory_entry &entry: fs::recursive_directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file())
+            continue;
+        // .manifests/user/path describes user/path
+        std::string relative = entry.path().string().substr(dir.size());
+        std::string user = relative.substr(0, relative.find('/'));
+        index_manifest(user, configuration::backuppath + relative, read_manifest(entry.path().string()));
+    }
+}
+
+/**
+ * check which chunks are not in the files of the user
+ *
+ * @param user username of the authenticated user
+ * @param hashes SHA256 of the chunks
+ * @return the hashes of the chunks that must be sent
+ */
+std::vector<std::string> missing_chunks(const std::string &user, const std::vector<std::string> &hashes) {
+    std::lock_guard lg(m_chunks);
+    load_index();
+
+    auto user_index = chunk_index.find(user);
+    std::vector<std::string> missing;
+    for (const std::string &hash: hashes) {
+        if (user_index == chunk_index.end() || user_index->second.count(hash) == 0)
+            missing.push_back(hash);
+    }
+    return missing;
+}
+
+/**
+ * build a file from its manifest: the chunks sent are read in order from the uploaded data, the others
+ * from the files of the user already on the server. Every chunk is verified with its SHA256 before being used
+ *
+ * @param user username of the authenticated user
+ * @param path of the file to create/override
+ * @param pack_path uploaded data, the concatenation of the chunks marked as sent
+ * @param manifest list of the chunks of the file
+ * @param missing filled with the chunks that the server doesn't have (anymore)
+ * @param expected version of the file to replace
+ * @return save_ok if the file was saved, save_changed if the file is not the expected version (it is not replaced)
+ */
+SaveState assemble_file(const std::string &user, const std::string &path, const std::string &pack_path,
+                        const std::vector<ManifestEntry> &manifest, std::vector<std::string> &missing,
+                        const ExpectedVersion &expected) {
+    std::string tmp_path = new_temp_path();
+    std::ofstream out(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    std::ifstream pack(pack_path, std::ios::in | std::ios::binary);
+    if (!out.is_open() || !pack.is_open()) {
+        discard_temp(tmp_path);
+        return save_error;
+    }
+
+    std::unique_ptr<char[]> buf{new char[MAX_CHUNK_SIZE]};
+    // the file from where the last chunk was read, kept open for the next chunks
+    std::string source_path;
+    StoredFile source;
+    // chunks sent in this upload, by hash, with their position in the uploaded data: a chunk repeated
+    // in the file is sent only once
+    std::unordered_map<std::string, std::uint64_t> pack_chunks;
+    std::uint64_t pack_offset = 0;
+    // digest of the whole file, computed while it is written
+    digest::Hasher hasher(digest::algorithm_sha256);
+
+    for (const ManifestEntry &entry: manifest) {
+        if (entry.size > MAX_CHUNK_SIZE) {
+            discard_temp(tmp_path);
+            return save_error;
+        }
+
+        if (entry.sent) {
+            pack.seekg(pack_offset);
+            if (!pack.read(buf.get(), entry.size) || sha256::digest(buf.get(), entry.size) != entry.hash) {
+                // the uploaded data is not what the manifest says
+                discard_temp(tmp_path);
+                return save_error;
+            }
+            pack_chunks.emplace(entry.hash, pack_offset);
+            pack_offset += entry.size;
+        } else if (pack_chunks.count(entry.hash) > 0) {
+            pack.seekg(pack_chunks[entry.hash]);
+            if (!pack.read(buf.get(), entry.size) || sha256::digest(buf.get(), entry.size) != entry.hash) {
+                discard_temp(tmp_path);
+                return save_error;
+            }
+        } else {
+            std::optional<ChunkLocation> location;
+            {
+                std::lock_guard lg(m_chunks);
+                load_index();
+                std::unordered_map<std::string, ChunkLocation> &user_index = chunk_index[user];
+                auto it = user_index.find(entry.hash);
+                if (it != user_index.end())
+                    location = it->second;
+            }
+
+            bool found = false;
+            if (location && location->size == entry.size) {
+                if (source_path != *location->file) {
+                    // a compressed file is decompressed only in the frames of the chunks read
+                    source.open(*location->file);
+                    source_path = *location->file;
+                }
+                source.seek(location->offset);
+                // the file could have been changed or removed after the manifest was saved
+                found = source.read(buf.get(), entry.size) == entry.size &&
+                        sha256::digest(buf.get(), entry.size) == entry.hash;
+            }
+            if (!found) {
+                std::lock_guard lg(m_chunks);
+                chunk_index[user].erase(entry.hash);
+                if (std::find(missing.begin(), missing.end(), entry.hash) == missing.end())
+                    missing.push_back(entry.hash);
+                continue;
+            }
+        }
+
+        out.write(buf.get(), entry.size);
+        hasher.update(buf.get(), entry.size);
+    }
+    out.close();
+
+    if (!missing.empty() || out.fail()) {
+        discard_temp(tmp_path);
+        return save_error;
+    }
+
+    SaveState state = replace_file(user, path, tmp_path, expected, hasher.final());
+    if (state != save_ok)
+        return state;
+
+    // save the manifest of the new file, its chunks can be used by the next uploads. It is written in a temporary
+    // file moved in place, so a request never reads a part of it
+    std::string manifest_path = manifest_path_of(user, path);
+    std::string manifest_tmp = new_temp_path();
+    std::error_code ec;
+    fs::create_directories(fs::path(manifest_path).parent_path(), ec);
+    std::ofstream manifest_file(manifest_tmp, std::ios::out | std::ios::trunc);
+    for (const ManifestEntry &entry: manifest)
+        manifest_file << entry.hash << " " << entry.size << "\n";
+    manifest_file.close();
+    if (manifest_file.fail())
+        discard_temp(manifest_tmp);
+    else
+        fs::rename(manifest_tmp, manifest_path, ec);
+
+    std::lock_guard lg(m_chunks);
+    load_index();
+    index_manifest(user, get_abs_path(user, path), manifest);
+    return save_ok;
+}
+
+/**
+ * remove the manifest of a file (or the manifests of the files in a folder) no more received in chunks.
+ * The chunks in the index are verified before being used, so the index doesn't need to be updated
+ *
+ * @param user username of the authenticated user
+ * @param path of the file/folder
+ */
+void remove_manifest(const std::string &user, const std::string &path) {
+    // never remove the manifests of the whole backup of the user
+    if (path.empty())
+        return;
+
+    std::error_code ec;
+    fs::remove_all(manifest_path_of(user, path), ec);
+}
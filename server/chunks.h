@@ -0,0 +1,36 @@
+#ifndef SERVER_PROGETTO_CHUNKS_H
+#define SERVER_PROGETTO_CHUNKS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "backup.h"
+
+// folder in the backuppath with the manifest of each file received in chunks
+#define MANIFESTS_DIR ".manifests/"
+
+// max size of a chunk accepted in a manifest
+#define MAX_CHUNK_SIZE (4 * 1024 * 1024)
+
+// a chunk of a file, as listed in the manifest sent by the client
+struct ManifestEntry {
+    std::string hash;   // SHA256 of the chunk
+    std::uint64_t size;
+    bool sent;          // the chunk is in the uploaded data, otherwise it is already on the server
+};
+
+// return the chunks (by hash) that the server doesn't have in the files of the user
+std::vector<std::string> missing_chunks(const std::string &user, const std::vector<std::string> &hashes);
+
+// build the file in path from the manifest, taking the chunks sent from the uploaded data (pack_path)
+// and the others from the files of the user already on the server, if the file is the expected version.
+// The chunks not found are added to missing
+SaveState assemble_file(const std::string &user, const std::string &path, const std::string &pack_path,
+                        const std::vector<ManifestEntry> &manifest, std::vector<std::string> &missing,
+                        const ExpectedVersion &expected);
+
+// remove the manifest of a file or of all the files in a folder
+void remove_manifest(const std::string &user, const std::string &path);
+
+#endif //SERVER_PROGETTO_CHUNKS_H
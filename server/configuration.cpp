@@ -3,9 +3,11 @@
 #include <boost/program_options.hpp>
 #include <pwd.h>
 #include <filesystem>
+#include <algorithm>
 
 #include "configuration.h"
 #include "dao.h"
+#include "upload.h"
 
 namespace po = boost::program_options;
 namespace fs = std::filesystem;
@@ -16,8 +18,22 @@ namespace configuration
     net::ip::address address;
     short unsigned port;
     int nthreads;
+    int disk_threads;
+    int db_threads;
+    std::string io_engine;
+    std::string durability;
+    int commit_interval;
+    int commit_files;
     std::string backuppath;
     std::string dbpath;
+    int keepalive_timeout;
+    int keepalive_max;
+    std::uint64_t body_limit;
+    int store_compression;
+    std::uint64_t store_frame_size;
+    std::string token_keys;
+    int token_lifetime;
+    int upload_expiry;
 }
 
 /**
@@ -49,8 +65,28 @@ bool configuration::load_config_file(const std::string &config_file)
             ("address", "listen socket address")
             ("port", po::value<unsigned short>(), "listen socket port")
             ("nthreads", po::value<int>(), "number of threads")
+            ("disk_threads", po::value<int>()->default_value(4), "number of threads for the work on the files")
+            ("db_threads", po::value<int>()->default_value(2), "number of threads for the work on the accounts")
+            ("io_engine", po::value<std::string>()->default_value("posix"),
+                    "functions of the storage operations: posix or uring")
+            ("durability", po::value<std::string>()->default_value("none"),
+                    "when the saved files are flushed to the disk: none, file or group")
+            ("commit_interval", po::value<int>()->default_value(20), "max ms a file waits for a group commit")
+            ("commit_files", po::value<int>()->default_value(64), "files that start a group commit")
             ("backuppath", "path where backups are stored")
             ("dbpath", "path of the database file")
+            ("keepalive_timeout", po::value<int>()->default_value(15), "seconds an idle connection is kept open")
+            ("keepalive_max", po::value<int>()->default_value(1000), "max number of requests served on a connection")
+            ("body_limit", po::value<int>()->default_value(64), "max size (MB) of a request body kept in memory")
+            ("store_compression", po::value<int>()->default_value(0),
+                    "level (1-9) of compression of the files stored, 0 to store them as they are received")
+            ("store_frame_size", po::value<int>()->default_value(1024),
+                    "size (KB) of the parts of a file compressed independently")
+            ("token_keys", po::value<std::string>()->default_value(""),
+                    "file with the keys that sign the tokens, empty to use a random key")
+            ("token_lifetime", po::value<int>()->default_value(86400), "seconds a token is valid")
+            ("upload_expiry", po::value<int>()->default_value(168),
+                    "hours a resumable upload is kept without receiving data")
             ;
 
     po::variables_map vm;
@@ -60,8 +96,28 @@ bool configuration::load_config_file(const std::string &config_file)
         configuration::address = net::ip::make_address(vm["address"].as<std::string>());
         configuration::port = vm["port"].as<unsigned short>();
         configuration::nthreads = std::max<int>(1, vm["nthreads"].as<int>());
+        configuration::disk_threads = std::max<int>(1, vm["disk_threads"].as<int>());
+        configuration::db_threads = std::max<int>(1, vm["db_threads"].as<int>());
+        configuration::io_engine = vm["io_engine"].as<std::string>();
+        if (configuration::io_engine != "posix" && configuration::io_engine != "uring")
+            throw boost::bad_any_cast();
+        configuration::durability = vm["durability"].as<std::string>();
+        if (configuration::durability != "none" && configuration::durability != "file" &&
+            configuration::durability != "group")
+            throw boost::bad_any_cast();
+        configuration::commit_interval = std::max<int>(1, vm["commit_interval"].as<int>());
+        configuration::commit_files = std::max<int>(1, vm["commit_files"].as<int>());
         configuration::backuppath = vm["backuppath"].as<std::string>();
         configuration::dbpath = vm["dbpath"].as<std::string>();
+        configuration::keepalive_timeout = std::max<int>(1, vm["keepalive_timeout"].as<int>());
+        configuration::keepalive_max = std::max<int>(1, vm["keepalive_max"].as<int>());
+        configuration::body_limit = std::max<int>(1, vm["body_limit"].as<int>()) * std::uint64_t(1024 * 1024);
+        configuration::store_compression = std::clamp<int>(vm["store_compression"].as<int>(), 0, 9);
+        configuration::store_frame_size = std::clamp<int>(vm["store_frame_size"].as<int>(), 64, 64 * 1024) *
+                                          std::uint64_t(1024);
+        configuration::token_keys = vm["token_keys"].as<std::string>();
+        configuration::token_lifetime = std::max<int>(60, vm["token_lifetime"].as<int>());
+        configuration::upload_expiry = std::max<int>(1, vm["upload_expiry"].as<int>());
 
         //add slash in the end if not present
         if(configuration::backuppath.back() != '/') {
@@ -89,6 +145,14 @@ bool configuration::prepare_environment(){
     if (users.empty())
         return false;
 
+    // uploads not completed before the last shutdown are discarded
+    std::string tmp_path = configuration::backuppath + TMP_DIR;
+    fs::remove_all(tmp_path);
+    fs::create_directory(tmp_path);
+
+    // uploads not committed can be resumed
+    load_uploads();
+
     for (const std::string& user: users){
         std::string path = configuration::backuppath + user;
 
@@ -6,13 +6,30 @@
 
 namespace net = boost::asio;
 
+// folder in the backuppath where uploads are received before being moved in place
+#define TMP_DIR ".tmp/"
+
 namespace configuration
 {
     extern net::ip::address address;
     extern short unsigned port;
     extern int nthreads;
+    extern int disk_threads;
+    extern int db_threads;
+    extern std::string io_engine;
+    extern std::string durability;
+    extern int commit_interval;
+    extern int commit_files;
     extern std::string backuppath;
     extern std::string dbpath;
+    extern int keepalive_timeout;
+    extern int keepalive_max;
+    extern std::uint64_t body_limit;
+    extern int store_compression;
+    extern std::uint64_t store_frame_size;
+    extern std::string token_keys;
+    extern int token_lifetime;
+    extern int upload_expiry;
 
     bool load_config_file(const std::string &config_file);
     bool prepare_environment();
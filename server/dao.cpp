@@ -1,7 +1,91 @@
+#include <unordered_map>
+
 #include "dao.h"
 
 Dao* Dao::instance= nullptr;
 
+// connection of a thread with the statements it prepared (by the text of the query, always a literal)
+struct ThreadConnection {
+    sqlite3 *db = nullptr;
+    std::unordered_map<const char *, sqlite3_stmt *> statements;
+
+    ~ThreadConnection() {
+        for (auto &statement: statements)
+            sqlite3_finalize(statement.second);
+        if (db != nullptr)
+            sqlite3_close(db);
+    }
+};
+
+static thread_local ThreadConnection thread_connection;
+
+Statement::Statement(sqlite3_stmt *stmt) : stmt_(stmt) {}
+
+Statement::~Statement() {
+    if (stmt_ != nullptr) {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+    }
+}
+
+sqlite3_stmt *Statement::get() const {
+    return stmt_;
+}
+
+Statement::operator bool() const {
+    return stmt_ != nullptr;
+}
+
+/**
+ * open the connection of the current thread the first time it is used.
+ * The connections don't use the mutex of sqlite (each one is used by a thread only) and wait for the lock of the
+ * database instead of failing when another connection is writing
+ *
+ * @return the connection, nullptr if it can't be opened
+ */
+sqlite3 *Dao::connection() {
+    if (thread_connection.db != nullptr)
+        return thread_connection.db;
+
+    sqlite3 *db = nullptr;
+    if( sqlite3_open_v2(configuration::dbpath.c_str(), &db,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK ){
+        std::cerr << "DB Open Error: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return nullptr;
+    }
+    sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT);
+    // in WAL mode a transaction is still atomic, only the last ones can be lost if the system crashes
+    sqlite3_exec(db, "PRAGMA synchronous=NORMAL", nullptr, nullptr, nullptr);
+
+    thread_connection.db = db;
+    return db;
+}
+
+/**
+ * get a statement from the cache of the connection of the current thread, it is prepared the first time
+ *
+ * @param sql the query, a string literal (the cache uses its address)
+ * @return the statement, empty if it can't be prepared
+ */
+Statement Dao::statement(const char *sql) {
+    sqlite3 *db = connection();
+    if (db == nullptr)
+        return Statement(nullptr);
+
+    auto it = thread_connection.statements.find(sql);
+    if (it != thread_connection.statements.end())
+        return Statement(it->second);
+
+    sqlite3_stmt *stmt = nullptr;
+    if ( sqlite3_prepare_v3( db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr ) != SQLITE_OK ){
+        sqlite3_finalize( stmt );
+        return Statement(nullptr);
+    }
+    thread_connection.statements.emplace(sql, stmt);
+    return Statement(stmt);
+}
+
 /**
  * return the username authenticated with the given token
  *
@@ -12,29 +96,24 @@ std::optional<std::string> Dao::getUserFromToken(const std::string &token) {
     if(!conn_open)
         return {};
 
-    sqlite3_stmt* stmt = nullptr;
-
-    int rc = sqlite3_prepare_v2( db, "SELECT username FROM users WHERE token = ?", -1, &stmt, 0 );
-    if ( rc != SQLITE_OK )
+    Statement stmt = statement("SELECT username FROM users WHERE token = ?");
+    int rc;
+    if ( !stmt )
         return {};
 
     //  Bind-parameter indexing is 1-based.
-    rc = sqlite3_bind_text( stmt, 1, token.c_str(), token.size(), nullptr); // Bind first parameter.
+    rc = sqlite3_bind_text( stmt.get(), 1, token.c_str(), token.size(), nullptr); // Bind first parameter.
     if ( rc != SQLITE_OK ){
-        sqlite3_finalize( stmt );
         return {};
     }
 
-    rc = sqlite3_step( stmt );
+    rc = sqlite3_step( stmt.get() );
 
     if( rc  == SQLITE_ROW ) { // if query has result-rows.
-        std::string result = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-        rc = sqlite3_finalize(stmt);
-        if (rc == SQLITE_OK)
-            return result;
+        std::string result = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+        return result;
     }
 
-    sqlite3_finalize( stmt );
     return {};
 }
 
@@ -48,29 +127,24 @@ std::optional<std::string> Dao::getPasswordFromUser(const std::string &username)
     if(!conn_open)
         return {};
 
-    sqlite3_stmt* stmt = nullptr;
-
-    int rc = sqlite3_prepare_v2( db, "SELECT hash FROM users WHERE username = ?", -1, &stmt, 0 );
-    if ( rc != SQLITE_OK )
+    Statement stmt = statement("SELECT hash FROM users WHERE username = ?");
+    int rc;
+    if ( !stmt )
         return {};
 
     //  Bind-parameter indexing is 1-based.
-    rc = sqlite3_bind_text( stmt, 1, username.c_str(), username.size(), nullptr); // Bind first parameter.
+    rc = sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr); // Bind first parameter.
     if ( rc != SQLITE_OK ){
-        sqlite3_finalize( stmt );
         return {};
     }
 
-    rc = sqlite3_step( stmt );
+    rc = sqlite3_step( stmt.get() );
 
     if( rc  == SQLITE_ROW ) { // if query has result-rows.
-        std::string result = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-        rc = sqlite3_finalize(stmt);
-        if (rc == SQLITE_OK)
-            return result;
+        std::string result = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+        return result;
     }
 
-    sqlite3_finalize( stmt );
     return {};
 }
 
@@ -85,26 +159,22 @@ bool Dao::insertTokenToUser(const std::string &username, const std::string &toke
     if(!conn_open)
         return {};
 
-    sqlite3_stmt* stmt = nullptr;
-
-    int rc = sqlite3_prepare_v2( db, "UPDATE users SET token=? WHERE username = ?", -1, &stmt, 0 );
-    if ( rc != SQLITE_OK )
+    Statement stmt = statement("UPDATE users SET token=? WHERE username = ?");
+    int rc;
+    if ( !stmt )
         return false;
 
     //  Bind-parameter indexing is 1-based.
-    rc = sqlite3_bind_text( stmt, 1, token.c_str(), token.size(), nullptr); // Bind first parameter.
+    rc = sqlite3_bind_text( stmt.get(), 1, token.c_str(), token.size(), nullptr); // Bind first parameter.
     if ( rc != SQLITE_OK ){
-        sqlite3_finalize( stmt );
         return false;
     }
-    rc = sqlite3_bind_text(stmt, 2, username.c_str(), username.size(), nullptr);  // Bind second parameter.
+    rc = sqlite3_bind_text(stmt.get(), 2, username.c_str(), username.size(), nullptr);  // Bind second parameter.
     if ( rc != SQLITE_OK ){
-        sqlite3_finalize( stmt );
         return false;
     }
 
-    rc = sqlite3_step( stmt );
-    sqlite3_finalize( stmt );
+    rc = sqlite3_step( stmt.get() );
 
     if( rc  != SQLITE_DONE ) { // if query has been executed without errors.
         return false;
@@ -121,27 +191,24 @@ bool Dao::deleteTokenToUser(const std::string &username){
     if(!conn_open)
         return {};
 
-    sqlite3_stmt* stmt = nullptr;
     std::string token;
 
-    int rc = sqlite3_prepare_v2( db, "UPDATE users SET token=? WHERE username = ?", -1, &stmt, 0 );
-    if ( rc != SQLITE_OK )
+    Statement stmt = statement("UPDATE users SET token=? WHERE username = ?");
+    int rc;
+    if ( !stmt )
         return false;
 
     //  Bind-parameter indexing is 1-based.
-    rc = sqlite3_bind_text( stmt, 1, token.c_str(), token.size(), nullptr); // Bind first parameter.
+    rc = sqlite3_bind_text( stmt.get(), 1, token.c_str(), token.size(), nullptr); // Bind first parameter.
     if ( rc != SQLITE_OK ){
-        sqlite3_finalize( stmt );
         return false;
     }
-    rc = sqlite3_bind_text( stmt, 2, username.c_str(), username.size(), nullptr);  // Bind second parameter.
+    rc = sqlite3_bind_text( stmt.get(), 2, username.c_str(), username.size(), nullptr);  // Bind second parameter.
     if ( rc != SQLITE_OK ){
-        sqlite3_finalize( stmt );
         return false;
     }
 
-    rc = sqlite3_step( stmt );
-    sqlite3_finalize( stmt );
+    rc = sqlite3_step( stmt.get() );
 
     if( rc  != SQLITE_DONE ) { // if query has been executed without errors.
         return false;
@@ -159,28 +226,21 @@ std::vector<std::string> Dao::getAllUsers(){
     if(!conn_open)
         return {};
 
-    sqlite3_stmt* stmt = nullptr;
-
-    int rc = sqlite3_prepare_v2( db, "SELECT username FROM users ", -1, &stmt, 0 );
-    if ( rc != SQLITE_OK )
+    Statement stmt = statement("SELECT username FROM users ");
+    int rc;
+    if ( !stmt )
         return {};
 
-    while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        std::string res = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    while((rc = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+        std::string res = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
         result.push_back(res);
     }
     if(rc != SQLITE_DONE) {
-        printf("ERROR: while performing sql: %s\n", sqlite3_errmsg(db));
+        printf("ERROR: while performing sql: %s\n", sqlite3_errmsg(connection()));
         printf("ret_code = %d\n", rc);
         return {};
     }
-    else {
-        rc = sqlite3_finalize(stmt);
-        if (rc == SQLITE_OK)
-            return result;
-        else
-            return {};
-    }
+    return result;
 }
 
 /**
@@ -191,44 +251,419 @@ void Dao::deleteAllTokens(){
     if(!conn_open)
         return ;
 
-    sqlite3_stmt* stmt = nullptr;
     std::string token;
 
-    int rc = sqlite3_prepare_v2( db, "UPDATE users SET token=? ", -1, &stmt, 0 );
-    if ( rc != SQLITE_OK )
+    Statement stmt = statement("UPDATE users SET token=? ");
+    int rc;
+    if ( !stmt )
         return;
 
     //  Bind-parameter indexing is 1-based.
-    rc = sqlite3_bind_text( stmt, 1, token.c_str(), token.size(), nullptr);  // Bind first parameter.
+    rc = sqlite3_bind_text( stmt.get(), 1, token.c_str(), token.size(), nullptr);  // Bind first parameter.
     if( rc != SQLITE_OK ){
-        sqlite3_finalize( stmt );
         return;
     }
 
-    rc = sqlite3_step( stmt );
+    rc = sqlite3_step( stmt.get() );
+}
+
+/**
+ * save a revoked token, so the other processes and the next start of the server know it, the expired ones are
+ * removed
+ *
+ * @param mac mac of the token (in hexadecimal)
+ * @param expiry expiry of the token in seconds since the epoch
+ * @param now current time in seconds since the epoch
+ * @return false if the token can't be saved
+ */
+bool Dao::revokeToken(const std::string &mac, std::int64_t expiry, std::int64_t now){
+    if(!conn_open)
+        return false;
+
+    {
+        Statement stmt = statement("DELETE FROM revoked_tokens WHERE expiry < ?");
+        if ( !stmt || sqlite3_bind_int64( stmt.get(), 1, now) != SQLITE_OK )
+            return false;
+        sqlite3_step( stmt.get() );
+    }
+
+    Statement stmt = statement("INSERT OR REPLACE INTO revoked_tokens (mac, expiry) VALUES (?, ?)");
+    if ( !stmt )
+        return false;
+
+    //  Bind-parameter indexing is 1-based.
+    if ( sqlite3_bind_text( stmt.get(), 1, mac.c_str(), mac.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_int64( stmt.get(), 2, expiry) != SQLITE_OK )
+        return false;
+
+    return sqlite3_step( stmt.get() ) == SQLITE_DONE;
+}
+
+/**
+ * get the revoked tokens not expired yet
+ *
+ * @param after id of the last revocation already read, 0 for all of them
+ * @param now current time in seconds since the epoch
+ * @return the revocations saved after the id, ordered by id
+ */
+std::vector<RevokedToken> Dao::getRevokedTokens(std::int64_t after, std::int64_t now){
+    std::vector<RevokedToken> result;
+    if(!conn_open)
+        return {};
+
+    Statement stmt = statement("SELECT id, mac, expiry FROM revoked_tokens WHERE id > ? AND expiry >= ? ORDER BY id");
+    if ( !stmt )
+        return {};
+
+    if ( sqlite3_bind_int64( stmt.get(), 1, after) != SQLITE_OK ||
+         sqlite3_bind_int64( stmt.get(), 2, now) != SQLITE_OK )
+        return {};
+
+    while ( sqlite3_step( stmt.get() ) == SQLITE_ROW ) {
+        result.push_back(RevokedToken{sqlite3_column_int64(stmt.get(), 0),
+                                      reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1)),
+                                      sqlite3_column_int64(stmt.get(), 2)});
+    }
+    return result;
+}
+
+/**
+ * get the digest saved for a file
+ *
+ * @param username owner of the file
+ * @param path relative path of the file
+ * @param algorithm of the digest
+ * @return the digest with the metadata of the file when it was computed, a empty optional if not present
+ */
+std::optional<FileDigest> Dao::getDigest(const std::string &username, const std::string &path,
+                                         const std::string &algorithm){
+    if(!conn_open)
+        return {};
+
+    Statement stmt = statement("SELECT size, mtime, inode, digest FROM digests WHERE username = ? AND path = ? AND algorithm = ?");
+    int rc;
+    if ( !stmt )
+        return {};
+
+    //  Bind-parameter indexing is 1-based.
+    rc = sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr); // Bind first parameter.
+    if ( rc != SQLITE_OK ){
+        return {};
+    }
+    rc = sqlite3_bind_text( stmt.get(), 2, path.c_str(), path.size(), nullptr);  // Bind second parameter.
+    if ( rc != SQLITE_OK ){
+        return {};
+    }
+    rc = sqlite3_bind_text( stmt.get(), 3, algorithm.c_str(), algorithm.size(), nullptr);
+    if ( rc != SQLITE_OK ){
+        return {};
+    }
+
+    rc = sqlite3_step( stmt.get() );
+
+    if( rc  == SQLITE_ROW ) { // if query has result-rows.
+        FileDigest result{static_cast<std::uint64_t>(sqlite3_column_int64(stmt.get(), 0)),
+                          sqlite3_column_int64(stmt.get(), 1),
+                          static_cast<std::uint64_t>(sqlite3_column_int64(stmt.get(), 2)),
+                          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 3))};
+        return result;
+    }
+
+    return {};
+}
+
+/**
+ * save (or replace) the digest of a file
+ *
+ * @param username owner of the file
+ * @param path relative path of the file
+ * @param algorithm of the digest
+ * @param digest the digest with the metadata of the file when it was computed
+ * @return true if the digest has been saved, false otherwise
+ */
+bool Dao::saveDigest(const std::string &username, const std::string &path, const std::string &algorithm,
+                     const FileDigest &digest){
+    if(!conn_open)
+        return false;
+
+    Statement stmt = statement("INSERT OR REPLACE INTO digests (username, path, size, mtime, inode, digest, algorithm) VALUES (?, ?, ?, ?, ?, ?, ?)");
+    int rc;
+    if ( !stmt )
+        return false;
+
+    //  Bind-parameter indexing is 1-based.
+    if ( sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 2, path.c_str(), path.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_int64( stmt.get(), 3, static_cast<sqlite3_int64>(digest.size)) != SQLITE_OK ||
+         sqlite3_bind_int64( stmt.get(), 4, digest.mtime) != SQLITE_OK ||
+         sqlite3_bind_int64( stmt.get(), 5, static_cast<sqlite3_int64>(digest.inode)) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 6, digest.digest.c_str(), digest.digest.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 7, algorithm.c_str(), algorithm.size(), nullptr) != SQLITE_OK ){
+        return false;
+    }
+
+    rc = sqlite3_step( stmt.get() );
+
+    if( rc  != SQLITE_DONE ) { // if query has been executed without errors.
+        return false;
+    }
+    return true;
+}
+
+/**
+ * upper bound of the paths with a prefix: the paths starting with it are in [prefix, prefix_end(prefix)). The text
+ * is compared byte by byte (BINARY collation), substr would count characters instead of bytes
+ *
+ * @param prefix of the paths
+ * @return the prefix with its last byte incremented, for the empty prefix a string greater than any path (no UTF-8
+ * text contains the byte 0xff)
+ */
+static std::string prefix_end(std::string prefix) {
+    if (prefix.empty())
+        return std::string(1, '\xff');
+    prefix.back() = static_cast<char>(prefix.back() + 1);
+    return prefix;
+}
+
+/**
+ * delete the digests of a file or of all the files in a folder
+ *
+ * @param username owner of the files
+ * @param path relative path of the file/folder
+ */
+void Dao::deleteDigests(const std::string &username, const std::string &path){
+    if(!conn_open)
+        return ;
+
+    std::string prefix = path + "/";
+
+    std::string end = prefix_end(prefix);
+
+    Statement stmt = statement("DELETE FROM digests WHERE username = ? AND (path = ? OR (path >= ? AND path < ?))");
+    if ( !stmt )
+        return;
+
+    //  Bind-parameter indexing is 1-based.
+    if ( sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 2, path.c_str(), path.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 3, prefix.c_str(), prefix.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 4, end.c_str(), end.size(), nullptr) != SQLITE_OK ){
+        return;
+    }
+
+    sqlite3_step( stmt.get() );
+}
+
+/**
+ * get the hash saved for a folder (Merkle tree of its content)
+ *
+ * @param username owner of the folder
+ * @param path relative path of the folder, a empty string for the root
+ * @param algorithm of the digests of the files in the hash
+ * @return the hash, a empty optional if not present
+ */
+std::optional<std::string> Dao::getTreeHash(const std::string &username, const std::string &path,
+                                            const std::string &algorithm){
+    if(!conn_open)
+        return {};
+
+    Statement stmt = statement("SELECT hash FROM tree_hashes WHERE username = ? AND path = ? AND algorithm = ?");
+    int rc;
+    if ( !stmt )
+        return {};
+
+    //  Bind-parameter indexing is 1-based.
+    if ( sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 2, path.c_str(), path.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 3, algorithm.c_str(), algorithm.size(), nullptr) != SQLITE_OK ){
+        return {};
+    }
+
+    rc = sqlite3_step( stmt.get() );
+
+    if( rc  == SQLITE_ROW ) { // if query has result-rows.
+        std::string result = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+        return result;
+    }
+
+    return {};
+}
+
+/**
+ * save (or replace) the hash of a folder
+ *
+ * @param username owner of the folder
+ * @param path relative path of the folder, a empty string for the root
+ * @param algorithm of the digests of the files in the hash
+ * @param hash of the content of the folder
+ * @return true if the hash has been saved, false otherwise
+ */
+bool Dao::saveTreeHash(const std::string &username, const std::string &path, const std::string &algorithm,
+                       const std::string &hash){
+    if(!conn_open)
+        return false;
+
+    Statement stmt = statement("INSERT OR REPLACE INTO tree_hashes (username, path, hash, algorithm) VALUES (?, ?, ?, ?)");
+    int rc;
+    if ( !stmt )
+        return false;
+
+    //  Bind-parameter indexing is 1-based.
+    if ( sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 2, path.c_str(), path.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 3, hash.c_str(), hash.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 4, algorithm.c_str(), algorithm.size(), nullptr) != SQLITE_OK ){
+        return false;
+    }
+
+    rc = sqlite3_step( stmt.get() );
+
+    return rc == SQLITE_DONE;
+}
+
+/**
+ * delete the hashes of a folder and of all its sub-folders
+ *
+ * @param username owner of the folders
+ * @param path relative path of the folder, a empty string for the root
+ */
+void Dao::deleteTreeHashes(const std::string &username, const std::string &path){
+    if(!conn_open)
+        return ;
+
+    // the children of the root have no prefix
+    std::string prefix = path.empty() ? "" : path + "/";
+
+    std::string end = prefix_end(prefix);
+
+    Statement stmt = statement("DELETE FROM tree_hashes WHERE username = ? AND (path = ? OR (path >= ? AND path < ?))");
+    if ( !stmt )
+        return;
+
+    //  Bind-parameter indexing is 1-based.
+    if ( sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 2, path.c_str(), path.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 3, prefix.c_str(), prefix.size(), nullptr) != SQLITE_OK ||
+         sqlite3_bind_text( stmt.get(), 4, end.c_str(), end.size(), nullptr) != SQLITE_OK ){
+        return;
+    }
+
+    sqlite3_step( stmt.get() );
+}
+
+/**
+ * delete the hashes of some folders (not of their sub-folders)
+ *
+ * @param username owner of the folders
+ * @param paths relative paths of the folders
+ */
+void Dao::deleteTreeHashes(const std::string &username, const std::vector<std::string> &paths){
+    if(!conn_open)
+        return ;
+
+    Statement stmt = statement("DELETE FROM tree_hashes WHERE username = ? AND path = ?");
+    if ( !stmt )
+        return;
+
+    for (const std::string &path: paths) {
+        //  Bind-parameter indexing is 1-based.
+        if ( sqlite3_bind_text( stmt.get(), 1, username.c_str(), username.size(), nullptr) != SQLITE_OK ||
+             sqlite3_bind_text( stmt.get(), 2, path.c_str(), path.size(), nullptr) != SQLITE_OK )
+            break;
+
+        sqlite3_step( stmt.get() );
+        sqlite3_reset( stmt.get() );
+    }
+}
+
+/**
+ * check if a table has a column
+ *
+ * @param db connection
+ * @param table name of the table
+ * @param column name of the column
+ * @return true if the table has the column, a empty optional if the table doesn't exist
+ */
+static std::optional<bool> has_column(sqlite3 *db, const std::string &table, const std::string &column){
+    sqlite3_stmt* stmt = nullptr;
+    std::string query = "PRAGMA table_info(" + table + ")";
+    if ( sqlite3_prepare_v2( db, query.c_str(), -1, &stmt, 0 ) != SQLITE_OK )
+        return {};
+
+    bool exists = false, found = false;
+    while ( sqlite3_step( stmt ) == SQLITE_ROW ) {
+        exists = true;
+        if ( column == reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)) )
+            found = true;
+    }
+
     sqlite3_finalize( stmt );
+    if (!exists)
+        return {};
+    return found;
 }
 
 /**
  * constructor of the Dao
- * open the connection with the DB
+ * open the connection of the current thread, switch the DB to WAL mode and create the tables of the digests and
+ * of the folder hashes if they don't exist
  */
 Dao::Dao() {
-    std::string path = configuration::dbpath;
-
-    if( sqlite3_open(path.c_str(), &db) != SQLITE_OK ){
-        std::cerr << "DB Open Error: " << sqlite3_errmsg(db) << std::endl;
+    sqlite3 *db = connection();
+    if( db == nullptr ){
         conn_open = false;
         return;
     }
     conn_open = true;
-}
 
-Dao::~Dao() {
-    if(conn_open)
-        sqlite3_close(db);
+    char *err = nullptr;
+    // the mode is saved in the database file, the connections opened later use it too
+    if( sqlite3_exec(db, "PRAGMA journal_mode=WAL", nullptr, nullptr, &err) != SQLITE_OK ){
+        std::cerr << "DB Error: " << err << std::endl;
+        sqlite3_free(err);
+    }
+
+    // the tables created before the digest algorithms have only SHA256 digests: they are kept, the folder hashes
+    // are computed again when needed
+    if( has_column(db, "digests", "algorithm") == std::optional<bool>(false) &&
+        sqlite3_exec(db, "BEGIN; ALTER TABLE digests RENAME TO digests_sha256; "
+                         "CREATE TABLE digests (username TEXT NOT NULL, path TEXT NOT NULL, algorithm TEXT NOT NULL, "
+                         "size INTEGER, mtime INTEGER, inode INTEGER, digest TEXT, "
+                         "PRIMARY KEY (username, path, algorithm)); "
+                         "INSERT INTO digests SELECT username, path, 'sha256', size, mtime, inode, digest "
+                         "FROM digests_sha256; DROP TABLE digests_sha256; COMMIT",
+                     nullptr, nullptr, &err) != SQLITE_OK ){
+        std::cerr << "DB Error: " << err << std::endl;
+        sqlite3_free(err);
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+    }
+    if( has_column(db, "tree_hashes", "algorithm") == std::optional<bool>(false) )
+        sqlite3_exec(db, "DROP TABLE tree_hashes", nullptr, nullptr, nullptr);
+
+    if( sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS digests (username TEXT NOT NULL, path TEXT NOT NULL, "
+                         "algorithm TEXT NOT NULL, size INTEGER, mtime INTEGER, inode INTEGER, digest TEXT, "
+                         "PRIMARY KEY (username, path, algorithm))",
+                     nullptr, nullptr, &err) != SQLITE_OK ){
+        std::cerr << "DB Error: " << err << std::endl;
+        sqlite3_free(err);
+    }
+    if( sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS tree_hashes (username TEXT NOT NULL, path TEXT NOT NULL, "
+                         "algorithm TEXT NOT NULL, hash TEXT, PRIMARY KEY (username, path, algorithm))",
+                     nullptr, nullptr, &err) != SQLITE_OK ){
+        std::cerr << "DB Error: " << err << std::endl;
+        sqlite3_free(err);
+    }
+    if( sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS revoked_tokens (id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                         "mac TEXT UNIQUE NOT NULL, expiry INTEGER NOT NULL)",
+                     nullptr, nullptr, &err) != SQLITE_OK ){
+        std::cerr << "DB Error: " << err << std::endl;
+        sqlite3_free(err);
+    }
 }
 
+// the connections are closed by their threads
+Dao::~Dao() = default;
+
 Dao *Dao::getInstance() {
 
     std::call_once(inited, []() {
@@ -6,17 +6,56 @@
 #include <future>
 #include <mutex>
 #include <thread>
+#include <optional>
+#include <vector>
 
 #include "configuration.h"
 
-//singleton, interface with database
+// digest of a stored file, valid only while the file has the same size, last write time and inode
+struct FileDigest {
+    std::uint64_t size;
+    std::int64_t mtime;     // nanoseconds
+    std::uint64_t inode;
+    std::string digest;
+};
+
+// token revoked at a logout, until it expires
+struct RevokedToken {
+    std::int64_t id;        // never reused: the rows after the last one read are the new revocations
+    std::string mac;
+    std::int64_t expiry;    // seconds since the epoch
+};
+
+// milliseconds a connection waits for the lock of another connection writing in the database
+#define DB_BUSY_TIMEOUT 5000
+
+// a statement of the cache of a connection, reset when it goes out of scope so it can be used again
+class Statement {
+    sqlite3_stmt *stmt_;
+
+public:
+    explicit Statement(sqlite3_stmt *stmt);
+    ~Statement();
+
+    sqlite3_stmt *get() const;
+    explicit operator bool() const;
+
+    Statement(const Statement&)= delete;
+    Statement& operator=(const Statement&)= delete;
+};
+
+//singleton, interface with database.
+//Each thread has its own connection (the database is in WAL mode, so the readers don't wait for the writers) with
+//its own cache of prepared statements
 class Dao{
     Dao();
     ~Dao();
 
-    sqlite3* db;
     bool conn_open;
 
+    sqlite3 *connection();
+    Statement statement(const char *sql);
+
 public:
     static Dao* instance;
     static std::once_flag inited;
@@ -29,6 +68,19 @@ public:
     bool deleteTokenToUser(const std::string &username);
     std::vector<std::string> getAllUsers();
     void deleteAllTokens();
+    bool revokeToken(const std::string &mac, std::int64_t expiry, std::int64_t now);
+    std::vector<RevokedToken> getRevokedTokens(std::int64_t after, std::int64_t now);
+    std::optional<FileDigest> getDigest(const std::string &username, const std::string &path,
+                                        const std::string &algorithm);
+    bool saveDigest(const std::string &username, const std::string &path, const std::string &algorithm,
+                    const FileDigest &digest);
+    void deleteDigests(const std::string &username, const std::string &path);
+    std::optional<std::string> getTreeHash(const std::string &username, const std::string &path,
+                                           const std::string &algorithm);
+    bool saveTreeHash(const std::string &username, const std::string &path, const std::string &algorithm,
+                      const std::string &hash);
+    void deleteTreeHashes(const std::string &username, const std::string &path);
+    void deleteTreeHashes(const std::string &username, const std::vector<std::string> &paths);
 
     Dao(const Dao&)= delete;
     Dao& operator=(const Dao&)= delete;
@@ -0,0 +1,218 @@
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+#include "delta.h"
+#include "backup.h"
+#include "storage.h"
+#include "sha256.h"
+
+namespace fs = std::filesystem;
+
+// size of the blocks used to copy the data in the new file
+#define DELTA_COPY_SIZE (64 * 1024)
+
+/**
+ * rolling checksum of a block (as in rsync): two sums of 16 bits, the second weighted by the position
+ *
+ * @param data the block
+ * @param n size of the block
+ * @return the checksum
+ */
+static std::uint32_t weak_checksum(const unsigned char *data, std::size_t n) {
+    std::uint32_t a = 0, b = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        a += data[i];
+        b += (n - i) * data[i];
+    }
+    return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+/**
+ * @param data the block
+ * @param n size of the block
+ * @return the first 16 bytes of the SHA256 of the block, in hexadecimal format
+ */
+static std::string strong_checksum(const unsigned char *data, std::size_t n) {
+    return sha256::digest(data, n).substr(0, 32);
+}
+
+/**
+ * compute the signatures of the blocks of a file. The size of the blocks grows with the square root of
+ * the size of the file (as in rsync), so the number of signatures and the size of the delta stay balanced
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the file
+ * @return the signatures, a empty optional if the file doesn't exist
+ */
+std::optional<Signatures> file_signatures(const std::string &user, const std::string &path) {
+    std::string abs_path = get_abs_path(user, path);
+    std::optional<std::string> version = file_version(abs_path);
+    if (!version)
+        return {};
+
+    // the blocks are of the original content, also if the file is stored compressed
+    StoredFile in;
+    if (!in.open(abs_path))
+        return {};
+
+    Signatures signatures{version.value(), in.size(), 0, {}, {}};
+    std::uint64_t block_size = std::max<std::uint64_t>(std::sqrt(signatures.size),
+                                                       signatures.size / DELTA_MAX_BLOCKS + 1);
+    // multiple of 1 KiB
+    block_size = (block_size + 1023) / 1024 * 1024;
+    signatures.block_size = std::max<std::uint64_t>(block_size, DELTA_MIN_BLOCK);
+
+    std::unique_ptr<unsigned char[]> buf{new unsigned char[signatures.block_size]};
+    std::size_t n;
+    while ((n = in.read(reinterpret_cast<char *>(buf.get()), signatures.block_size)) > 0) {
+        signatures.weak.push_back(weak_checksum(buf.get(), n));
+        signatures.strong.push_back(strong_checksum(buf.get(), n));
+    }
+    return signatures;
+}
+
+/**
+ * read a number of the delta (8 bytes, little endian)
+ *
+ * @param in the delta
+ * @param value set to the number read
+ * @return true if the number was read
+ */
+static bool read_u64(std::istream &in, std::uint64_t &value) {
+    unsigned char bytes[8];
+    if (!in.read(reinterpret_cast<char *>(bytes), 8))
+        return false;
+    value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = (value << 8) | bytes[i];
+    return true;
+}
+
+/**
+ * read bytes of the delta
+ *
+ * @param in the delta
+ * @param buf where the bytes are written
+ * @param n number of bytes
+ * @return true if all the bytes were read
+ */
+static bool read_bytes(std::istream &in, char *buf, std::size_t n) {
+    return static_cast<bool>(in.read(buf, n));
+}
+
+/**
+ * read bytes of the old version of the file
+ *
+ * @param in the old version of the file
+ * @param buf where the bytes are written
+ * @param n number of bytes
+ * @return true if all the bytes were read
+ */
+static bool read_bytes(StoredFile &in, char *buf, std::size_t n) {
+    return in.read(buf, n) == n;
+}
+
+/**
+ * copy bytes from a file to the new file, updating its digest
+ *
+ * @param in where the bytes are read (the delta or the old version of the file)
+ * @param out the new file
+ * @param hasher digest of the new file
+ * @param n number of bytes to copy
+ * @param buf buffer of DELTA_COPY_SIZE bytes
+ * @return true if all the bytes were copied
+ */
+template<class Input>
+static bool copy_bytes(Input &in, std::ostream &out, digest::Hasher &hasher, std::uint64_t n, char *buf) {
+    while (n > 0) {
+        std::size_t amount = n > DELTA_COPY_SIZE ? DELTA_COPY_SIZE : n;
+        if (!read_bytes(in, buf, amount))
+            return false;
+        out.write(buf, amount);
+        hasher.update(buf, amount);
+        n -= amount;
+    }
+    return true;
+}
+
+/**
+ * build the new version of a file from the old one and a delta, a sequence of operations:
+ * copy (DELTA_OP_COPY, offset, size) of a range of the old file or literal (DELTA_OP_LITERAL, size, bytes).
+ * The new file is written in a temporary file and then replaces the old one, so the old version
+ * stays available until the new one is complete
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the file
+ * @param delta_path temporary file with the delta received, removed at the end
+ * @param expected version of the file used to compute the delta (its base and optionally its digest): the check
+ * and the replacement are atomic, as in replace_file
+ * @param digest expected digest of the new file
+ * @param algorithm of the digest
+ * @return delta_ok if the file was updated, delta_changed if the file isn't the expected version anymore
+ */
+DeltaState apply_delta(const std::string &user, const std::string &path, const std::string &delta_path,
+                       const ExpectedVersion &expected, const std::string &digest, digest::Algorithm algorithm) {
+    std::string abs_path = get_abs_path(user, path);
+    if (file_version(abs_path) != expected.base) {
+        discard_temp(delta_path);
+        return delta_changed;
+    }
+
+    std::string tmp_path = new_temp_path();
+    StoredFile old_file;
+    old_file.open(abs_path);
+    std::ifstream delta(delta_path, std::ios::in | std::ios::binary);
+    std::ofstream out(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!old_file.is_open() || !delta.is_open() || !out.is_open()) {
+        discard_temp(delta_path);
+        discard_temp(tmp_path);
+        return delta_error;
+    }
+
+    std::uint64_t old_size = old_file.size();
+    std::unique_ptr<char[]> buf{new char[DELTA_COPY_SIZE]};
+    digest::Hasher hasher(algorithm);
+
+    bool valid = true;
+    char op;
+    while (valid && delta.get(op)) {
+        std::uint64_t offset, size;
+        if (op == DELTA_OP_COPY) {
+            valid = read_u64(delta, offset) && read_u64(delta, size) && offset <= old_size &&
+                    size <= old_size - offset;
+            if (valid) {
+                old_file.seek(offset);
+                valid = copy_bytes(old_file, out, hasher, size, buf.get());
+            }
+        } else if (op == DELTA_OP_LITERAL) {
+            valid = read_u64(delta, size) && copy_bytes(delta, out, hasher, size, buf.get());
+        } else {
+            valid = false;
+        }
+    }
+    out.close();
+    delta.close();
+    discard_temp(delta_path);
+
+    if (!valid || out.fail()) {
+        discard_temp(tmp_path);
+        return out.fail() ? delta_error : delta_bad;
+    }
+
+    std::string new_digest = hasher.final();
+
+    // a different result means that the old file is not the one the client expected
+    if (digest != new_digest) {
+        discard_temp(tmp_path);
+        return delta_changed;
+    }
+
+    // the base is checked again with the path locked, another request may have replaced the file meanwhile
+    switch (replace_file(user, path, tmp_path, expected, new_digest, algorithm)) {
+        case save_ok: return delta_ok;
+        case save_changed: return delta_changed;
+        default: return delta_error;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef SERVER_PROGETTO_DELTA_H
+#define SERVER_PROGETTO_DELTA_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "digest.h"
+#include "backup.h"
+
+// limits of the size of the blocks of the signatures
+#define DELTA_MIN_BLOCK (2 * 1024)
+#define DELTA_MAX_BLOCKS (64 * 1024)
+
+// operations of a delta: copy a range of the old file, or take the next bytes (literal) of the delta
+#define DELTA_OP_COPY 'C'
+#define DELTA_OP_LITERAL 'L'
+
+// signatures of the blocks of a file, the client uses them to find the parts that didn't change
+struct Signatures {
+    std::string version;            // changes when the file changes, the delta must be applied to this version
+    std::uint64_t size;
+    std::uint64_t block_size;
+    std::vector<std::uint32_t> weak;  // rolling checksum of each block
+    std::vector<std::string> strong;  // SHA256 (first 16 bytes) of each block
+};
+
+enum DeltaState { delta_ok, delta_changed, delta_bad, delta_error };
+
+// compute the signatures of a file, a empty optional if the file doesn't exist
+std::optional<Signatures> file_signatures(const std::string &user, const std::string &path);
+
+// build the new version of the file applying the delta received in delta_path, then replace the old one
+DeltaState apply_delta(const std::string &user, const std::string &path, const std::string &delta_path,
+                       const ExpectedVersion &expected, const std::string &digest,
+                       digest::Algorithm algorithm = digest::algorithm_sha256);
+
+#endif //SERVER_PROGETTO_DELTA_H
@@ -3,6 +3,12 @@
 #include "Listener.h"
 #include "configuration.h"
 #include "authorization.h"
+#include "TokenCache.h"
+#include "TokenSigner.h"
+#include "WorkerPool.h"
+#include "IoRing.h"
+#include "GroupCommit.h"
+#include "storage.h"
 
 int main() {
 
@@ -11,11 +17,30 @@ int main() {
         return EXIT_FAILURE;
     }
 
+    // keys that sign the tokens
+    if(!TokenSigner::getInstance()->load_keys(configuration::token_keys)){
+        return EXIT_FAILURE;
+    }
+    TokenSigner::getInstance()->load_revoked();
+
+    if(configuration::io_engine == "uring" && !ring_storage()){
+        std::cout << "io_uring not available (" << IoRing::getInstance()->error()
+                  << "), the storage uses the POSIX functions" << std::endl;
+    } else if(ring_storage() && !IoRing::getInstance()->fixed_reads()){
+        std::cout << "io_uring buffers not registered (" << IoRing::getInstance()->error()
+                  << "), the digests use the POSIX reads" << std::endl;
+    }
+
     // create a folder for each user on the server
     if(!configuration::prepare_environment()){
         return EXIT_FAILURE;
     }
 
+    // the files saved must be flushed as set by durability
+    if(!GroupCommit::getInstance()->ready()){
+        return EXIT_FAILURE;
+    }
+
     // The io_context is required for all I/O (including network)
     net::io_context ioc{configuration::nthreads};
 
@@ -36,10 +61,36 @@ int main() {
             std::cout << ss.str();
             ioc.stop();
 
-            // delete tokens of all users
+            // delete the tokens of the database of all users. The signed tokens are valid until they expire or
+            // are revoked: with a key file they are still accepted after a restart and by the other processes
             deleteAllTokens();
+
+            std::stringstream stats;
+            stats << "Token cache: " << TokenCache::getInstance()->hits() << " hits, "
+                  << TokenCache::getInstance()->misses() << " misses" << std::endl;
+            for (WorkerPool *pool: {WorkerPool::disk(), WorkerPool::database()})
+                stats << pool->name() << " pool: " << pool->queue_depth() << " queued, max "
+                      << pool->max_queue_depth() << " queued" << std::endl;
+            if (ring_storage())
+                stats << "I/O ring: " << IoRing::getInstance()->operations() << " operations in "
+                      << IoRing::getInstance()->enters() << " submissions" << std::endl;
+            if (configuration::durability == "group")
+                stats << "Group commit: " << GroupCommit::getInstance()->requests() << " requests in "
+                      << GroupCommit::getInstance()->commits() << " commits" << std::endl;
+            std::cout << stats.str();
     });
 
+    // Reload the key file with SIGHUP, to rotate the keys without a restart
+    net::signal_set reload(ioc, SIGHUP);
+    std::function<void(beast::error_code const&, int)> on_reload =
+        [&reload, &on_reload](beast::error_code const& ec, int){
+            if (ec)
+                return;
+            if (!configuration::token_keys.empty() && TokenSigner::getInstance()->load_keys(configuration::token_keys))
+                std::cout << "Token keys reloaded" << std::endl;
+            reload.async_wait(on_reload);
+    };
+    reload.async_wait(on_reload);
 
     // Run the I/O service on the requested number of threads
     std::vector<std::thread> v;
@@ -54,5 +105,9 @@ int main() {
     for(auto& t : v)
         t.join();
 
+    // the requests not started are discarded, wait for the running ones
+    WorkerPool::disk()->stop();
+    WorkerPool::database()->stop();
+
     return 0;
 }
@@ -10,4 +10,66 @@ void replaceSpaces(std::string &str) {
     while ((pos=str.find("%20"))!= std::string::npos){
         str.replace(pos, 3, " ");
     }
-}
\ No newline at end of file
+}
+
+/**
+ * remove the query string from the target and look for a parameter in it
+ *
+ * @param target of the request, the query string is removed
+ * @param name of the parameter
+ * @return the value of the parameter, a empty optional if not present
+ */
+std::optional<std::string> query_parameter(std::string &target, const std::string &name) {
+    std::size_t pos = target.find('?');
+    if (pos == std::string::npos)
+        return {};
+
+    std::string query = target.substr(pos + 1);
+    target.erase(pos);
+
+    std::size_t start = 0;
+    while (start <= query.size()) {
+        std::size_t end = query.find('&', start);
+        if (end == std::string::npos)
+            end = query.size();
+
+        std::string parameter = query.substr(start, end - start);
+        if (parameter.rfind(name + "=", 0) == 0)
+            return parameter.substr(name.size() + 1);
+
+        start = end + 1;
+    }
+    return {};
+}
+
+/**
+ * release the file of an upload that was not completed (e.g. connection lost)
+ *
+ * @param upload the upload not completed
+ */
+void discard_upload(const Upload &upload) {
+    if (upload.id.empty()) {
+        discard_temp(upload.tmp_path);
+    } else {
+        // the data received until now is kept, the client can resume the upload
+        upload_unlock(upload.id);
+    }
+}
+/**
+ * choose the algorithm of the digests of a client
+ *
+ * @param names of the algorithms supported by the client, in order of preference
+ * @return the first algorithm supported also by the server, SHA256 if none
+ */
+digest::Algorithm negotiate_algorithm(const json &names) {
+    if (!names.is_array())
+        return digest::algorithm_sha256;
+    for (const auto &name: names) {
+        if (!name.is_string())
+            continue;
+        std::optional<digest::Algorithm> algorithm = digest::from_name(name.get<std::string>());
+        if (algorithm)
+            return algorithm.value();
+    }
+    return digest::algorithm_sha256;
+}
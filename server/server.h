@@ -1,7 +1,6 @@
 #ifndef SERVER_PROGETTO_SERVER_H
 #define SERVER_PROGETTO_SERVER_H
 
-#include <boost/beast/core/detail/base64.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
@@ -10,6 +9,7 @@
 #include <boost/config.hpp>
 #include <algorithm>
 #include <cstdlib>
+#include <filesystem>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -19,6 +19,16 @@
 #include <nlohmann/json.hpp>
 
 #include "backup.h"
+#include "upload.h"
+#include "chunks.h"
+#include "delta.h"
+#include "TokenSigner.h"
+#include "tree.h"
+#include "base64.h"
+#include "gzip.h"
+#include "UploadBody.h"
+#include "RestoreBody.h"
+#include "configuration.h"
 #include "authorization.h"
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
@@ -26,7 +36,6 @@ namespace http = beast::http;           // from <boost/beast/http.hpp>
 namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 using json = nlohmann::json;
-namespace base64 = boost::beast::detail::base64;
 
 // Report a failure
 void fail(beast::error_code ec, const std::string  &what);
@@ -34,6 +43,307 @@ void fail(beast::error_code ec, const std::string  &what);
 // replace %20 with the space
 void replaceSpaces(std::string &str);
 
+// split the query string (after '?') from the target, return the value of a parameter of the query
+std::optional<std::string> query_parameter(std::string &target, const std::string &name);
+
+// algorithm of the digests sent by the client and expected in the response (SHA256 if the header is missing),
+// a empty optional if it is not supported
+template<class Body, class Allocator>
+std::optional<digest::Algorithm> request_algorithm(const http::request<Body, http::basic_fields<Allocator>>& req){
+    auto name = req[DIGEST_ALGORITHM_HEADER];
+    if (name.empty())
+        return digest::algorithm_sha256;
+    return digest::from_name(name.to_string());
+}
+
+// version of the file the client expects to replace, from the If-Match header (a digest with the algorithm of the
+// Digest-Algorithm header, with or without quotes, or "*"): an empty digest if the header is missing, a empty
+// optional if the algorithm is not supported
+template<class Body, class Allocator>
+std::optional<ExpectedVersion> expected_version(const http::request<Body, http::basic_fields<Allocator>>& req){
+    std::optional<digest::Algorithm> algorithm = request_algorithm(req);
+    if (!algorithm)
+        return {};
+    std::string value = req[http::field::if_match].to_string();
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        value = value.substr(1, value.size() - 2);
+    return ExpectedVersion{value, algorithm.value(), ""};
+}
+
+// true if the body of the request is compressed in gzip format, false if it is not compressed, a empty optional if
+// the Content-Encoding is not supported
+template<class Body, class Allocator>
+std::optional<bool> is_gzip_body(const http::request<Body, http::basic_fields<Allocator>>& req){
+    auto encoding = req[http::field::content_encoding];
+    if (encoding.empty() || beast::iequals(encoding, "identity"))
+        return false;
+    if (beast::iequals(encoding, GZIP_ENCODING))
+        return true;
+    return {};
+}
+
+// the response to a body with a Content-Encoding not supported, with the encodings supported
+template<class Body, class Allocator>
+http::response<http::string_body> unsupported_encoding(const http::request<Body, http::basic_fields<Allocator>>& req){
+    http::response<http::string_body> res{http::status::unsupported_media_type, req.version()};
+    res.set(http::field::content_type, "text/plain");
+    res.set(http::field::accept_encoding, GZIP_ENCODING);
+    res.body() = "Unsupported Content-Encoding";
+    res.prepare_payload();
+    return res;
+}
+
+// the first algorithm of the list sent by the client at the login supported by the server, SHA256 if none is
+// supported (or the client doesn't send the list)
+digest::Algorithm negotiate_algorithm(const json &names);
+
+// A raw upload whose body is written in a file while it is received
+struct Upload {
+    std::string user;
+    std::string path;     // destination of the file (POST /backup/{path} or POST /delta/{path})
+    std::string tmp_path; // file where the body is written
+    std::string id;       // upload session (PUT /upload/{id}), empty for POST /backup/{path}
+    std::string digest;   // expected digest of the file built from the delta
+    digest::Algorithm algorithm = digest::algorithm_sha256; // algorithm of digest
+    ExpectedVersion expected; // version of the file to replace (If-Match, and for POST /delta/{path} the version the
+                              // delta applies to)
+};
+
+// release what was reserved for an upload not completed
+void discard_upload(const Upload &upload);
+
+// true if the body of the request must be streamed to disk instead of being kept in memory
+template<class Body, class Allocator>
+bool is_stream_upload(const http::request<Body, http::basic_fields<Allocator>>& req){
+    return req.method() == http::verb::put ||
+           (req.method() == http::verb::post &&
+            req[http::field::content_type].starts_with("application/octet-stream"));
+}
+
+// This function checks the header of a raw upload (POST /backup/{path} with
+// Content-Type: application/octet-stream, PUT /upload/{id}?offset=N for a
+// resumable upload or POST /delta/{path}?base=V&digest=D for a delta)
+// and opens the file where the body will be written.
+// If the upload can't be accepted an error response is sent and an empty
+// optional is returned.
+template<class Allocator, class Send>
+std::optional<Upload> open_upload(http::request<UploadBody, http::basic_fields<Allocator>>& req, Send&& send){
+
+    auto const bad_request =
+            [&req](const std::string &why){
+                http::response<http::string_body> res{http::status::bad_request, req.version()};
+                res.set(http::field::content_type, "text/plain");
+                res.body() = why;
+                res.prepare_payload();
+                return res;
+            };
+
+    auto const server_error =
+            [&req](const std::string &what){
+                http::response<http::string_body> res{http::status::internal_server_error, req.version()};
+                res.set(http::field::content_type, "text/plain");
+                res.body() = "An error occurred: '" + what + "'";
+                res.prepare_payload();
+                return res;
+            };
+
+    auto const unauthorized_response =
+            [&req](const std::string &what)
+            {
+                http::response<http::string_body> res{http::status::unauthorized, req.version()};
+                res.set(http::field::content_type, "text/plain");
+                res.body() = "Unauthorized: '" + what + "'";
+                res.prepare_payload();
+                return res;
+            };
+
+    auto const conflict =
+            [&req](std::uint64_t size){
+                http::response<http::string_body> res{http::status::conflict, req.version()};
+                res.set(http::field::content_type, "text/plain");
+                res.body() = std::to_string(size);
+                res.prepare_payload();
+                return res;
+            };
+
+    std::string req_path = req.target().to_string();
+
+    //avoid path traversal
+    if(req_path.find("..")!=std::string::npos) {
+        send(bad_request("Bad path"));
+        return {};
+    }
+    // substitute %20 with spaces
+    replaceSpaces(req_path);
+
+    bool is_backup = req.method() == http::verb::post && req_path.rfind("/backup/", 0) == 0 && req_path.size() > 8;
+    bool is_chunk = req.method() == http::verb::put && req_path.rfind("/upload/", 0) == 0;
+    bool is_delta = req.method() == http::verb::post && req_path.rfind("/delta/", 0) == 0;
+    if (!is_backup && !is_chunk && !is_delta) {
+        send(bad_request("Raw upload is allowed only for files"));
+        return {};
+    }
+
+    //check if authorized
+    auto auth = req[http::field::authorization];
+    if(auth.empty()) {
+        send(unauthorized_response("Token needed"));
+        return {};
+    }
+    std::optional<std::string> user = verifyToken(auth.to_string());
+    if (!user.has_value()) {
+        send(unauthorized_response("Invalid token"));
+        return {};
+    }
+
+    // a compressed body is decompressed while it is written in the file
+    std::optional<bool> gzip_body = is_gzip_body(req);
+    if (!gzip_body) {
+        send(unsupported_encoding(req));
+        return {};
+    }
+    if (gzip_body.value())
+        req.body().decompress();
+
+    auto const not_found =
+            [&req](){
+                http::response<http::empty_body> res{http::status::not_found, req.version()};
+                return res;
+            };
+
+    if (is_chunk) {
+        // part of a resumable upload, appended to the data already received
+        std::optional<std::string> offset_opt = query_parameter(req_path, "offset");
+        std::uint64_t offset;
+        try {
+            offset = std::stoull(offset_opt.value());
+        } catch (std::exception &e) {
+            send(bad_request("Missing offset"));
+            return {};
+        }
+
+        Upload upload{user.value(), "", "", req_path.substr(8), "", digest::algorithm_sha256, ExpectedVersion{}};
+        switch (upload_lock(upload.user, upload.id, offset, upload.tmp_path)) {
+            case upload_ok: break;
+            case upload_not_found: send(not_found()); return {};
+            case upload_bad_offset:
+            case upload_busy:
+            case upload_missing:
+            case upload_changed:
+            case upload_error:
+                // tell the client where the received data ends
+                send(conflict(upload_size(upload.user, upload.id).value_or(0)));
+                return {};
+        }
+
+        beast::error_code ec;
+        req.body().open(upload.tmp_path.c_str(), beast::file_mode::append_existing, ec);
+        if (!ec)
+            req.body().file().seek(offset, ec);
+        if (ec) {
+            upload_unlock(upload.id);
+            send(server_error("Impossible save the file, retry"));
+            return {};
+        }
+        return upload;
+    }
+
+    Upload upload{user.value(), "", new_temp_path(), "", "", digest::algorithm_sha256, ExpectedVersion{}};
+    std::optional<ExpectedVersion> expected = expected_version(req);
+    if (!expected) {
+        send(bad_request("Unknown digest algorithm"));
+        return {};
+    }
+    upload.expected = expected.value();
+    if (is_delta) {
+        // the delta is received in the temporary file, then it is applied to the file in path
+        std::string target = req_path;
+        std::optional<std::string> base = query_parameter(target, "base");
+        std::optional<std::string> digest = query_parameter(req_path, "digest");
+        if (!base || base->empty() || !digest || req_path.size() <= 7) {
+            send(bad_request("Missing base or digest"));
+            return {};
+        }
+        upload.path = req_path.substr(7);
+        upload.expected.base = base.value();
+        upload.digest = digest.value();
+        upload.algorithm = upload.expected.algorithm;
+    } else {
+        upload.path = req_path.substr(8);
+    }
+
+    beast::error_code ec;
+    req.body().open(upload.tmp_path.c_str(), beast::file_mode::write, ec);
+    if (ec) {
+        send(server_error("Impossible save the file, retry"));
+        return {};
+    }
+    return upload;
+}
+
+// This function produces the response for a raw upload, when the whole
+// body has been written in the temporary file.
+template<class Allocator, class Send>
+void handle_upload(http::request<UploadBody, http::basic_fields<Allocator>>&& req, const Upload& upload, Send&& send){
+
+    auto const server_error =
+            [&req](const std::string &what){
+                http::response<http::string_body> res{http::status::internal_server_error, req.version()};
+                res.set(http::field::content_type, "text/plain");
+                res.body() = "An error occurred: '" + what + "'";
+                res.prepare_payload();
+                return res;
+            };
+
+    auto const okay_response =
+            [&req](){
+                http::response<http::empty_body> res{http::status::ok, req.version()};
+                return res;
+            };
+
+    // flush and close the file before moving it
+    req.body().close();
+
+    if (!upload.id.empty()) {
+        // part of a resumable upload received, answer with the total number of bytes received
+        upload_unlock(upload.id);
+        std::string size = std::to_string(upload_size(upload.user, upload.id).value_or(0));
+        http::response<http::string_body> res{http::status::ok, req.version(), size};
+        res.set(http::field::content_type, "text/plain");
+        return send(std::move(res));
+    }
+
+    if (!upload.expected.base.empty()) {
+        // delta received, build the new version of the file
+        switch (apply_delta(upload.user, upload.path, upload.tmp_path, upload.expected, upload.digest,
+                            upload.algorithm)) {
+            case delta_ok: return send(okay_response());
+            case delta_changed: {
+                // the delta can't be applied, the client must send the whole file
+                http::response<http::empty_body> res{http::status::precondition_failed, req.version()};
+                return send(std::move(res));
+            }
+            case delta_bad: {
+                http::response<http::string_body> res{http::status::bad_request, req.version(), "Bad delta"};
+                res.set(http::field::content_type, "text/plain");
+                return send(std::move(res));
+            }
+            case delta_error: return send(server_error("Impossible save the file, retry"));
+        }
+    }
+
+    switch (replace_file(upload.user, upload.path, upload.tmp_path, upload.expected)) {
+        case save_ok: return send(okay_response());
+        case save_changed: {
+            // the file is not the version the client expected, it is not replaced
+            http::response<http::empty_body> res{http::status::precondition_failed, req.version()};
+            return send(std::move(res));
+        }
+        case save_error: break;
+    }
+    return send(server_error("Impossible save the file, retry"));
+}
+
 
 // This function produces an HTTP response for the given
 // request. The type of the response object depends on the
@@ -96,6 +406,18 @@ void handle_request(http::request<Body, http::basic_fields<Allocator>>&& req,Sen
         req.method() != http::verb::delete_)
         return send(bad_request("Unknown HTTP-method"));
 
+    // a compressed body (e.g. a json upload) is decompressed, up to the limit of the bodies kept in memory
+    std::optional<bool> gzip_body = is_gzip_body(req);
+    if (!gzip_body)
+        return send(unsupported_encoding(req));
+    if (gzip_body.value()) {
+        std::optional<std::string> body = gzip::decompress(req.body().data(), req.body().size(),
+                                                           configuration::body_limit);
+        if (!body)
+            return send(bad_request("Bad compressed body"));
+        req.body() = std::move(body.value());
+    }
+
 
     std::string req_path = req.target().to_string();
 
@@ -125,16 +447,16 @@ void handle_request(http::request<Body, http::basic_fields<Allocator>>&& req,Sen
         if (verifyUserPassword(username, password)) {
             // the user exists and the password is verified
 
-            // create token
-            std::string token = createToken(32);
+            // create a signed token, it is not saved in the database
+            std::string token = createSessionToken(username);
 
-            // save token related to user
-            if (!saveTokenToUser(username, token))
-                return send(server_error("Error in creating token to user"));
-
-            // send token
+            // send token, with its lifetime and the algorithm of the digests chosen for the client
             http::response<http::string_body> res{http::status::ok,req.version(),token};
             res.set(http::field::content_type, "text/plain");
+            res.set(TOKEN_LIFETIME_HEADER, std::to_string(configuration::token_lifetime));
+            res.set(DIGEST_ALGORITHM_HEADER, digest::name(negotiate_algorithm(j.value("digests", json::array()))));
+            // the bodies of the requests can be compressed
+            res.set(http::field::accept_encoding, GZIP_ENCODING);
             res.content_length(token.size());
             return send(std::move(res));
         } else {
@@ -181,17 +503,28 @@ void handle_request(http::request<Body, http::basic_fields<Allocator>>&& req,Sen
                     return send(bad_request("Missing parameters"));
                 }
 
-                std::size_t max_l = base64::decoded_size(encodedfile.size());
+                // a string without padding can have a partial group at the end
+                std::size_t max_l = base64::decoded_size(encodedfile.size() + 3);
                 std::unique_ptr<char[]> raw_file{new char[max_l]};
                 std::pair<std::size_t, std::size_t> res = base64::decode(raw_file.get(), encodedfile.c_str(), encodedfile.size());
 
-                if (save_file(user.value(), path, std::move(raw_file), res.first)) {
-                    //std::clog << " saved file " << path << std::endl;
-                    return send(okay_response());
-                } else {
-                    //std::clog << "impossible save file " << path << std::endl;
-                    return send(server_error("Impossible save the file, retry"));
+                std::optional<ExpectedVersion> expected = expected_version(req);
+                if (!expected)
+                    return send(bad_request("Unknown digest algorithm"));
+
+                switch (replace_file(user.value(), path, std::move(raw_file), res.first, expected.value())) {
+                    case save_ok:
+                        //std::clog << " saved file " << path << std::endl;
+                        return send(okay_response());
+                    case save_changed: {
+                        // the file is not the version the client expected, it is not replaced
+                        http::response<http::empty_body> changed{http::status::precondition_failed, req.version()};
+                        return send(std::move(changed));
+                    }
+                    case save_error: break;
                 }
+                //std::clog << "impossible save file " << path << std::endl;
+                return send(server_error("Impossible save the file, retry"));
 
             } else if (type == "folder"){
                 if(new_directory(user.value(),path)){
@@ -232,8 +565,113 @@ void handle_request(http::request<Body, http::basic_fields<Allocator>>&& req,Sen
                 return send(not_found());
             }
         }
+        if (req_path.rfind("/upload/", 0) == 0) {
+            // open a resumable upload for the file in path
+            std::string path = req_path.substr(8);
+            if (path.empty())
+                return send(bad_request("Bad path"));
+
+            std::optional<std::string> id = upload_create(user.value(), path);
+            if (!id)
+                return send(server_error("Impossible create the upload"));
+
+            http::response<http::string_body> res{http::status::ok, req.version(), id.value()};
+            res.set(http::field::content_type, "text/plain");
+            return send(std::move(res));
+        }
+
+        if (req_path.rfind("/commit/", 0) == 0) {
+            // complete a resumable upload, the received data must have the expected size
+            std::optional<std::string> size_opt = query_parameter(req_path, "size");
+            std::uint64_t size;
+            try {
+                size = std::stoull(size_opt.value());
+            } catch (std::exception &e) {
+                return send(bad_request("Missing size"));
+            }
+
+            std::optional<ExpectedVersion> expected = expected_version(req);
+            if (!expected)
+                return send(bad_request("Unknown digest algorithm"));
+
+            std::string id = req_path.substr(8);
+            UploadState state;
+            std::vector<std::string> missing;
+            if (req.body().empty()) {
+                // the received data is the file
+                state = upload_commit(user.value(), id, size, expected.value());
+            } else {
+                // the received data contains the chunks of the manifest marked as sent
+                std::vector<ManifestEntry> manifest;
+                try {
+                    json j = json::parse(req.body());
+                    for (const json &chunk: j.at("chunks"))
+                        manifest.push_back(ManifestEntry{chunk.at("hash"), chunk.at("size"), chunk.at("sent")});
+                } catch (json::exception &e) {
+                    return send(bad_request("Bad manifest"));
+                }
+                state = upload_commit_chunks(user.value(), id, size, manifest, missing, expected.value());
+            }
+
+            switch (state) {
+                case upload_ok: return send(okay_response());
+                case upload_not_found: return send(not_found());
+                case upload_error: return send(server_error("Impossible save the file, retry"));
+                case upload_missing: {
+                    // the chunks must be sent again with a new upload
+                    json j;
+                    j["missing"] = missing;
+                    http::response<http::string_body> res{http::status::precondition_failed, req.version(), j.dump()};
+                    res.set(http::field::content_type, "application/json");
+                    return send(std::move(res));
+                }
+                case upload_changed: {
+                    // the file is not the version the client expected, it is not replaced
+                    http::response<http::empty_body> res{http::status::precondition_failed, req.version()};
+                    return send(std::move(res));
+                }
+                case upload_busy:
+                case upload_bad_offset: {
+                    // tell the client where the received data ends
+                    std::string body = std::to_string(upload_size(user.value(), id).value_or(0));
+                    http::response<http::string_body> res{http::status::conflict, req.version(), body};
+                    res.set(http::field::content_type, "text/plain");
+                    return send(std::move(res));
+                }
+            }
+        }
+
+        if (req_path == "/chunks") {
+            // tell which chunks are not in the backup of the user
+            std::vector<std::string> hashes;
+            try {
+                json j = json::parse(req.body());
+                j.at("chunks").get_to(hashes);
+            } catch (json::exception &e) {
+                return send(bad_request("Bad request body"));
+            }
+
+            json j;
+            j["missing"] = missing_chunks(user.value(), hashes);
+            std::string body = j.dump();
+            http::response<http::string_body> res{http::status::ok, req.version(), body};
+            res.set(http::field::content_type, "application/json");
+            return send(std::move(res));
+        }
+
+        if (req_path == "/refresh") {
+            // a new token before the current one expires: the current one is not revoked, the requests sent
+            // with it in the meantime must not fail
+            std::string new_token = createSessionToken(user.value());
+
+            http::response<http::string_body> res{http::status::ok, req.version(), new_token};
+            res.set(http::field::content_type, "text/plain");
+            res.set(TOKEN_LIFETIME_HEADER, std::to_string(configuration::token_lifetime));
+            return send(std::move(res));
+        }
+
         if (req_path.rfind("/logout", 0) == 0){
-            if (logoutUser(user.value())) {
+            if (logoutUser(user.value(), token)) {
                 return send(okay_response());
             } else {
                 return send(server_error("Error during logout"));
@@ -251,20 +689,98 @@ void handle_request(http::request<Body, http::basic_fields<Allocator>>&& req,Sen
             std::string path = req_path.substr(11);
             //std::clog << "get /probefile " << path << std::endl;
 
-            std::optional<std::string> digest_opt = get_file_digest(user.value(), path);
+            std::optional<digest::Algorithm> algorithm = request_algorithm(req);
+            if (!algorithm)
+                return send(bad_request("Unknown digest algorithm"));
+
+            std::optional<std::string> digest_opt = get_file_digest(user.value(), path, algorithm.value());
 
             if(digest_opt){
                 //file exists
-                std::string digest = digest_opt.value();
-                http::response<http::string_body> res{http::status::ok, req.version(), digest};
+                std::string file_digest = digest_opt.value();
+                http::response<http::string_body> res{http::status::ok, req.version(), file_digest};
                 res.set(http::field::content_type, "text/plain");
-                res.content_length(digest.size());
+                res.set(DIGEST_ALGORITHM_HEADER, digest::name(algorithm.value()));
+                res.content_length(file_digest.size());
                 return send(std::move(res));
             } else {
                 //file not found
                 return send(not_found());
             }
         }
+
+        //if starts with probetree
+        if (req_path.rfind("/probetree/", 0) == 0) {
+            // hash of the folder and, if it is not the one of the client, the hashes of its children
+            std::string known_hash = query_parameter(req_path, "hash").value_or("");
+            std::optional<digest::Algorithm> algorithm = request_algorithm(req);
+            if (!algorithm)
+                return send(bad_request("Unknown digest algorithm"));
+            std::optional<TreeNode> node = probe_tree(user.value(), req_path.substr(11), known_hash, algorithm.value());
+            if (!node)
+                return send(not_found());
+
+            json j;
+            j["hash"] = node->hash;
+            json children = json::array();
+            for (const auto &[name, child]: node->children)
+                children.push_back({{"name", name},
+                                    {"type", child.type == TREE_FOLDER ? "folder" : "file"},
+                                    {"hash", child.hash}});
+            j["children"] = children;
+            j["algorithm"] = digest::name(algorithm.value());
+            std::string body = j.dump();
+            http::response<http::string_body> res{http::status::ok, req.version(), body};
+            res.set(http::field::content_type, "application/json");
+            res.set(DIGEST_ALGORITHM_HEADER, digest::name(algorithm.value()));
+            return send(std::move(res));
+        }
+
+        //if starts with signature
+        if (req_path.rfind("/signature/", 0) == 0) {
+            // signatures of the blocks of the file, used by the client to send only the differences
+            std::optional<Signatures> signatures = file_signatures(user.value(), req_path.substr(11));
+            if (!signatures)
+                return send(not_found());
+
+            json j;
+            j["version"] = signatures->version;
+            j["size"] = signatures->size;
+            j["block_size"] = signatures->block_size;
+            j["weak"] = signatures->weak;
+            j["strong"] = signatures->strong;
+            std::string body = j.dump();
+            http::response<http::string_body> res{http::status::ok, req.version(), body};
+            res.set(http::field::content_type, "application/json");
+            return send(std::move(res));
+        }
+
+        //if starts with backup
+        if (req_path.rfind("/backup/", 0) == 0) {
+            // content of a file of the backup (restore), decompressed while it is sent
+            std::string abs_path = get_abs_path(user.value(), req_path.substr(8));
+            std::error_code ec;
+            StoredFile file;
+            if (!std::filesystem::is_regular_file(abs_path, ec) || !file.open(abs_path))
+                return send(not_found());
+
+            http::response<RestoreBody> res{http::status::ok, req.version(), std::move(file)};
+            res.set(http::field::content_type, "application/octet-stream");
+            return send(std::move(res));
+        }
+
+        //if starts with upload
+        if (req_path.rfind("/upload/", 0) == 0) {
+            // number of bytes received for a resumable upload
+            std::optional<std::uint64_t> size = upload_size(user.value(), req_path.substr(8));
+            if (!size)
+                return send(not_found());
+
+            std::string body = std::to_string(size.value());
+            http::response<http::string_body> res{http::status::ok, req.version(), body};
+            res.set(http::field::content_type, "text/plain");
+            return send(std::move(res));
+        }
         return send(not_found());
     }
 
@@ -291,6 +807,15 @@ void handle_request(http::request<Body, http::basic_fields<Allocator>>&& req,Sen
                 return send(not_found());
             }
         }
+
+        //if starts with upload
+        if (req_path.rfind("/upload/", 0) == 0) {
+            // abort a resumable upload
+            if (upload_abort(user.value(), req_path.substr(8)))
+                return send(okay_response());
+            else
+                return send(not_found());
+        }
         return send(not_found());
     }
 }
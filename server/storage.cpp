@@ -0,0 +1,402 @@
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+#include "storage.h"
+#include "configuration.h"
+#include "gzip.h"
+#include "IoRing.h"
+
+/**
+ * read a little endian number
+ *
+ * @param data where the number starts
+ * @param n number of bytes
+ * @return the number
+ */
+static std::uint64_t read_number(const unsigned char *data, int n) {
+    std::uint64_t value = 0;
+    for (int i = n - 1; i >= 0; i--)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+/**
+ * write a little endian number
+ *
+ * @param out the stored file
+ * @param value the number
+ * @param n number of bytes
+ */
+static void write_number(std::ostream &out, std::uint64_t value, int n) {
+    char bytes[8];
+    for (int i = 0; i < n; i++) {
+        bytes[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+    out.write(bytes, n);
+}
+
+StoredFile::StoredFile(StoredFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+StoredFile &StoredFile::operator=(StoredFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = std::exchange(other.fd_, -1);
+        compressed_ = other.compressed_;
+        size_ = other.size_;
+        frame_size_ = other.frame_size_;
+        offsets_ = std::move(other.offsets_);
+        lengths_ = std::move(other.lengths_);
+        frame_ = other.frame_;
+        data_ = std::move(other.data_);
+        loaded_ = other.loaded_;
+        pos_ = other.pos_;
+        other.close();
+    }
+    return *this;
+}
+
+StoredFile::~StoredFile() {
+    close();
+}
+
+/**
+ * read n bytes of the stored file
+ *
+ * @param offset in the stored file
+ * @param buf where the bytes are written
+ * @param n number of bytes
+ * @return false if the file has less than n bytes from offset or a error occurred
+ */
+bool StoredFile::read_at(std::uint64_t offset, char *buf, std::size_t n) {
+    while (n > 0) {
+        ssize_t done = pread(fd_, buf, n, static_cast<off_t>(offset));
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            return false;
+        buf += done;
+        offset += done;
+        n -= done;
+    }
+    return true;
+}
+
+/**
+ * open a stored file: for a compressed file (with the attribute STORE_XATTR) the header and the sizes of the frames
+ * are read, the frames are read only when needed
+ *
+ * @param abs_path absolute path of the file
+ * @return false if the file can't be read or the compressed format is not valid
+ */
+bool StoredFile::open(const std::string &abs_path) {
+    close();
+    fd_ = ::open(abs_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+        return false;
+
+    struct stat st{};
+    if (fstat(fd_, &st) != 0) {
+        close();
+        return false;
+    }
+    auto file_size = static_cast<std::uint64_t>(st.st_size);
+
+    // the attribute is read from the file opened, so it can't be of another version of the path
+    char mark[1];
+    if (fgetxattr(fd_, STORE_XATTR, mark, sizeof(mark)) < 0) {
+        // stored as it was received
+        size_ = file_size;
+        return true;
+    }
+
+    unsigned char header[STORE_HEADER_SIZE];
+    if (file_size < STORE_HEADER_SIZE || !read_at(0, reinterpret_cast<char *>(header), STORE_HEADER_SIZE) ||
+        std::memcmp(header, STORE_MAGIC, STORE_MAGIC_SIZE) != 0) {
+        close();
+        return false;
+    }
+
+    compressed_ = true;
+    frame_size_ = read_number(header + STORE_MAGIC_SIZE + 4, 4);
+    size_ = read_number(header + STORE_MAGIC_SIZE + 8, 8);
+    if (frame_size_ == 0 || frame_size_ >= STORE_RAW_FRAME) {
+        close();
+        return false;
+    }
+
+    // the sizes of the frames are at the end of the file: the number of frames is checked against the size of the
+    // file before it is used, so a bad header can't overflow the computations
+    std::uint64_t frames = size_ / frame_size_ + (size_ % frame_size_ != 0);
+    if (frames > (file_size - STORE_HEADER_SIZE) / 4) {
+        close();
+        return false;
+    }
+    std::unique_ptr<unsigned char[]> table{new unsigned char[frames * 4 + 1]};
+    if (!read_at(file_size - frames * 4, reinterpret_cast<char *>(table.get()), frames * 4)) {
+        close();
+        return false;
+    }
+
+    std::uint64_t offset = STORE_HEADER_SIZE;
+    for (std::uint64_t i = 0; i < frames; i++) {
+        std::uint32_t length = read_number(table.get() + 4 * i, 4);
+        offsets_.push_back(offset);
+        lengths_.push_back(length);
+        offset += length & ~STORE_RAW_FRAME;
+    }
+    if (offset != file_size - frames * 4) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool StoredFile::is_open() const {
+    return fd_ >= 0;
+}
+
+void StoredFile::close() {
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    compressed_ = false;
+    size_ = 0;
+    frame_size_ = 0;
+    offsets_.clear();
+    lengths_.clear();
+    data_.clear();
+    loaded_ = false;
+    pos_ = 0;
+}
+
+/**
+ * @return true if the file is stored compressed
+ */
+bool StoredFile::compressed() const {
+    return compressed_;
+}
+
+/**
+ * @return size of the original content
+ */
+std::uint64_t StoredFile::size() const {
+    return size_;
+}
+
+/**
+ * move the position of the next read
+ *
+ * @param offset in the original content
+ */
+void StoredFile::seek(std::uint64_t offset) {
+    pos_ = offset;
+}
+
+/**
+ * read a frame of a compressed file in data_
+ *
+ * @param frame index of the frame
+ * @return false if the frame can't be read or decompressed
+ */
+bool StoredFile::load_frame(std::uint64_t frame) {
+    if (loaded_ && frame_ == frame)
+        return true;
+    loaded_ = false;
+
+    std::uint32_t length = lengths_[frame] & ~STORE_RAW_FRAME;
+    std::uint64_t expected = std::min<std::uint64_t>(frame_size_, size_ - frame * frame_size_);
+    std::string stored(length, 0);
+    if (!read_at(offsets_[frame], &stored[0], length))
+        return false;
+
+    if (lengths_[frame] & STORE_RAW_FRAME) {
+        data_ = std::move(stored);
+    } else {
+        std::optional<std::string> data = gzip::decompress(stored.data(), stored.size(), expected);
+        if (!data)
+            return false;
+        data_ = std::move(data.value());
+    }
+    if (data_.size() != expected)
+        return false;
+
+    frame_ = frame;
+    loaded_ = true;
+    return true;
+}
+
+/**
+ * read the original content from the current position
+ *
+ * @param buf where the bytes are written
+ * @param n number of bytes to read
+ * @return number of bytes read, less than n only at the end of the file or if a error occurred
+ */
+std::size_t StoredFile::read(char *buf, std::size_t n) {
+    if (fd_ < 0)
+        return 0;
+
+    if (!compressed_) {
+        std::size_t done = 0;
+        while (done < n) {
+            ssize_t r = pread(fd_, buf + done, n - done, static_cast<off_t>(pos_));
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            done += r;
+            pos_ += r;
+        }
+        return done;
+    }
+
+    std::size_t done = 0;
+    while (done < n && pos_ < size_) {
+        std::uint64_t frame = pos_ / frame_size_;
+        if (!load_frame(frame))
+            break;
+        std::size_t start = pos_ - frame * frame_size_;
+        std::size_t amount = std::min<std::size_t>(n - done, data_.size() - start);
+        std::memcpy(buf + done, data_.data() + start, amount);
+        done += amount;
+        pos_ += amount;
+    }
+    return done;
+}
+
+bool ring_storage() {
+    static const bool ring = configuration::io_engine == "uring" && IoRing::getInstance()->available();
+    return ring;
+}
+
+/**
+ * compress a file in frames, a frame that doesn't shrink is kept as it is
+ *
+ * @param src_path file to compress
+ * @param dst_path where the compressed file is written
+ * @param level of compression, from 1 to 9
+ * @param frame_size bytes of the original content in each frame
+ * @return true if dst_path was written, it is smaller than src_path and it is marked as compressed (the filesystem of
+ * the backuppath must support the user extended attributes)
+ */
+bool store_compressed(const std::string &src_path, const std::string &dst_path, int level,
+                      std::uint64_t frame_size) {
+    std::ifstream in(src_path, std::ios::in | std::ios::binary);
+    if (!in.is_open() || frame_size == 0 || frame_size >= STORE_RAW_FRAME)
+        return false;
+    in.seekg(0, std::ios::end);
+    auto size = static_cast<std::uint64_t>(in.tellg());
+    in.seekg(0);
+
+    std::ofstream out(dst_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+    out.write(STORE_MAGIC, STORE_MAGIC_SIZE);
+    write_number(out, level, 4);
+    write_number(out, frame_size, 4);
+    write_number(out, size, 8);
+
+    std::unique_ptr<char[]> buf{new char[frame_size]};
+    std::vector<std::uint32_t> lengths;
+    std::uint64_t stored = STORE_HEADER_SIZE;
+    std::uint64_t read = 0;
+    while (read < size) {
+        std::size_t n = std::min<std::uint64_t>(frame_size, size - read);
+        if (!in.read(buf.get(), static_cast<std::streamsize>(n)))
+            return false;
+        read += n;
+
+        std::string compressed = gzip::compress(buf.get(), n, level);
+        if (compressed.size() < n) {
+            out.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+            lengths.push_back(compressed.size());
+        } else {
+            out.write(buf.get(), static_cast<std::streamsize>(n));
+            lengths.push_back(n | STORE_RAW_FRAME);
+        }
+        stored += (lengths.back() & ~STORE_RAW_FRAME) + 4;
+        // already compressed data: the file is stored as it is
+        if (read >= 4 * frame_size && stored >= read)
+            return false;
+    }
+    for (std::uint32_t length: lengths)
+        write_number(out, length, 4);
+    out.close();
+    if (out.fail() || stored >= size)
+        return false;
+
+    // without the attribute the file would be read as it is, so it is stored compressed only if it can be marked
+    return setxattr(dst_path.c_str(), STORE_XATTR, "1", 1, 0) == 0;
+}
+
+/**
+ * @param abs_path absolute path of a stored file
+ * @return the size of its original content (read from the header if it is compressed)
+ */
+std::optional<std::uint64_t> stored_size(const std::string &abs_path) {
+    StoredFile file;
+    if (!file.open(abs_path))
+        return {};
+    return file.size();
+}
+
+/**
+ * compute the digests of the original content of some stored files
+ *
+ * @param abs_paths absolute paths of the files
+ * @param algorithm of the digests
+ * @return the digests in hexadecimal format in the same order, a empty optional for the files that can't be read
+ */
+std::vector<std::optional<std::string>> stored_digests(const std::vector<std::string> &abs_paths,
+                                                       digest::Algorithm algorithm) {
+    std::vector<std::optional<std::string>> digests(abs_paths.size());
+    std::vector<std::string> plain;
+    std::vector<std::size_t> positions;
+    std::unique_ptr<char[]> buf;
+
+    for (std::size_t i = 0; i < abs_paths.size(); i++) {
+        StoredFile file;
+        if (!file.open(abs_paths[i]))
+            continue;
+        if (!file.compressed()) {
+            plain.push_back(abs_paths[i]);
+            positions.push_back(i);
+            continue;
+        }
+
+        if (!buf)
+            buf.reset(new char[1024 * 1024]);
+        digest::Hasher hasher(algorithm);
+        std::uint64_t remain = file.size();
+        while (remain > 0) {
+            std::size_t n = file.read(buf.get(), std::min<std::uint64_t>(remain, 1024 * 1024));
+            if (n == 0)
+                break;
+            hasher.update(buf.get(), n);
+            remain -= n;
+        }
+        if (remain == 0)
+            digests[i] = hasher.final();
+    }
+
+    if (ring_storage() && IoRing::getInstance()->fixed_reads()) {
+        // read in the registered buffers of the ring
+        for (std::size_t j = 0; j < plain.size(); j++)
+            digests[positions[j]] = IoRing::getInstance()->digest_file(plain[j], algorithm);
+        return digests;
+    }
+
+    std::vector<std::optional<std::string>> computed = digest::files(plain, algorithm);
+    for (std::size_t j = 0; j < plain.size(); j++)
+        digests[positions[j]] = computed[j];
+    return digests;
+}
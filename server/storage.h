@@ -0,0 +1,75 @@
+#ifndef SERVER_PROGETTO_STORAGE_H
+#define SERVER_PROGETTO_STORAGE_H
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "digest.h"
+
+// first bytes of a file stored compressed, the format is:
+// magic, level (4 bytes), size of the frames (4 bytes), size of the original file (8 bytes), the frames (each one
+// the gzip of frame size bytes of the file, the last one shorter) and the stored size of each frame (4 bytes, the
+// highest bit is set if the frame is not compressed). Numbers are little endian.
+// The frames are compressed independently, so a read at any offset decompresses only one frame.
+// A compressed file is marked by the extended attribute STORE_XATTR (it follows the file in the renames): the content
+// of a file stored as it was received can start with the magic too
+#define STORE_XATTR "user.backup.compressed"
+#define STORE_MAGIC "\x89" "BKZ\r\n\x1a\n"
+#define STORE_MAGIC_SIZE 8
+#define STORE_HEADER_SIZE (STORE_MAGIC_SIZE + 4 + 4 + 8)
+#define STORE_RAW_FRAME 0x80000000u
+
+// A file of the backup, stored as it was received or compressed in frames: the reads always return the original
+// content, a compressed frame is decompressed when the reads reach it
+class StoredFile {
+    int fd_ = -1;
+    bool compressed_ = false;
+    std::uint64_t size_ = 0;                // size of the original content
+    std::uint64_t frame_size_ = 0;
+    std::vector<std::uint64_t> offsets_;    // position of each frame in the stored file
+    std::vector<std::uint32_t> lengths_;    // stored size of each frame (with STORE_RAW_FRAME)
+    std::uint64_t frame_ = 0;               // frame in data_
+    std::string data_;                      // content of the last frame read
+    bool loaded_ = false;
+    std::uint64_t pos_ = 0;
+
+    bool load_frame(std::uint64_t frame);
+    bool read_at(std::uint64_t offset, char *buf, std::size_t n);
+
+public:
+    StoredFile() = default;
+    StoredFile(StoredFile &&other) noexcept;
+    StoredFile &operator=(StoredFile &&other) noexcept;
+    ~StoredFile();
+
+    bool open(const std::string &abs_path);
+    bool is_open() const;
+    void close();
+
+    bool compressed() const;
+    std::uint64_t size() const;
+
+    void seek(std::uint64_t offset);
+    std::size_t read(char *buf, std::size_t n);
+};
+
+// true if the storage operations use io_uring (io_engine=uring and the kernel supports it)
+bool ring_storage();
+
+// write the content of src_path in dst_path compressed in frames, false if the compression doesn't save space
+// (dst_path is not written) or a error occurred
+bool store_compressed(const std::string &src_path, const std::string &dst_path, int level,
+                      std::uint64_t frame_size);
+
+// size of the original content of a stored file, a empty optional if it can't be read
+std::optional<std::uint64_t> stored_size(const std::string &abs_path);
+
+// digests of the original content of stored files, in the same order (a empty optional for the files that can't be
+// read): the files not compressed are hashed together, the others while they are decompressed
+std::vector<std::optional<std::string>> stored_digests(const std::vector<std::string> &abs_paths,
+                                                       digest::Algorithm algorithm);
+
+#endif //SERVER_PROGETTO_STORAGE_H
@@ -0,0 +1,189 @@
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "tree.h"
+#include "backup.h"
+#include "dao.h"
+
+namespace fs = std::filesystem;
+
+// incremented when a hash is removed: a hash computed while the content was changing is not saved
+static std::uint64_t tree_generation = 0;
+static std::mutex tree_mutex;
+
+/**
+ * the hash of a folder is the SHA256 of its children sorted by name, each one as
+ * type, hash, name and a '\0' (a name can't contain it)
+ *
+ * @param children of the folder, by name
+ * @return the hash in hexadecimal format
+ */
+std::string tree_hash(const std::map<std::string, TreeChild> &children) {
+    digest::Hasher hasher(digest::algorithm_sha256);
+    for (const auto &[name, child]: children) {
+        hasher.update(&child.type, 1);
+        hasher.update(child.hash.data(), child.hash.size());
+        hasher.update(name.c_str(), name.size() + 1);
+    }
+    return hasher.final();
+}
+
+/**
+ * @param path relative path, with or without the final '/'
+ * @return the path without the final '/' (a empty string for the root)
+ */
+static std::string normalize(std::string path) {
+    while (!path.empty() && path.back() == '/')
+        path.pop_back();
+    return path;
+}
+
+/**
+ * save the hash of a folder, unless its content changed while it was computed
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the folder (normalized)
+ * @param algorithm of the digests of the files
+ * @param hash of the folder
+ * @param generation value of tree_generation when the computation started
+ */
+static void save_hash(const std::string &user, const std::string &path, digest::Algorithm algorithm,
+                      const std::string &hash, std::uint64_t generation) {
+    std::lock_guard lg(tree_mutex);
+    if (generation == tree_generation)
+        Dao::getInstance()->saveTreeHash(user, path, digest::name(algorithm), hash);
+}
+
+static std::optional<std::string> directory_hash(const std::string &user, const std::string &path,
+                                                 digest::Algorithm algorithm, std::uint64_t generation);
+
+/**
+ * list the children of a folder with their hashes
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the folder (normalized)
+ * @param algorithm of the digests of the files
+ * @param generation value of tree_generation when the computation started
+ * @return the children by name, a empty optional if the folder doesn't exist
+ */
+static std::optional<std::map<std::string, TreeChild>> read_children(const std::string &user,
+                                                                     const std::string &path,
+                                                                     digest::Algorithm algorithm,
+                                                                     std::uint64_t generation) {
+    std::error_code ec;
+    fs::directory_iterator it(get_abs_path(user, path), ec);
+    if (ec)
+        return {};
+
+    std::map<std::string, TreeChild> children;
+    std::vector<std::string> names, files;
+    for (fs::directory_iterator end; it != end; it.increment(ec)) {
+        if (ec)
+            return {};
+        std::string name = it->path().filename().string();
+        std::string child = path.empty() ? name : path + "/" + name;
+
+        // a child removed in the meantime is not in the hash
+        if (it->is_directory(ec)) {
+            std::optional<std::string> hash = directory_hash(user, child, algorithm, generation);
+            if (hash)
+                children[name] = TreeChild{TREE_FOLDER, hash.value()};
+        } else if (it->is_regular_file(ec)) {
+            names.push_back(name);
+            files.push_back(child);
+        }
+    }
+
+    // the files of the folder are hashed together
+    std::vector<std::optional<std::string>> digests = get_file_digests(user, files, algorithm);
+    for (std::size_t i = 0; i < files.size(); i++) {
+        if (digests[i])
+            children[names[i]] = TreeChild{TREE_FILE, digests[i].value()};
+    }
+    return children;
+}
+
+/**
+ * get the hash of a folder: the saved one if its content didn't change since it was computed,
+ * otherwise it is computed from the children (only the sub-folders changed are computed again) and saved
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the folder (normalized)
+ * @param algorithm of the digests of the files
+ * @param generation value of tree_generation when the computation started
+ * @return the hash, a empty optional if the folder doesn't exist
+ */
+static std::optional<std::string> directory_hash(const std::string &user, const std::string &path,
+                                                 digest::Algorithm algorithm, std::uint64_t generation) {
+    std::optional<std::string> saved = Dao::getInstance()->getTreeHash(user, path, digest::name(algorithm));
+    if (saved)
+        return saved;
+
+    std::optional<std::map<std::string, TreeChild>> children = read_children(user, path, algorithm, generation);
+    if (!children)
+        return {};
+
+    std::string hash = tree_hash(children.value());
+    save_hash(user, path, algorithm, hash, generation);
+    return hash;
+}
+
+/**
+ * get the hash of a folder and, if it is different from the one known by the client, the hashes of its children
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the folder
+ * @param known_hash hash of the folder on the client (can be empty)
+ * @param algorithm of the digests of the files
+ * @return the node, a empty optional if the folder doesn't exist
+ */
+std::optional<TreeNode> probe_tree(const std::string &user, const std::string &path, const std::string &known_hash,
+                                   digest::Algorithm algorithm) {
+    std::string folder = normalize(path);
+    std::uint64_t generation;
+    {
+        std::lock_guard lg(tree_mutex);
+        generation = tree_generation;
+    }
+
+    // nothing changed: the saved hash is enough, without reading the folder
+    std::optional<std::string> saved = Dao::getInstance()->getTreeHash(user, folder, digest::name(algorithm));
+    if (saved && saved.value() == known_hash && fs::is_directory(get_abs_path(user, folder)))
+        return TreeNode{saved.value(), {}};
+
+    std::optional<std::map<std::string, TreeChild>> children = read_children(user, folder, algorithm, generation);
+    if (!children)
+        return {};
+
+    std::string hash = tree_hash(children.value());
+    save_hash(user, folder, algorithm, hash, generation);
+    if (hash == known_hash)
+        return TreeNode{hash, {}};
+    return TreeNode{hash, std::move(children.value())};
+}
+
+/**
+ * remove the saved hashes that are not valid anymore after a change
+ *
+ * @param user username of the authenticated user
+ * @param path relative path of the file/folder changed
+ * @param subtree true if path is a folder created or removed (the hashes of its sub-folders are removed too)
+ */
+void invalidate_tree(const std::string &user, const std::string &path, bool subtree) {
+    std::string changed = normalize(path);
+
+    // the folders that contain the path, up to the root
+    std::vector<std::string> parents;
+    for (std::string parent = changed; !parent.empty();) {
+        std::size_t pos = parent.rfind('/');
+        parent = pos == std::string::npos ? "" : parent.substr(0, pos);
+        parents.push_back(parent);
+    }
+
+    std::lock_guard lg(tree_mutex);
+    tree_generation++;
+    if (subtree)
+        Dao::getInstance()->deleteTreeHashes(user, changed);
+    Dao::getInstance()->deleteTreeHashes(user, parents);
+}
@@ -0,0 +1,37 @@
+#ifndef SERVER_PROGETTO_TREE_H
+#define SERVER_PROGETTO_TREE_H
+
+#include <map>
+#include <optional>
+#include <string>
+
+#include "digest.h"
+
+// types of the children of a folder in the Merkle tree
+#define TREE_FILE 'f'
+#define TREE_FOLDER 'd'
+
+// a child of a folder: its type and its hash (digest of the content for a file, hash of the folder otherwise)
+struct TreeChild {
+    char type;
+    std::string hash;
+};
+
+// a folder with the hashes of its direct children, by name
+struct TreeNode {
+    std::string hash;
+    std::map<std::string, TreeChild> children;
+};
+
+// hash of a folder built from names, types and hashes of its children
+std::string tree_hash(const std::map<std::string, TreeChild> &children);
+
+// hash of a folder with the digests of the files in the given algorithm, the children are listed only if the hash is
+// different from known_hash
+std::optional<TreeNode> probe_tree(const std::string &user, const std::string &path, const std::string &known_hash,
+                                   digest::Algorithm algorithm = digest::algorithm_sha256);
+
+// the content of path changed: the hashes of its folders (if subtree) and of the folders containing it are removed
+void invalidate_tree(const std::string &user, const std::string &path, bool subtree);
+
+#endif //SERVER_PROGETTO_TREE_H
@@ -0,0 +1,311 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "upload.h"
+#include "backup.h"
+#include "authorization.h"
+#include "configuration.h"
+
+namespace fs = std::filesystem;
+
+// an upload session: the data is appended in a file of the UPLOADS_DIR,
+// the info file (same name + ".info") contains the user and the destination path, its last write time is the last
+// time the session received data
+struct UploadSession {
+    std::string user;
+    std::string path;
+    bool busy = false;
+};
+
+static std::mutex m_uploads;
+static std::unordered_map<std::string, UploadSession> uploads;
+
+/**
+ * @param id of the upload session
+ * @return the path of the file with the received data
+ */
+static std::string data_path_of(const std::string &id) {
+    return configuration::backuppath + UPLOADS_DIR + id;
+}
+
+/**
+ * @param id of the upload session
+ * @return true if the session didn't receive data for upload_expiry hours (or its info file can't be read)
+ */
+static bool is_expired(const std::string &id) {
+    std::error_code ec;
+    fs::file_time_type last = fs::last_write_time(data_path_of(id) + ".info", ec);
+    return ec || fs::file_time_type::clock::now() - last > std::chrono::hours(configuration::upload_expiry);
+}
+
+/**
+ * remove the files of an upload session
+ *
+ * @param id of the upload session
+ */
+static void remove_upload_files(const std::string &id) {
+    std::error_code ec;
+    fs::remove(data_path_of(id), ec);
+    fs::remove(data_path_of(id) + ".info", ec);
+}
+
+/**
+ * read the info files of the UPLOADS_DIR, so the uploads can be resumed also after a restart of the server.
+ * The expired sessions and the files of no session are removed, then a thread removes the sessions that expire
+ * every UPLOAD_EXPIRY_CHECK seconds
+ */
+void load_uploads() {
+    std::lock_guard lg(m_uploads);
+
+    std::string dir = configuration::backuppath + UPLOADS_DIR;
+    fs::create_directory(dir);
+
+    std::vector<fs::path> data_files;
+    for (const fs::directory_entry &entry : fs::directory_iterator(dir)) {
+        if (entry.path().extension() != ".info") {
+            data_files.push_back(entry.path());
+            continue;
+        }
+
+        std::string id = entry.path().stem().string();
+        std::ifstream info(entry.path());
+        UploadSession session;
+        if (std::getline(info, session.user) && std::getline(info, session.path) &&
+            fs::is_regular_file(data_path_of(id)) && !is_expired(id))
+            uploads[id] = session;
+        else
+            remove_upload_files(id);
+    }
+    for (const fs::path &data_file: data_files) {
+        std::error_code ec;
+        if (uploads.count(data_file.filename().string()) == 0)
+            fs::remove(data_file, ec);
+    }
+
+    // the thread lives as the process
+    std::thread([]() {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::seconds(UPLOAD_EXPIRY_CHECK));
+            expire_uploads();
+        }
+    }).detach();
+}
+
+/**
+ * remove the upload sessions that didn't receive data for upload_expiry hours, the client that opened them was
+ * stopped or gave up
+ */
+void expire_uploads() {
+    std::vector<std::string> expired;
+    {
+        std::lock_guard lg(m_uploads);
+        for (auto it = uploads.begin(); it != uploads.end();) {
+            if (!it->second.busy && is_expired(it->first)) {
+                expired.push_back(it->first);
+                it = uploads.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const std::string &id: expired)
+        remove_upload_files(id);
+}
+
+/**
+ * open a new upload session with a empty data file
+ *
+ * @param user username of the authenticated user
+ * @param path destination of the file once committed
+ * @return the id of the session, a empty optional if an error occurred
+ */
+std::optional<std::string> upload_create(const std::string &user, const std::string &path) {
+    std::string id = createToken(16);
+
+    std::ofstream data(data_path_of(id), std::ios::out | std::ios::binary | std::ios::trunc);
+    std::ofstream info(data_path_of(id) + ".info", std::ios::out | std::ios::trunc);
+    if (!data.is_open() || !info.is_open())
+        return {};
+    info << user << "\n" << path << "\n";
+
+    std::lock_guard lg(m_uploads);
+    uploads[id] = UploadSession{user, path};
+    return id;
+}
+
+/**
+ * @param user username of the authenticated user
+ * @param id of the upload session
+ * @return the number of bytes received, a empty optional if the session doesn't exist
+ */
+std::optional<std::uint64_t> upload_size(const std::string &user, const std::string &id) {
+    {
+        std::lock_guard lg(m_uploads);
+        auto it = uploads.find(id);
+        if (it == uploads.end() || it->second.user != user)
+            return {};
+    }
+
+    std::error_code ec;
+    std::uint64_t size = fs::file_size(data_path_of(id), ec);
+    if (ec)
+        return {};
+    return size;
+}
+
+/**
+ * reserve the upload session for a write, only a request at time can write the data
+ *
+ * @param user username of the authenticated user
+ * @param id of the upload session
+ * @param offset position of the first byte that will be written
+ * @param data_path set to the file where the data must be written
+ * @return upload_ok if the session was reserved
+ */
+UploadState upload_lock(const std::string &user, const std::string &id, std::uint64_t offset, std::string &data_path) {
+    std::lock_guard lg(m_uploads);
+
+    auto it = uploads.find(id);
+    if (it == uploads.end() || it->second.user != user)
+        return upload_not_found;
+    if (it->second.busy)
+        return upload_busy;
+
+    std::error_code ec;
+    std::uint64_t size = fs::file_size(data_path_of(id), ec);
+    if (ec)
+        return upload_not_found;
+    // the data must be contiguous
+    if (size != offset)
+        return upload_bad_offset;
+
+    it->second.busy = true;
+    data_path = data_path_of(id);
+    // the session is active, it doesn't expire
+    fs::last_write_time(data_path + ".info", fs::file_time_type::clock::now(), ec);
+    return upload_ok;
+}
+
+/**
+ * release the upload session after a write
+ *
+ * @param id of the upload session
+ */
+void upload_unlock(const std::string &id) {
+    std::lock_guard lg(m_uploads);
+
+    auto it = uploads.find(id);
+    if (it != uploads.end())
+        it->second.busy = false;
+}
+
+/**
+ * complete the upload session moving the file in the backup of the user
+ *
+ * @param user username of the authenticated user
+ * @param id of the upload session
+ * @param size expected size of the file
+ * @param expected version of the file to replace
+ * @return upload_ok if the file has been saved, upload_changed if the file is not the expected version (the upload
+ * is removed anyway)
+ */
+UploadState upload_commit(const std::string &user, const std::string &id, std::uint64_t size,
+                          const ExpectedVersion &expected) {
+    std::unique_lock ul(m_uploads);
+
+    auto it = uploads.find(id);
+    if (it == uploads.end() || it->second.user != user)
+        return upload_not_found;
+    if (it->second.busy)
+        return upload_busy;
+
+    std::error_code ec;
+    if (fs::file_size(data_path_of(id), ec) != size || ec)
+        return upload_bad_offset;
+
+    std::string path = it->second.path;
+    uploads.erase(it);
+    ul.unlock();
+
+    fs::remove(data_path_of(id) + ".info", ec);
+    switch (replace_file(user, path, data_path_of(id), expected)) {
+        case save_ok: return upload_ok;
+        case save_changed: return upload_changed;
+        case save_error: break;
+    }
+    return upload_error;
+}
+
+/**
+ * complete the upload session building the file from its manifest: the received data contains only the
+ * chunks not already on the server
+ *
+ * @param user username of the authenticated user
+ * @param id of the upload session
+ * @param size expected size of the received data
+ * @param manifest list of the chunks of the file
+ * @param missing filled with the chunks not sent and not found on the server
+ * @param expected version of the file to replace
+ * @return upload_ok if the file has been saved, upload_changed if the file is not the expected version (the upload
+ * is removed anyway)
+ */
+UploadState upload_commit_chunks(const std::string &user, const std::string &id, std::uint64_t size,
+                                 const std::vector<ManifestEntry> &manifest, std::vector<std::string> &missing,
+                                 const ExpectedVersion &expected) {
+    std::string path;
+    {
+        std::lock_guard lg(m_uploads);
+
+        auto it = uploads.find(id);
+        if (it == uploads.end() || it->second.user != user)
+            return upload_not_found;
+        if (it->second.busy)
+            return upload_busy;
+
+        std::error_code ec;
+        if (fs::file_size(data_path_of(id), ec) != size || ec)
+            return upload_bad_offset;
+
+        // no other request can use the session while the file is built
+        it->second.busy = true;
+        path = it->second.path;
+    }
+
+    SaveState state = assemble_file(user, path, data_path_of(id), manifest, missing, expected);
+    if (state == save_error) {
+        upload_unlock(id);
+        return missing.empty() ? upload_error : upload_missing;
+    }
+
+    {
+        std::lock_guard lg(m_uploads);
+        uploads.erase(id);
+    }
+    remove_upload_files(id);
+    // a new version of the file must be uploaded again from the start
+    return state == save_changed ? upload_changed : upload_ok;
+}
+
+/**
+ * remove an upload session without saving the file
+ *
+ * @param user username of the authenticated user
+ * @param id of the upload session
+ * @return true if the session existed
+ */
+bool upload_abort(const std::string &user, const std::string &id) {
+    {
+        std::lock_guard lg(m_uploads);
+        auto it = uploads.find(id);
+        if (it == uploads.end() || it->second.user != user || it->second.busy)
+            return false;
+        uploads.erase(it);
+    }
+
+    remove_upload_files(id);
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef SERVER_PROGETTO_UPLOAD_H
+#define SERVER_PROGETTO_UPLOAD_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "chunks.h"
+
+// folder in the backuppath where the data of the resumable uploads is kept until the commit
+#define UPLOADS_DIR ".uploads/"
+// seconds between two checks of the upload sessions expired (no data received for upload_expiry hours)
+#define UPLOAD_EXPIRY_CHECK 3600
+
+// result of the operations on an upload session
+enum UploadState {
+    upload_ok,
+    upload_not_found,   // no upload session with that id for the user
+    upload_busy,        // another request is writing in the upload session
+    upload_bad_offset,  // the data doesn't start where the received data ends
+    upload_error,       // the file can't be saved
+    upload_missing,     // some chunks of the manifest are not on the server
+    upload_changed      // the file is not the version expected by the client (If-Match), it is not replaced
+};
+
+// load the upload sessions not committed before the last shutdown, the expired ones are removed
+void load_uploads();
+
+// remove the upload sessions that didn't receive data for upload_expiry hours
+void expire_uploads();
+
+// open a new upload session for the file in path, return the id of the session
+std::optional<std::string> upload_create(const std::string &user, const std::string &path);
+
+// number of bytes received for the upload session, a empty optional if it doesn't exist
+std::optional<std::uint64_t> upload_size(const std::string &user, const std::string &id);
+
+// reserve the upload session for writing the data starting at offset
+UploadState upload_lock(const std::string &user, const std::string &id, std::uint64_t offset, std::string &data_path);
+
+// release the upload session after a write (completed or not)
+void upload_unlock(const std::string &id);
+
+// move the received file in place if it has the expected size and the file is the expected version
+UploadState upload_commit(const std::string &user, const std::string &id, std::uint64_t size,
+                          const ExpectedVersion &expected);
+
+// build the file from the manifest, the received data contains the chunks marked as sent
+UploadState upload_commit_chunks(const std::string &user, const std::string &id, std::uint64_t size,
+                                 const std::vector<ManifestEntry> &manifest, std::vector<std::string> &missing,
+                                 const ExpectedVersion &expected);
+
+// remove the upload session and its data
+bool upload_abort(const std::string &user, const std::string &id);
+
+#endif //SERVER_PROGETTO_UPLOAD_H
@@ -0,0 +1,55 @@
+import requests
+import hashlib
+import sys
+
+
+if(len(sys.argv) != 3):
+	print("Usage: " + sys.argv[0] + " file_to_send path")
+	exit(-1)
+
+# the server accepts chunks of any size (up to 4 MiB), here the file is split in fixed size chunks
+chunk_size = 64 * 1024
+f = open(sys.argv[1],'rb')
+chunks = []
+while True:
+	data = f.read(chunk_size)
+	if not data:
+		break
+	chunks.append(data)
+
+
+#token for 'user0' 
+token = 'aaa'
+
+headers = {'Authorization' : token}
+
+server = "http://127.0.0.1:12345"
+
+# ask which chunks the server doesn't have
+hashes = [hashlib.sha256(c).hexdigest() for c in chunks]
+req = requests.post(server + "/chunks", json={'chunks': list(set(hashes))}, headers=headers)
+print(req)
+missing = set(req.json()['missing'])
+
+# send only the missing chunks (once each)
+manifest = []
+pack = b''
+for c, h in zip(chunks, hashes):
+	sent = h in missing
+	if sent:
+		missing.remove(h)
+		pack += c
+	manifest.append({'hash': h, 'size': len(c), 'sent': sent})
+
+req = requests.post(server + "/upload/" + sys.argv[2], headers=headers)
+print(req)
+upload_id = req.text
+
+req = requests.put(server + "/upload/" + upload_id + "?offset=0", data=pack, headers=headers)
+print(req)
+
+# build the file from the list of its chunks
+req = requests.post(server + "/commit/" + upload_id + "?size=" + str(len(pack)), json={'chunks': manifest},
+					headers=headers)
+print(req)
+print(req.text)
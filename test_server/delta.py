@@ -0,0 +1,35 @@
+import requests
+import hashlib
+import struct
+import sys
+
+
+if(len(sys.argv) != 3):
+	print("Usage: " + sys.argv[0] + " text_to_append path")
+	exit(-1)
+
+
+#token for 'user0' 
+token = 'aaa'
+
+headers = {'Authorization' : token}
+
+server = "http://127.0.0.1:12345"
+
+# signatures of the file on the server
+req = requests.get(server + "/signature/" + sys.argv[2], headers=headers)
+print(req)
+signatures = req.json()
+
+# the new file is the old one with the text appended
+text = sys.argv[1].encode()
+delta = b'C' + struct.pack('<QQ', 0, signatures['size']) + b'L' + struct.pack('<Q', len(text)) + text
+
+# the digest of the new file is needed, here the old content is read from a local copy
+old = open(sys.argv[2], 'rb').read()
+digest = hashlib.sha256(old + text).hexdigest()
+
+headers['Content-Type'] = 'application/octet-stream'
+req = requests.post(server + "/delta/" + sys.argv[2] + "?base=" + signatures['version'] + "&digest=" + digest,
+					data=delta, headers=headers)
+print(req)
@@ -0,0 +1,22 @@
+import requests
+import sys
+
+
+#token for 'user0' 
+token = 'aaa'
+
+headers = {'Authorization' : token}
+
+server = "http://127.0.0.1:12345"
+
+# the tree of the folder, compared with the hash known by the client (if given)
+path = sys.argv[1] if len(sys.argv) > 1 else ""
+known_hash = sys.argv[2] if len(sys.argv) > 2 else ""
+
+req = requests.get(server + "/probetree/" + path + "?hash=" + known_hash, headers=headers)
+print(req)
+if req.ok:
+	tree = req.json()
+	print(tree['hash'])
+	for child in tree['children']:
+		print(child['type'], child['hash'], child['name'])
@@ -0,0 +1,25 @@
+import requests
+import sys
+
+
+if(len(sys.argv) != 4):
+	print("Usage: " + sys.argv[0] + " file_to_send path expected_digest")
+	exit(-1)
+
+f = open(sys.argv[1],'rb')
+
+
+#token for 'user0' 
+token = 'aaa'
+
+# the file on the server is replaced only if its SHA256 is expected_digest ('*' if it must only exist):
+# 412 PRECONDITION FAILED otherwise
+headers = {'content-type': 'application/octet-stream',
+			'Authorization' : token,
+			'If-Match' : '"' + sys.argv[3] + '"'}
+
+myurl = "http://127.0.0.1:12345/backup/"+sys.argv[2]
+req = requests.post(myurl,data=f,headers=headers)
+
+print(req)
+print(req.text)
@@ -0,0 +1,22 @@
+import requests
+import sys
+
+
+if(len(sys.argv) != 3):
+	print("Usage: " + sys.argv[0] + " path file_to_write")
+	exit(-1)
+
+#token for 'user0' 
+token = 'aaa'
+
+headers = {'Authorization' : token}
+
+myurl = "http://127.0.0.1:12345/backup/"+sys.argv[1]
+# the content is received as a stream, without loading it in memory
+req = requests.get(myurl,headers=headers,stream=True)
+
+print(req)
+if req.status_code == 200:
+	with open(sys.argv[2],'wb') as f:
+		for block in req.iter_content(64 * 1024):
+			f.write(block)
@@ -0,0 +1,42 @@
+import requests
+import sys
+import os
+
+
+if(len(sys.argv) != 3 and len(sys.argv) != 4):
+	print("Usage: " + sys.argv[0] + " file_to_send path [expected_digest]")
+	exit(-1)
+
+part_size = 8 * 1024 * 1024
+size = os.path.getsize(sys.argv[1])
+f = open(sys.argv[1],'rb')
+
+
+#token for 'user0' 
+token = 'aaa'
+
+headers = {'Authorization' : token}
+
+server = "http://127.0.0.1:12345"
+
+# open the upload
+req = requests.post(server + "/upload/" + sys.argv[2], headers=headers)
+print(req)
+upload_id = req.text
+
+# send the parts, the server answers with the number of bytes received
+offset = 0
+while offset < size:
+	f.seek(offset)
+	req = requests.put(server + "/upload/" + upload_id + "?offset=" + str(offset),
+					   data=f.read(part_size), headers=headers)
+	print(req)
+	offset = int(req.text)
+
+# save the file, only if its SHA256 on the server is expected_digest when given: 412 PRECONDITION FAILED otherwise
+commit_headers = dict(headers)
+if len(sys.argv) == 4:
+	commit_headers['If-Match'] = '"' + sys.argv[3] + '"'
+req = requests.post(server + "/commit/" + upload_id + "?size=" + str(size), headers=commit_headers)
+print(req)
+print(req.text)
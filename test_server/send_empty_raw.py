@@ -0,0 +1,31 @@
+import requests
+import sys
+
+
+if(len(sys.argv) != 2):
+	print("Usage: " + sys.argv[0] + " path")
+	exit(-1)
+
+
+#token for 'user0'
+token = 'aaa'
+
+headers = {'content-type': 'application/octet-stream',
+			'Authorization' : token}
+
+server = "http://127.0.0.1:12345"
+
+# an empty file as raw body (Content-Length: 0): the server must answer at once, without waiting for a body
+req = requests.post(server + "/backup/" + sys.argv[1], data=b'', headers=headers, timeout=5)
+print(req)
+print(req.text)
+
+# an empty part of a resumable upload, the server answers with the bytes received (0)
+req = requests.post(server + "/upload/" + sys.argv[1], headers={'Authorization' : token}, timeout=5)
+print(req)
+upload_id = req.text
+req = requests.put(server + "/upload/" + upload_id + "?offset=0", data=b'', headers=headers, timeout=5)
+print(req)
+print(req.text)
+req = requests.post(server + "/commit/" + upload_id + "?size=0", headers={'Authorization' : token}, timeout=5)
+print(req)
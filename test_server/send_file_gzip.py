@@ -0,0 +1,28 @@
+import requests
+import sys
+import zlib
+
+
+if(len(sys.argv) != 3):
+	print("Usage: " + sys.argv[0] + " file_to_send path")
+	exit(-1)
+
+data = open(sys.argv[1],'rb').read()
+
+#token for 'user0' 
+token = 'aaa'
+
+# the body is compressed in gzip format, the server decompresses it while it is received
+compressor = zlib.compressobj(6, zlib.DEFLATED, 31)
+body = compressor.compress(data) + compressor.flush()
+print("size " + str(len(data)) + ", compressed " + str(len(body)))
+
+headers = {'content-type': 'application/octet-stream',
+			'content-encoding': 'gzip',
+			'Authorization' : token}
+
+myurl = "http://127.0.0.1:12345/backup/"+sys.argv[2]
+req = requests.post(myurl,data=body,headers=headers)
+
+print(req)
+print(req.text)
@@ -0,0 +1,23 @@
+import requests
+import sys
+
+
+if(len(sys.argv) != 3):
+	print("Usage: " + sys.argv[0] + " file_to_send path")
+	exit(-1)
+
+f = open(sys.argv[1],'rb')
+
+
+#token for 'user0' 
+token = 'aaa'
+
+headers = {'content-type': 'application/octet-stream',
+			'Authorization' : token}
+
+myurl = "http://127.0.0.1:12345/backup/"+sys.argv[2]
+# the file object is sent as a stream, without loading it in memory
+req = requests.post(myurl,data=f,headers=headers)
+
+print(req)
+print(req.text)